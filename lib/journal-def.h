@@ -44,6 +44,8 @@ typedef struct FieldObject FieldObject;
 typedef struct EntryObject EntryObject;
 typedef struct HashTableObject HashTableObject;
 typedef struct EntryArrayObject EntryArrayObject;
+typedef struct BloomObject BloomObject;
+typedef struct TokenObject TokenObject;
 
 typedef struct EntryItem EntryItem;
 typedef struct HashItem HashItem;
@@ -57,6 +59,9 @@ typedef enum ObjectType {
         OBJECT_DATA_HASH_TABLE,
         OBJECT_FIELD_HASH_TABLE,
         OBJECT_ENTRY_ARRAY,
+        OBJECT_BLOOM,
+        OBJECT_TOKEN,
+        OBJECT_TOKEN_HASH_TABLE,
         _OBJECT_TYPE_MAX
 } ObjectType;
 
@@ -127,6 +132,24 @@ struct EntryArrayObject {
         le64_t items[];
 } _packed_;
 
+/* Blocked bloom filter over the hashes of all data objects: each
+ * hash sets a few bits within a single block */
+struct BloomObject {
+        ObjectHeader object;
+        uint8_t bits[];
+} _packed_;
+
+/* Posting list of the data objects whose MESSAGE= values contain a
+ * token with this hash, stored like the entries of a data object */
+struct TokenObject {
+        ObjectHeader object;
+        le64_t hash;
+        le64_t next_hash_offset;
+        le64_t data_offset; /* the first array entry we store inline */
+        le64_t data_array_offset;
+        le64_t n_data;
+} _packed_;
+
 union Object {
         ObjectHeader object;
         DataObject data;
@@ -134,6 +157,8 @@ union Object {
         EntryObject entry;
         HashTableObject hash_table;
         EntryArrayObject entry_array;
+        BloomObject bloom;
+        TokenObject token;
 };
 
 enum {
@@ -149,6 +174,16 @@ enum {
         HEADER_INCOMPATIBLE_COMPRESSED_LZ4 = 1 << 1
 };
 
+enum {
+        /* 1 << 0 is used by sealed files of systemd */
+        HEADER_COMPATIBLE_BLOOM = 1 << 1,
+        HEADER_COMPATIBLE_TOKENS = 1 << 2,
+        HEADER_COMPATIBLE_REALTIME_ORDERED = 1 << 3
+};
+
+#define HEADER_COMPATIBLE_ANY (HEADER_COMPATIBLE_BLOOM|HEADER_COMPATIBLE_TOKENS|HEADER_COMPATIBLE_REALTIME_ORDERED)
+#define HEADER_COMPATIBLE_SUPPORTED HEADER_COMPATIBLE_ANY
+
 #define HEADER_INCOMPATIBLE_ANY (HEADER_INCOMPATIBLE_COMPRESSED_XZ|HEADER_INCOMPATIBLE_COMPRESSED_LZ4)
 
 #if defined(HAVE_XZ) && defined(HAVE_LZ4)
@@ -203,6 +238,12 @@ struct Header {
         /* Added in 189 */
         le64_t n_tags;
         le64_t n_entry_arrays;
-
-        /* Size: 240 */
+        /* Added in 214.3 */
+        le64_t bloom_offset;
+        le64_t bloom_size;
+        le64_t token_hash_table_offset;
+        le64_t token_hash_table_size;
+        le64_t n_tokens;
+
+        /* Size: 280 */
 } _packed_;
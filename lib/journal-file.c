@@ -61,6 +61,11 @@
 /* n_data was the first entry we added after the initial file format design */
 #define HEADER_SIZE_MIN ALIGN64(offsetof(Header, n_data))
 
+/* The bloom filter is made of blocks of one cache line each, and every
+ * data hash sets this many bits in one of them */
+#define BLOOM_BLOCK_SIZE 64ULL
+#define BLOOM_N_HASHES 7
+
 /* How many entries to keep in the entry array chain cache at max */
 #define CHAIN_CACHE_MAX 20
 
@@ -112,8 +117,15 @@ int journal_file_set_offline(JournalFile *f) {
 }
 
 void journal_file_close(JournalFile *f) {
+        unsigned i;
+
         assert(f);
 
+        /* Tell followers about the last entries */
+        if (f->notify_pending &&
+            (!f->notify_followers_only || journal_file_has_followers(f) != 0))
+                journal_file_post_change(f);
+
         /* Sync everything to disk, before we mark the file offline */
         if (f->mmap && f->fd >= 0)
                 mmap_cache_close_fd(f->mmap, f->fd);
@@ -125,6 +137,10 @@ void journal_file_close(JournalFile *f) {
 
         safe_close(f->fd);
         free(f->path);
+        free(f->match_cache);
+
+        for (i = 0; i < MISSED_FIELDS_MAX; i++)
+                free(f->missed_fields[i].field);
 
         if (f->mmap)
                 mmap_cache_unref(f->mmap);
@@ -152,7 +168,9 @@ static int journal_file_init_header(JournalFile *f, JournalFile *template) {
         h.incompatible_flags |= htole32(f->compress_xz * HEADER_INCOMPATIBLE_COMPRESSED_XZ);
         h.incompatible_flags |= htole32(f->compress_lz4 * HEADER_INCOMPATIBLE_COMPRESSED_LZ4);
 
-        h.compatible_flags = 0;
+        h.compatible_flags = htole32(HEADER_COMPATIBLE_REALTIME_ORDERED);
+        h.bloom_offset = h.bloom_size = 0;
+        h.token_hash_table_offset = h.token_hash_table_size = h.n_tokens = 0;
 
         uuid_gen_rand(&h.file_id);
 
@@ -218,10 +236,14 @@ static int journal_file_verify_header(JournalFile *f) {
         }
 
         /* When open for writing we refuse to open files with
-         * compatible flags, too */
+         * compatible flags we don't know, too */
         if (f->writable) {
-                if (f->header->compatible_flags != 0)
+                flags = le32toh(f->header->compatible_flags);
+                if (flags & ~HEADER_COMPATIBLE_SUPPORTED) {
+                        log_debug("Journal file %s has unknown compatible flags %"PRIx32,
+                                  f->path, flags & ~HEADER_COMPATIBLE_SUPPORTED);
                         return -EPROTONOSUPPORT;
+                }
         }
 
         if (f->header->state >= _STATE_MAX)
@@ -358,7 +380,10 @@ static uint64_t minimum_header_size(Object *o) {
                 [OBJECT_ENTRY] = sizeof(EntryObject),
                 [OBJECT_DATA_HASH_TABLE] = sizeof(HashTableObject),
                 [OBJECT_FIELD_HASH_TABLE] = sizeof(HashTableObject),
-                [OBJECT_ENTRY_ARRAY] = sizeof(EntryArrayObject)
+                [OBJECT_ENTRY_ARRAY] = sizeof(EntryArrayObject),
+                [OBJECT_BLOOM] = sizeof(BloomObject),
+                [OBJECT_TOKEN] = sizeof(TokenObject),
+                [OBJECT_TOKEN_HASH_TABLE] = sizeof(HashTableObject)
         };
 
         if (o->object.type >= ELEMENTSOF(table) || table[o->object.type] <= 0)
@@ -546,6 +571,66 @@ static int journal_file_setup_field_hash_table(JournalFile *f) {
         return 0;
 }
 
+static int journal_file_setup_bloom(JournalFile *f) {
+        uint64_t s, p;
+        Object *o;
+        int r;
+
+        assert(f);
+
+        /* We use one byte per data hash table entry, which makes for
+         * roughly ten bits per data object at the fill level where
+         * rotation is suggested, and a false positive rate of about
+         * one percent. */
+
+        s = ALIGN_TO(le64toh(f->header->data_hash_table_size) / sizeof(HashItem), BLOOM_BLOCK_SIZE);
+
+        r = journal_file_append_object(f,
+                                       OBJECT_BLOOM,
+                                       offsetof(Object, bloom.bits) + s,
+                                       &o, &p);
+        if (r < 0)
+                return r;
+
+        memzero(o->bloom.bits, s);
+
+        f->header->bloom_offset = htole64(p + offsetof(Object, bloom.bits));
+        f->header->bloom_size = htole64(s);
+        f->header->compatible_flags |= htole32(HEADER_COMPATIBLE_BLOOM);
+
+        return 0;
+}
+
+static int journal_file_setup_token_hash_table(JournalFile *f) {
+        uint64_t s, p;
+        Object *o;
+        int r;
+
+        assert(f);
+
+        /* Distinct tokens are fewer than distinct messages, half of
+         * the data hash table should do */
+
+        s = (le64toh(f->header->data_hash_table_size) / sizeof(HashItem) / 2) * sizeof(HashItem);
+        if (s < DEFAULT_FIELD_HASH_TABLE_SIZE)
+                s = DEFAULT_FIELD_HASH_TABLE_SIZE;
+
+        r = journal_file_append_object(f,
+                                       OBJECT_TOKEN_HASH_TABLE,
+                                       offsetof(Object, hash_table.items) + s,
+                                       &o, &p);
+        if (r < 0)
+                return r;
+
+        memzero(o->hash_table.items, s);
+
+        f->header->token_hash_table_offset = htole64(p + offsetof(Object, hash_table.items));
+        f->header->token_hash_table_size = htole64(s);
+        f->header->compatible_flags |= htole32(HEADER_COMPATIBLE_TOKENS);
+
+        return 0;
+}
+
 static int journal_file_map_data_hash_table(JournalFile *f) {
         uint64_t s, p;
         void *t;
@@ -590,6 +675,105 @@ static int journal_file_map_field_hash_table(JournalFile *f) {
         return 0;
 }
 
+static int journal_file_map_bloom(JournalFile *f) {
+        uint64_t s, p;
+        void *t;
+        int r;
+
+        assert(f);
+
+        if (!JOURNAL_HEADER_BLOOM(f->header))
+                return 0;
+
+        p = le64toh(f->header->bloom_offset);
+        s = le64toh(f->header->bloom_size);
+
+        if (s == 0 || s % BLOOM_BLOCK_SIZE != 0)
+                return -EBADMSG;
+
+        r = journal_file_move_to(f,
+                                 OBJECT_BLOOM,
+                                 true,
+                                 p, s,
+                                 &t);
+        if (r < 0)
+                return r;
+
+        f->bloom = t;
+        return 0;
+}
+
+static int journal_file_map_token_hash_table(JournalFile *f) {
+        uint64_t s, p;
+        void *t;
+        int r;
+
+        assert(f);
+
+        if (!JOURNAL_HEADER_TOKENS(f->header))
+                return 0;
+
+        p = le64toh(f->header->token_hash_table_offset);
+        s = le64toh(f->header->token_hash_table_size);
+
+        if (s < sizeof(HashItem) || s % sizeof(HashItem) != 0)
+                return -EBADMSG;
+
+        r = journal_file_move_to(f,
+                                 OBJECT_TOKEN_HASH_TABLE,
+                                 true,
+                                 p, s,
+                                 &t);
+        if (r < 0)
+                return r;
+
+        f->token_hash_table = t;
+        return 0;
+}
+
+static uint8_t *bloom_block(JournalFile *f, uint64_t hash, uint64_t *bits) {
+        assert(f);
+        assert(f->bloom);
+        assert(bits);
+
+        /* The block is picked by the hash directly, the bit positions
+         * within it are taken from the upper bits of the hash with
+         * its halves swapped and mixed */
+        *bits = ((hash >> 32) | (hash << 32)) * 0x9E3779B97F4A7C15ULL;
+
+        return f->bloom + (hash % (le64toh(f->header->bloom_size) / BLOOM_BLOCK_SIZE)) * BLOOM_BLOCK_SIZE;
+}
+
+static void bloom_add(JournalFile *f, uint64_t hash) {
+        uint8_t *b;
+        uint64_t x;
+        unsigned i;
+
+        b = bloom_block(f, hash, &x);
+
+        for (i = 0; i < BLOOM_N_HASHES; i++, x <<= 9)
+                b[x >> 58] |= 1 << ((x >> 55) & 7);
+}
+
+bool journal_file_bloom_may_contain(JournalFile *f, uint64_t hash) {
+        uint8_t *b;
+        uint64_t x;
+        unsigned i;
+
+        assert(f);
+
+        if (!f->bloom)
+                return true;
+
+        b = bloom_block(f, hash, &x);
+
+        for (i = 0; i < BLOOM_N_HASHES; i++, x <<= 9)
+                if (!(b[x >> 58] & (1 << ((x >> 55) & 7))))
+                        return false;
+
+        return true;
+}
+
 static int journal_file_link_field(
                 JournalFile *f,
                 Object *o,
@@ -652,6 +836,12 @@ static int journal_file_link_data(
         o->data.entry_offset = o->data.entry_array_offset = 0;
         o->data.n_entries = 0;
 
+        /* Set the bits before the object is reachable, so that
+         * readers never see a linked object missing from the
+         * filter */
+        if (f->bloom)
+                bloom_add(f, hash);
+
         h = hash % (le64toh(f->header->data_hash_table_size) / sizeof(HashItem));
         p = le64toh(f->data_hash_table[h].tail_hash_offset);
         if (p == 0)
@@ -753,6 +943,9 @@ int journal_file_find_data_object_with_hash(
         if (f->header->data_hash_table_size == 0)
                 return -EBADMSG;
 
+        if (!journal_file_bloom_may_contain(f, hash))
+                return 0;
+
         h = hash % (le64toh(f->header->data_hash_table_size) / sizeof(HashItem));
         p = le64toh(f->data_hash_table[h].head_hash_offset);
 
@@ -832,6 +1025,265 @@ int journal_file_find_data_object(
                                                        ret, offset);
 }
 
+const char *journal_file_next_token(const char *p, const char *e, size_t *size) {
+        const char *t;
+
+        assert(p);
+        assert(e);
+        assert(size);
+
+#define IS_TOKEN_CHAR(c) ((c) >= 0x80 || ((c) >= '0' && (c) <= '9') || ((c) >= 'A' && (c) <= 'Z') || ((c) >= 'a' && (c) <= 'z'))
+
+        while (p < e && !IS_TOKEN_CHAR((uint8_t) *p))
+                p++;
+
+        if (p >= e)
+                return NULL;
+
+        for (t = p; t < e && IS_TOKEN_CHAR((uint8_t) *t); t++)
+                ;
+
+#undef IS_TOKEN_CHAR
+
+        *size = t - p;
+        return p;
+}
+
+int journal_file_find_token(
+                JournalFile *f,
+                uint64_t hash,
+                Object **ret, uint64_t *offset) {
+
+        uint64_t p, h;
+        int r;
+
+        assert(f);
+
+        if (!f->token_hash_table)
+                return -EOPNOTSUPP;
+
+        h = hash % (le64toh(f->header->token_hash_table_size) / sizeof(HashItem));
+        p = le64toh(f->token_hash_table[h].head_hash_offset);
+
+        while (p > 0) {
+                Object *o;
+
+                r = journal_file_move_to_object(f, OBJECT_TOKEN, p, &o);
+                if (r < 0)
+                        return r;
+
+                if (le64toh(o->token.hash) == hash) {
+                        if (ret)
+                                *ret = o;
+                        if (offset)
+                                *offset = p;
+
+                        return 1;
+                }
+
+                p = le64toh(o->token.next_hash_offset);
+        }
+
+        return 0;
+}
+
+int journal_file_get_token_data(JournalFile *f, Object *o, uint64_t **ret, uint64_t *ret_n) {
+        _cleanup_free_ uint64_t *d = NULL;
+        uint64_t n, i = 0, a;
+        int r;
+
+        assert(f);
+        assert(o);
+        assert(ret);
+        assert(ret_n);
+
+        if (o->object.type != OBJECT_TOKEN)
+                return -EINVAL;
+
+        /* Copy the fields, moving to the arrays might change the
+         * window the token object is in */
+        n = le64toh(o->token.n_data);
+        a = le64toh(o->token.data_array_offset);
+
+        d = new(uint64_t, MAX(n, 1U));
+        if (!d)
+                return -ENOMEM;
+
+        if (n > 0)
+                d[i++] = le64toh(o->token.data_offset);
+
+        while (i < n && a > 0) {
+                uint64_t k, m;
+
+                r = journal_file_move_to_object(f, OBJECT_ENTRY_ARRAY, a, &o);
+                if (r < 0)
+                        return r;
+
+                m = journal_file_entry_array_n_items(o);
+                for (k = 0; k < m && i < n; k++)
+                        d[i++] = le64toh(o->entry_array.items[k]);
+
+                a = le64toh(o->entry_array.next_entry_array_offset);
+        }
+
+        if (i != n)
+                return -EBADMSG;
+
+        *ret = d;
+        *ret_n = n;
+        d = NULL;
+
+        return 0;
+}
+
+int journal_file_data_payload(JournalFile *f, Object *o, const void **ret, size_t *ret_size) {
+        uint64_t l;
+
+        assert(f);
+        assert(o);
+        assert(ret);
+        assert(ret_size);
+
+        if (o->object.type != OBJECT_DATA)
+                return -EINVAL;
+
+        l = le64toh(o->object.size);
+        if (l < offsetof(Object, data.payload))
+                return -EBADMSG;
+
+        l -= offsetof(Object, data.payload);
+
+        /* We can't read objects larger than 4G on a 32bit machine */
+        if ((uint64_t) (size_t) l != l)
+                return -E2BIG;
+
+        if (o->object.flags & OBJECT_COMPRESSION_MASK) {
+#if defined(HAVE_XZ) || defined(HAVE_LZ4)
+                size_t rsize;
+                int r;
+
+                r = decompress_blob(o->object.flags & OBJECT_COMPRESSION_MASK,
+                                    o->data.payload, l, &f->compress_buffer, &f->compress_buffer_size, &rsize, 0);
+                if (r < 0)
+                        return r;
+
+                *ret = f->compress_buffer;
+                *ret_size = rsize;
+#else
+                return -EPROTONOSUPPORT;
+#endif
+        } else {
+                *ret = o->data.payload;
+                *ret_size = (size_t) l;
+        }
+
+        return 0;
+}
+
+static int link_entry_into_array_plus_one(JournalFile *f, le64_t *extra, le64_t *first, le64_t *idx, uint64_t p);
+
+static int journal_file_append_token(JournalFile *f, uint64_t hash, uint64_t data_offset) {
+        uint64_t p, h, q;
+        le64_t extra, first, idx;
+        Object *o;
+        int r;
+
+        assert(f);
+
+        r = journal_file_find_token(f, hash, &o, &p);
+        if (r < 0)
+                return r;
+        if (r == 0) {
+                r = journal_file_append_object(f, OBJECT_TOKEN, sizeof(TokenObject), &o, &p);
+                if (r < 0)
+                        return r;
+
+                o->token.hash = htole64(hash);
+                o->token.next_hash_offset = o->token.data_offset = 0;
+                o->token.data_array_offset = o->token.n_data = 0;
+
+                h = hash % (le64toh(f->header->token_hash_table_size) / sizeof(HashItem));
+                q = le64toh(f->token_hash_table[h].tail_hash_offset);
+                if (q == 0)
+                        f->token_hash_table[h].head_hash_offset = htole64(p);
+                else {
+                        r = journal_file_move_to_object(f, OBJECT_TOKEN, q, &o);
+                        if (r < 0)
+                                return r;
+
+                        o->token.next_hash_offset = htole64(p);
+                }
+
+                f->token_hash_table[h].tail_hash_offset = htole64(p);
+                f->header->n_tokens = htole64(le64toh(f->header->n_tokens) + 1);
+
+                r = journal_file_move_to_object(f, OBJECT_TOKEN, p, &o);
+                if (r < 0)
+                        return r;
+        }
+
+        /* The fields of the packed object are linked through
+         * aligned copies, and written back afterwards */
+        extra = o->token.data_offset;
+        first = o->token.data_array_offset;
+        idx = o->token.n_data;
+
+        r = link_entry_into_array_plus_one(f, &extra, &first, &idx, data_offset);
+        if (r < 0)
+                return r;
+
+        r = journal_file_move_to_object(f, OBJECT_TOKEN, p, &o);
+        if (r < 0)
+                return r;
+
+        o->token.data_offset = extra;
+        o->token.data_array_offset = first;
+        o->token.n_data = idx;
+
+        return 0;
+}
+
+static int uint64_cmp(const void *_a, const void *_b) {
+        const uint64_t *a = _a, *b = _b;
+
+        return *a < *b ? -1 : *a > *b ? 1 : 0;
+}
+
+static int journal_file_link_tokens(JournalFile *f, const char *message, size_t size, uint64_t offset) {
+        _cleanup_free_ uint64_t *hashes = NULL;
+        size_t n = 0, allocated = 0, l, i;
+        const char *t;
+        int r;
+
+        assert(f);
+        assert(message || size == 0);
+
+        for (t = message; (t = journal_file_next_token(t, message + size, &l)); t += l) {
+                if (l < JOURNAL_TOKEN_SIZE_MIN || l > JOURNAL_TOKEN_SIZE_MAX)
+                        continue;
+
+                if (!GREEDY_REALLOC(hashes, allocated, n + 1))
+                        return -ENOMEM;
+
+                hash64(t, l, hashes + n++);
+        }
+
+        /* Link the data object once per distinct token, which keeps
+         * the posting lists sorted by offset */
+        qsort_safe(hashes, n, sizeof(uint64_t), uint64_cmp);
+
+        for (i = 0; i < n; i++) {
+                if (i > 0 && hashes[i] == hashes[i - 1])
+                        continue;
+
+                r = journal_file_append_token(f, hashes[i], offset);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
 static int journal_file_append_field(
                 JournalFile *f,
                 const void *field, uint64_t size,
@@ -894,10 +1346,10 @@ static int journal_file_append_data(
                 Object **ret, uint64_t *offset) {
 
         uint64_t hash, p;
-        uint64_t osize;
+        uint64_t osize, psize;
         Object *o;
         int r, compression = 0;
-        const void *eq;
+        const void *eq, *payload;
 
         assert(f);
         assert(data || size == 0);
@@ -918,23 +1370,26 @@ static int journal_file_append_data(
                 return 0;
         }
 
-        osize = offsetof(Object, data.payload) + size;
-        r = journal_file_append_object(f, OBJECT_DATA, osize, &o, &p);
-        if (r < 0)
-                return r;
-
-        o->data.hash = htole64(hash);
+        payload = data;
+        psize = size;
 
 #if defined(HAVE_XZ) || defined(HAVE_LZ4)
-        if (f->compress_xz &&
+        if ((f->compress_xz || f->compress_lz4) &&
             size >= COMPRESSION_SIZE_THRESHOLD) {
                 size_t rsize;
 
-                compression = compress_blob(data, size, o->data.payload, &rsize);
+                /* Compress into the scratch buffer first, so that we
+                 * reserve only as much of the arena as the final
+                 * object actually needs. The compressors never
+                 * produce more than size - 1 bytes. */
+                if (!greedy_realloc(&f->compress_buffer, &f->compress_buffer_size, size, 1))
+                        return -ENOMEM;
 
-                if (compression) {
-                        o->object.size = htole64(offsetof(Object, data.payload) + rsize);
-                        o->object.flags |= compression;
+                r = compress_blob(data, size, f->compress_buffer, &rsize);
+                if (r > 0) {
+                        compression = r;
+                        payload = f->compress_buffer;
+                        psize = rsize;
 
                         log_debug("Compressed data object %"PRIu64" -> %zu using %s",
                                   size, rsize, object_compressed_to_string(compression));
@@ -942,8 +1397,16 @@ static int journal_file_append_data(
         }
 #endif
 
-        if (!compression && size > 0)
-                memcpy(o->data.payload, data, size);
+        osize = offsetof(Object, data.payload) + psize;
+        r = journal_file_append_object(f, OBJECT_DATA, osize, &o, &p);
+        if (r < 0)
+                return r;
+
+        o->data.hash = htole64(hash);
+        o->object.flags |= compression;
+
+        if (psize > 0)
+                memcpy(o->data.payload, payload, psize);
 
         r = journal_file_link_data(f, o, p, hash);
         if (r < 0)
@@ -973,6 +1436,17 @@ static int journal_file_append_data(
                 fo->field.head_data_offset = le64toh(p);
         }
 
+        /* Index the tokens of messages, for full text search */
+        if (f->token_hash_table && size >= 8 && memcmp(data, "MESSAGE=", 8) == 0) {
+                r = journal_file_link_tokens(f, (const char*) data + 8, size - 8, p);
+                if (r < 0)
+                        return r;
+
+                r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+                if (r < 0)
+                        return r;
+        }
+
         if (ret)
                 *ret = o;
 
@@ -1004,7 +1478,8 @@ uint64_t journal_file_hash_table_n_items(Object *o) {
         assert(o);
 
         if (o->object.type != OBJECT_DATA_HASH_TABLE &&
-            o->object.type != OBJECT_FIELD_HASH_TABLE)
+            o->object.type != OBJECT_FIELD_HASH_TABLE &&
+            o->object.type != OBJECT_TOKEN_HASH_TABLE)
                 return 0;
 
         return (le64toh(o->object.size) - offsetof(Object, hash_table.items)) / sizeof(HashItem);
@@ -1130,6 +1605,7 @@ static int journal_file_link_entry_item(JournalFile *f, Object *o, uint64_t offs
 
 static int journal_file_link_entry(JournalFile *f, Object *o, uint64_t offset) {
         uint64_t n, i;
+        le64_t realtime, monotonic;
         int r;
 
         assert(f);
@@ -1139,9 +1615,23 @@ static int journal_file_link_entry(JournalFile *f, Object *o, uint64_t offset) {
         if (o->object.type != OBJECT_ENTRY)
                 return -EINVAL;
 
+        realtime = o->entry.realtime;
+        monotonic = o->entry.monotonic;
+
+        __sync_synchronize();
+
+        /* Link up the items */
+        n = journal_file_entry_n_items(o);
+        for (i = 0; i < n; i++) {
+                r = journal_file_link_entry_item(f, o, offset, i);
+                if (r < 0)
+                        return r;
+        }
+
+        /* Link up the entry itself last, so that readers watching
+         * n_entries in the header find it complete */
         __sync_synchronize();
 
-        /* Link up the entry itself */
         r = link_entry_into_array(f,
                                   &f->header->entry_array_offset,
                                   &f->header->n_entries,
@@ -1152,21 +1642,15 @@ static int journal_file_link_entry(JournalFile *f, Object *o, uint64_t offset) {
         /* log_debug("=> %s seqnr=%"PRIu64" n_entries=%"PRIu64, f->path, o->entry.seqnum, f->header->n_entries); */
 
         if (f->header->head_entry_realtime == 0)
-                f->header->head_entry_realtime = o->entry.realtime;
+                f->header->head_entry_realtime = realtime;
+        else if (le64toh(realtime) < le64toh(f->header->tail_entry_realtime))
+                f->header->compatible_flags &= htole32(~HEADER_COMPATIBLE_REALTIME_ORDERED);
 
-        f->header->tail_entry_realtime = o->entry.realtime;
-        f->header->tail_entry_monotonic = o->entry.monotonic;
+        f->header->tail_entry_realtime = realtime;
+        f->header->tail_entry_monotonic = monotonic;
 
         f->tail_entry_monotonic_valid = true;
 
-        /* Link up the items */
-        n = journal_file_entry_n_items(o);
-        for (i = 0; i < n; i++) {
-                r = journal_file_link_entry_item(f, o, offset, i);
-                if (r < 0)
-                        return r;
-        }
-
         return 0;
 }
 
@@ -1226,6 +1710,70 @@ void journal_file_post_change(JournalFile *f) {
                 log_error("Failed to truncate file to its own size: %m");
 }
 
+/* The lock byte is the first one of the signature, which nobody writes
+ * to. OFD locks belong to the open file, not the process, so the lock
+ * of a reader shows even to a writer in the same process. */
+#define FOLLOW_LOCK(type) { .l_type = (type), .l_whence = SEEK_SET, .l_start = 0, .l_len = 1 }
+
+int journal_file_follow(JournalFile *f) {
+        struct flock fl = FOLLOW_LOCK(F_RDLCK);
+
+        assert(f);
+
+        if (fcntl(f->fd, F_OFD_SETLK, &fl) < 0)
+                return -errno;
+
+        return 0;
+}
+
+int journal_file_has_followers(JournalFile *f) {
+        struct flock fl = FOLLOW_LOCK(F_WRLCK);
+
+        assert(f);
+
+        if (fcntl(f->fd, F_OFD_GETLK, &fl) < 0)
+                return -errno;
+
+        return fl.l_type != F_UNLCK;
+}
+
+static void journal_file_notify(JournalFile *f, bool appended) {
+        usec_t n;
+
+        n = now(CLOCK_MONOTONIC);
+        if (n < f->notify_timestamp + f->notify_interval) {
+                if (appended) {
+                        f->notify_pending = true;
+                        f->n_notify_suppressed++;
+                }
+                return;
+        }
+
+        f->notify_pending = false;
+        f->notify_timestamp = n;
+
+        /* Readers which start following later look at the file
+         * anyway. If the lock can't be checked, tell just in case. */
+        if (f->notify_followers_only && journal_file_has_followers(f) == 0) {
+                if (appended)
+                        f->n_notify_suppressed++;
+                return;
+        }
+
+        journal_file_post_change(f);
+}
+
+usec_t journal_file_notify_pending(JournalFile *f) {
+        assert(f);
+
+        if (!f->notify_pending)
+                return 0;
+
+        journal_file_notify(f, false);
+
+        return f->notify_pending ? f->notify_timestamp + f->notify_interval : 0;
+}
+
 static int entry_item_cmp(const void *_a, const void *_b) {
         const EntryItem *a = _a, *b = _b;
 
@@ -1278,7 +1826,13 @@ int journal_file_append_entry(JournalFile *f, const dual_timestamp *ts, const st
 
         r = journal_file_append_entry_internal(f, ts, xor_hash, items, n_iovec, seqnum, ret, offset);
 
-        journal_file_post_change(f);
+        if (f->defer_post_change)
+                return r;
+
+        if (f->notify_interval > 0)
+                journal_file_notify(f, true);
+        else
+                journal_file_post_change(f);
 
         return r;
 }
@@ -2203,6 +2757,51 @@ int journal_file_move_to_entry_by_realtime_for_data(
                                              ret, offset, NULL);
 }
 
+int journal_file_count_entries_since_realtime(
+                JournalFile *f,
+                uint64_t data_offset,
+                uint64_t realtime,
+                uint64_t *ret) {
+
+        uint64_t n, i = 0;
+        Object *d;
+        int r;
+
+        assert(f);
+        assert(ret);
+
+        if (data_offset == 0) {
+                n = le64toh(f->header->n_entries);
+                r = generic_array_bisect(f,
+                                         le64toh(f->header->entry_array_offset),
+                                         n,
+                                         realtime,
+                                         test_object_realtime,
+                                         DIRECTION_DOWN,
+                                         NULL, NULL, &i);
+        } else {
+                r = journal_file_move_to_object(f, OBJECT_DATA, data_offset, &d);
+                if (r < 0)
+                        return r;
+
+                n = le64toh(d->data.n_entries);
+                r = generic_array_bisect_plus_one(f,
+                                                  le64toh(d->data.entry_offset),
+                                                  le64toh(d->data.entry_array_offset),
+                                                  n,
+                                                  realtime,
+                                                  test_object_realtime,
+                                                  DIRECTION_DOWN,
+                                                  NULL, NULL, &i);
+        }
+        if (r < 0)
+                return r;
+
+        *ret = r > 0 ? n - i : 0;
+
+        return 0;
+}
+
 void journal_file_dump(JournalFile *f) {
         Object *o;
         int r;
@@ -2251,6 +2850,18 @@ void journal_file_dump(JournalFile *f) {
                         printf("Type: OBJECT_ENTRY_ARRAY\n");
                         break;
 
+                case OBJECT_BLOOM:
+                        printf("Type: OBJECT_BLOOM\n");
+                        break;
+
+                case OBJECT_TOKEN:
+                        printf("Type: OBJECT_TOKEN\n");
+                        break;
+
+                case OBJECT_TOKEN_HASH_TABLE:
+                        printf("Type: OBJECT_TOKEN_HASH_TABLE\n");
+                        break;
+
                 default:
                         printf("Type: unknown (%u)\n", o->object.type);
                         break;
@@ -2306,7 +2917,7 @@ void journal_file_print_header(JournalFile *f) {
                "Boot ID: %s\n"
                "Sequential Number ID: %s\n"
                "State: %s\n"
-               "Compatible Flags:\n"
+               "Compatible Flags:%s%s%s%s\n"
                "Incompatible Flags:%s%s%s\n"
                "Header size: %"PRIu64"\n"
                "Arena size: %"PRIu64"\n"
@@ -2327,6 +2938,10 @@ void journal_file_print_header(JournalFile *f) {
                f->header->state == STATE_OFFLINE ? "OFFLINE" :
                f->header->state == STATE_ONLINE ? "ONLINE" :
                f->header->state == STATE_ARCHIVED ? "ARCHIVED" : "UNKNOWN",
+               JOURNAL_HEADER_BLOOM(f->header) ? " BLOOM" : "",
+               JOURNAL_HEADER_TOKENS(f->header) ? " TOKENS" : "",
+               JOURNAL_HEADER_REALTIME_ORDERED(f->header) ? " REALTIME-ORDERED" : "",
+               (le32toh(f->header->compatible_flags) & ~HEADER_COMPATIBLE_ANY) ? " ???" : "",
                JOURNAL_HEADER_COMPRESSED_XZ(f->header) ? " COMPRESSED-XZ" : "",
                JOURNAL_HEADER_COMPRESSED_LZ4(f->header) ? " COMPRESSED-LZ4" : "",
                (le32toh(f->header->incompatible_flags) & ~HEADER_INCOMPATIBLE_ANY) ? " ???" : "",
@@ -2359,6 +2974,24 @@ void journal_file_print_header(JournalFile *f) {
                 printf("Entry Array Objects: %"PRIu64"\n",
                        le64toh(f->header->n_entry_arrays));
 
+        if (f->bloom) {
+                uint64_t i, n = 0;
+
+                for (i = 0; i < le64toh(f->header->bloom_size); i++)
+                        n += __builtin_popcount(f->bloom[i]);
+
+                printf("Bloom Filter Size: %"PRIu64"\n"
+                       "Bloom Filter Fill: %.1f%%\n",
+                       le64toh(f->header->bloom_size),
+                       100.0 * (double) n / (double) (le64toh(f->header->bloom_size) * 8));
+        }
+
+        if (f->token_hash_table)
+                printf("Token Objects: %"PRIu64"\n"
+                       "Token Hash Table Fill: %.1f%%\n",
+                       le64toh(f->header->n_tokens),
+                       100.0 * (double) le64toh(f->header->n_tokens) / ((double) (le64toh(f->header->token_hash_table_size) / sizeof(HashItem))));
+
         if (fstat(f->fd, &st) >= 0)
                 printf("Disk usage: %s\n", format_bytes(bytes, sizeof(bytes), (off_t) st.st_blocks * 512ULL));
 }
@@ -2368,6 +3001,7 @@ int journal_file_open(
                 int flags,
                 mode_t mode,
                 bool compress,
+                bool index_tokens,
                 JournalMetrics *metrics,
                 MMapCache *mmap_cache,
                 JournalFile *template,
@@ -2503,6 +3137,16 @@ int journal_file_open(
                 r = journal_file_setup_data_hash_table(f);
                 if (r < 0)
                         goto fail;
+
+                r = journal_file_setup_bloom(f);
+                if (r < 0)
+                        goto fail;
+
+                if (index_tokens) {
+                        r = journal_file_setup_token_hash_table(f);
+                        if (r < 0)
+                                goto fail;
+                }
         }
 
         r = journal_file_map_field_hash_table(f);
@@ -2513,6 +3157,14 @@ int journal_file_open(
         if (r < 0)
                 goto fail;
 
+        r = journal_file_map_bloom(f);
+        if (r < 0)
+                goto fail;
+
+        r = journal_file_map_token_hash_table(f);
+        if (r < 0)
+                goto fail;
+
         *ret = f;
         return 0;
 
@@ -2522,7 +3174,7 @@ fail:
         return r;
 }
 
-int journal_file_rotate(JournalFile **f, bool compress) {
+int journal_file_rotate(JournalFile **f, bool compress, bool index_tokens) {
         _cleanup_free_ char *p = NULL;
         size_t l;
         JournalFile *old_file, *new_file = NULL;
@@ -2553,7 +3205,7 @@ int journal_file_rotate(JournalFile **f, bool compress) {
 
         old_file->header->state = STATE_ARCHIVED;
 
-        r = journal_file_open(old_file->path, old_file->flags, old_file->mode, compress, NULL, old_file->mmap, old_file, &new_file);
+        r = journal_file_open(old_file->path, old_file->flags, old_file->mode, compress, index_tokens, NULL, old_file->mmap, old_file, &new_file);
         journal_file_close(old_file);
 
         *f = new_file;
@@ -2565,6 +3217,7 @@ int journal_file_open_reliably(
                 int flags,
                 mode_t mode,
                 bool compress,
+                bool index_tokens,
                 JournalMetrics *metrics,
                 MMapCache *mmap_cache,
                 JournalFile *template,
@@ -2575,7 +3228,7 @@ int journal_file_open_reliably(
         _cleanup_free_ char *p = NULL;
         char x[FORMAT_TIMESTAMP_MAX];
 
-        r = journal_file_open(fname, flags, mode, compress,
+        r = journal_file_open(fname, flags, mode, compress, index_tokens,
                               metrics, mmap_cache, template, ret);
         if (r != -EBADMSG && /* corrupted */
             r != -ENODATA && /* truncated */
@@ -2608,10 +3261,21 @@ int journal_file_open_reliably(
 
         log_warning("File %s corrupted or uncleanly shut down, renaming and replacing.", fname);
 
-        return journal_file_open(fname, flags, mode, compress,
+        return journal_file_open(fname, flags, mode, compress, index_tokens,
                                  metrics, mmap_cache, template, ret);
 }
 
+void journal_file_set_boot_id(JournalFile *f, uuid_t boot_id) {
+        assert(f);
+
+        if (uuid_equal(boot_id, f->header->boot_id))
+                return;
+
+        /* Monotonic timestamps of different boots aren't ordered */
+        f->header->boot_id = boot_id;
+        f->tail_entry_monotonic_valid = false;
+}
+
 int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint64_t p, uint64_t *seqnum, Object **ret, uint64_t *offset) {
         uint64_t i, n;
         uint64_t q, xor_hash = 0;
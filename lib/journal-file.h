@@ -44,6 +44,42 @@ typedef enum direction {
         DIRECTION_DOWN
 } direction_t;
 
+/* What is known in a file about a concrete match of sd_journal: the
+ * offset of its data object, 0 if unknown, or the tail object offset
+ * plus one if the data object was absent at that point, and the entry
+ * last found for it beyond after_offset in direction, 0 if none was
+ * found while the file had n_entries entries. */
+typedef struct MatchCacheItem {
+        uint64_t data_offset;
+        uint64_t after_offset;
+        uint64_t entry_offset;
+        uint64_t n_entries;
+        direction_t direction;
+} MatchCacheItem;
+
+/* A field sd_journal_get_data() recently didn't find in an entry of a
+ * file. Once it is missed again, the file is checked for its field
+ * object: if there is one, the field is present in the file, otherwise
+ * it is absent while the file has n_fields fields. */
+typedef struct MissedField {
+        char *field;
+        bool probed:1;
+        bool absent:1;
+        uint64_t n_fields;
+} MissedField;
+
+#define MISSED_FIELDS_MAX 8
+
+/* The fields of an entry object which define its position in the
+ * interleaved stream of entries from several files */
+typedef struct EntryOrder {
+        uuid_t boot_id;
+        uint64_t seqnum;
+        uint64_t realtime;
+        uint64_t monotonic;
+        uint64_t xor_hash;
+} EntryOrder;
+
 typedef struct JournalFile {
         int fd;
 
@@ -57,6 +93,22 @@ typedef struct JournalFile {
 
         bool tail_entry_monotonic_valid:1;
 
+        /* Appending entries leaves journal_file_post_change() to the
+         * caller, who may call it once for many entries */
+        bool defer_post_change:1;
+
+        /* Appending entries calls journal_file_post_change() at most
+         * once per notify_interval. Entries appended in between leave
+         * a notification pending for journal_file_notify_pending().
+         * With notify_followers_only, notifications are also dropped
+         * while no reader holds the follow lock, which readers built
+         * before the lock was introduced never take. */
+        bool notify_pending:1;
+        bool notify_followers_only:1;
+        usec_t notify_interval;
+        usec_t notify_timestamp;
+        uint64_t n_notify_suppressed;
+
         direction_t last_direction;
 
         char *path;
@@ -65,15 +117,35 @@ typedef struct JournalFile {
         Header *header;
         HashItem *data_hash_table;
         HashItem *field_hash_table;
+        uint8_t *bloom;
+        HashItem *token_hash_table;
 
         uint64_t current_offset;
 
+        /* The next entry of this file beyond the current location of
+         * the reader, as queued in the merge queue of sd_journal, or
+         * the number of entries the file had when it had none */
+        unsigned next_idx;
+        uint64_t next_offset;
+        uint64_t next_n_entries;
+        EntryOrder next_order;
+
+        /* The concrete matches of sd_journal, indexed by match */
+        MatchCacheItem *match_cache;
+        unsigned n_match_cache;
+        unsigned match_generation;
+
+        /* The fields sd_journal_get_data() missed last, the oldest
+         * one is replaced by the next */
+        MissedField missed_fields[MISSED_FIELDS_MAX];
+        unsigned missed_fields_next;
+
         JournalMetrics metrics;
         MMapCache *mmap;
 
         Hashmap *chain_cache;
 
-#ifdef HAVE_XZ
+#if defined(HAVE_XZ) || defined(HAVE_LZ4)
         void *compress_buffer;
         size_t compress_buffer_size;
 #endif
@@ -84,6 +156,7 @@ int journal_file_open(
                 int flags,
                 mode_t mode,
                 bool compress,
+                bool index_tokens,
                 JournalMetrics *metrics,
                 MMapCache *mmap_cache,
                 JournalFile *template,
@@ -97,6 +170,7 @@ int journal_file_open_reliably(
                 int flags,
                 mode_t mode,
                 bool compress,
+                bool index_tokens,
                 JournalMetrics *metrics,
                 MMapCache *mmap_cache,
                 JournalFile *template,
@@ -133,6 +207,28 @@ static inline bool VALID_EPOCH(uint64_t u) {
 #define JOURNAL_HEADER_COMPRESSED_LZ4(h) \
         (!!(le32toh((h)->incompatible_flags) & HEADER_INCOMPATIBLE_COMPRESSED_LZ4))
 
+#define JOURNAL_HEADER_BLOOM(h) \
+        ((le32toh((h)->compatible_flags) & HEADER_COMPATIBLE_BLOOM) && \
+         JOURNAL_HEADER_CONTAINS(h, bloom_size))
+
+#define JOURNAL_HEADER_TOKENS(h) \
+        ((le32toh((h)->compatible_flags) & HEADER_COMPATIBLE_TOKENS) && \
+         JOURNAL_HEADER_CONTAINS(h, n_tokens))
+
+/* Set on new files, and cleared for good by the first entry whose
+ * realtime timestamp is before the one of the entry appended last.
+ * Writers which don't know the flag refuse to write to the file, so it
+ * can't go stale. */
+#define JOURNAL_HEADER_REALTIME_ORDERED(h) \
+        (!!(le32toh((h)->compatible_flags) & HEADER_COMPATIBLE_REALTIME_ORDERED))
+
+/* Tokens are the runs of ASCII letters and digits and of non-ASCII
+ * bytes in MESSAGE= values. Only those within these bounds are
+ * indexed, shorter ones are too common to narrow down a search, and
+ * longer ones are mostly unique identifiers. */
+#define JOURNAL_TOKEN_SIZE_MIN 2
+#define JOURNAL_TOKEN_SIZE_MAX 64
+
 int journal_file_move_to_object(JournalFile *f, int type, uint64_t offset, Object **ret);
 
 uint64_t journal_file_entry_n_items(Object *o) _pure_;
@@ -144,6 +240,13 @@ int journal_file_append_entry(JournalFile *f, const dual_timestamp *ts, const st
 
 int journal_file_find_data_object(JournalFile *f, const void *data, uint64_t size, Object **ret, uint64_t *offset);
 int journal_file_find_data_object_with_hash(JournalFile *f, const void *data, uint64_t size, uint64_t hash, Object **ret, uint64_t *offset);
+int journal_file_data_payload(JournalFile *f, Object *o, const void **ret, size_t *ret_size);
+
+bool journal_file_bloom_may_contain(JournalFile *f, uint64_t hash) _pure_;
+
+const char *journal_file_next_token(const char *p, const char *e, size_t *size);
+int journal_file_find_token(JournalFile *f, uint64_t hash, Object **ret, uint64_t *offset);
+int journal_file_get_token_data(JournalFile *f, Object *o, uint64_t **ret, uint64_t *n);
 
 int journal_file_find_field_object(JournalFile *f, const void *field, uint64_t size, Object **ret, uint64_t *offset);
 int journal_file_find_field_object_with_hash(JournalFile *f, const void *field, uint64_t size, uint64_t hash, Object **ret, uint64_t *offset);
@@ -163,15 +266,35 @@ int journal_file_move_to_entry_by_seqnum_for_data(JournalFile *f, uint64_t data_
 int journal_file_move_to_entry_by_realtime_for_data(JournalFile *f, uint64_t data_offset, uint64_t realtime, direction_t direction, Object **ret, uint64_t *offset);
 int journal_file_move_to_entry_by_monotonic_for_data(JournalFile *f, uint64_t data_offset, uuid_t boot_id, uint64_t monotonic, direction_t direction, Object **ret, uint64_t *offset);
 
+/* The number of entries with a realtime timestamp of at least the one
+ * given, of the file or, unless data_offset is 0, of the data object.
+ * Like the seek functions this takes entries to be ordered by realtime,
+ * which only files with JOURNAL_HEADER_REALTIME_ORDERED are. */
+int journal_file_count_entries_since_realtime(JournalFile *f, uint64_t data_offset, uint64_t realtime, uint64_t *ret);
+
 int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint64_t p, uint64_t *seqnum, Object **ret, uint64_t *offset);
 
+/* Entries appended from now on are recorded for that boot, as when
+ * they are imported from elsewhere */
+void journal_file_set_boot_id(JournalFile *f, uuid_t boot_id);
+
 void journal_file_dump(JournalFile *f);
 void journal_file_print_header(JournalFile *f);
 
-int journal_file_rotate(JournalFile **f, bool compress);
+int journal_file_rotate(JournalFile **f, bool compress, bool index_tokens);
 
 void journal_file_post_change(JournalFile *f);
 
+/* Sends a notification held back by notify_interval, if it is due.
+ * Returns the time on CLOCK_MONOTONIC when to call again if one stays
+ * pending, and 0 otherwise. */
+usec_t journal_file_notify_pending(JournalFile *f);
+
+/* Readers following a file through inotify hold a shared lock on it,
+ * which tells writers that notifications are wanted */
+int journal_file_follow(JournalFile *f);
+int journal_file_has_followers(JournalFile *f);
+
 void journal_reset_metrics(JournalMetrics *m);
 void journal_default_metrics(JournalMetrics *m, int fd);
 
@@ -72,6 +72,7 @@ struct MMapCache {
         unsigned n_windows;
 
         unsigned n_hit, n_missed;
+        unsigned n_pinned;
 
 
         Hashmap *fds;
@@ -173,7 +174,7 @@ static Window *window_add(MMapCache *m) {
 
         assert(m);
 
-        if (!m->last_unused || m->n_windows <= WINDOWS_MIN) {
+        if (!m->last_unused || m->n_windows <= WINDOWS_MIN || m->n_pinned > 0) {
 
                 /* Allocate a new window */
                 w = new0(Window, 1);
@@ -380,7 +381,7 @@ MMapCache* mmap_cache_unref(MMapCache *m) {
 static int make_room(MMapCache *m) {
         assert(m);
 
-        if (!m->last_unused)
+        if (!m->last_unused || m->n_pinned > 0)
                 return 0;
 
         window_free(m->last_unused);
@@ -630,6 +631,25 @@ void mmap_cache_close_fd(MMapCache *m, int fd) {
         fd_free(f);
 }
 
+void mmap_cache_pin(MMapCache *m) {
+        assert(m);
+
+        m->n_pinned++;
+}
+
+void mmap_cache_unpin(MMapCache *m) {
+        assert(m);
+        assert(m->n_pinned > 0);
+
+        m->n_pinned--;
+        if (m->n_pinned > 0)
+                return;
+
+        /* Drop what was kept around beyond the usual number */
+        while (m->n_windows > WINDOWS_MIN && m->last_unused)
+                window_free(m->last_unused);
+}
+
 unsigned mmap_cache_get_hit(MMapCache *m) {
         assert(m);
 
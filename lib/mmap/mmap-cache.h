@@ -43,5 +43,12 @@ int mmap_cache_get(
         void **ret);
 void mmap_cache_close_fd(MMapCache *m, int fd);
 
+/* While the cache is pinned, windows no context uses anymore are kept
+ * mapped instead of being reused, so pointers returned by
+ * mmap_cache_get() stay valid until it is unpinned again. Closing the
+ * fd still unmaps its windows. */
+void mmap_cache_pin(MMapCache *m);
+void mmap_cache_unpin(MMapCache *m);
+
 unsigned mmap_cache_get_hit(MMapCache *m);
 unsigned mmap_cache_get_missed(MMapCache *m);
@@ -31,6 +31,7 @@
 
 int main(int argc, char *argv[]) {
         int x, y, z, r;
+        unsigned i;
         char px[] = "/tmp/testmmapXXXXXXX", py[] = "/tmp/testmmapYXXXXXX", pz[] = "/tmp/testmmapZXXXXXX";
         MMapCache *m;
         void *p, *q;
@@ -70,6 +71,23 @@ int main(int argc, char *argv[]) {
 
         assert((uint8_t*) p + 1 == (uint8_t*) q);
 
+        /* Windows no context uses anymore stay mapped while pinned */
+        assert_se(pwrite(y, "y", 1, 0) == 1);
+
+        mmap_cache_pin(m);
+
+        r = mmap_cache_get(m, y, PROT_READ, 2, false, 0, 1, NULL, &p);
+        assert(r >= 0);
+
+        for (i = 1; i < 80; i++) {
+                r = mmap_cache_get(m, y, PROT_READ, 2, false, i * 16ULL*1024ULL*1024ULL, 1, NULL, &q);
+                assert(r >= 0);
+        }
+
+        assert(*(char*) p == 'y');
+
+        mmap_cache_unpin(m);
+
         mmap_cache_unref(m);
 
         safe_close(x);
@@ -74,14 +74,26 @@ static int set_put_error(sd_journal *j, int r) {
         return set_put(j->errors, INT_TO_PTR(r));
 }
 
+static void release_fields(sd_journal *j) {
+        assert(j);
+
+        if (!j->fields_pinned)
+                return;
+
+        mmap_cache_unpin(j->mmap);
+        j->fields_pinned = false;
+}
+
 static void detach_location(sd_journal *j) {
         Iterator i;
         JournalFile *f;
 
         assert(j);
 
+        release_fields(j);
         j->current_file = NULL;
         j->current_field = 0;
+        j->next_valid = false;
 
         HASHMAP_FOREACH(f, j->files, i)
                 f->current_offset = 0;
@@ -94,7 +106,7 @@ static void reset_location(sd_journal *j) {
         zero(j->current_location);
 }
 
-static void init_location(Location *l, LocationType type, JournalFile *f, Object *o) {
+static void init_location(Location *l, LocationType type, JournalFile *f, Object *o, uint64_t offset) {
         assert(l);
         assert(type == LOCATION_DISCRETE || type == LOCATION_SEEK);
         assert(f);
@@ -108,7 +120,11 @@ static void init_location(Location *l, LocationType type, JournalFile *f, Object
         l->boot_id = o->entry.boot_id;
         l->xor_hash = le64toh(o->entry.xor_hash);
 
+        l->file_id = f->header->file_id;
+        l->offset = offset;
+
         l->seqnum_set = l->realtime_set = l->monotonic_set = l->xor_hash_set = true;
+        l->offset_set = true;
 }
 
 static void set_location(sd_journal *j, LocationType type, JournalFile *f, Object *o,
@@ -118,7 +134,7 @@ static void set_location(sd_journal *j, LocationType type, JournalFile *f, Objec
         assert(f);
         assert(o);
 
-        init_location(&j->current_location, type, f, o);
+        init_location(&j->current_location, type, f, o, offset);
 
         j->current_file = f;
         j->current_field = 0;
@@ -314,6 +330,9 @@ _public_ int sd_journal_add_match(sd_journal *j, const void *data, size_t size)
         if (!m->data)
                 goto fail;
 
+        m->idx = j->n_match_leaves++;
+        j->match_generation++;
+
         detach_location(j);
 
         return 0;
@@ -431,53 +450,51 @@ _public_ void sd_journal_flush_matches(sd_journal *j) {
 
         j->level0 = j->level1 = j->level2 = NULL;
 
+        j->n_match_leaves = 0;
+        j->match_generation++;
+
         detach_location(j);
 }
 
-static int compare_entry_order(JournalFile *af, Object *_ao,
-                               JournalFile *bf, uint64_t bp) {
+static void entry_order_from_object(EntryOrder *e, Object *o) {
+        assert(e);
+        assert(o);
 
-        uint64_t a, b;
-        Object *ao, *bo;
-        int r;
+        e->boot_id = o->entry.boot_id;
+        e->seqnum = le64toh(o->entry.seqnum);
+        e->realtime = le64toh(o->entry.realtime);
+        e->monotonic = le64toh(o->entry.monotonic);
+        e->xor_hash = le64toh(o->entry.xor_hash);
+}
+
+static int compare_entry_order(JournalFile *af, const EntryOrder *a,
+                               JournalFile *bf, const EntryOrder *b) {
 
         assert(af);
         assert(bf);
-        assert(_ao);
-
-        /* The mmap cache might invalidate the object from the first
-         * file if we look at the one from the second file. Hence
-         * temporarily copy the header of the first one, and look at
-         * that only. */
-        ao = alloca(offsetof(EntryObject, items));
-        memcpy(ao, _ao, offsetof(EntryObject, items));
-
-        r = journal_file_move_to_object(bf, OBJECT_ENTRY, bp, &bo);
-        if (r < 0)
-                return strcmp(af->path, bf->path);
+        assert(a);
+        assert(b);
 
-        /* We operate on two different files here, hence we can access
-         * two objects at the same time, which we normally can't.
+        /* We operate on two different files here, which are
+         * described by copies of their entry headers, so no object
+         * needs to be mapped.
          *
          * If contents and timestamps match, these entries are
          * identical, even if the seqnum does not match */
 
-        if (uuid_equal(ao->entry.boot_id, bo->entry.boot_id) &&
-            ao->entry.monotonic == bo->entry.monotonic &&
-            ao->entry.realtime == bo->entry.realtime &&
-            ao->entry.xor_hash == bo->entry.xor_hash)
+        if (uuid_equal(a->boot_id, b->boot_id) &&
+            a->monotonic == b->monotonic &&
+            a->realtime == b->realtime &&
+            a->xor_hash == b->xor_hash)
                 return 0;
 
         if (uuid_equal(af->header->seqnum_id, bf->header->seqnum_id)) {
 
                 /* If this is from the same seqnum source, compare
                  * seqnums */
-                a = le64toh(ao->entry.seqnum);
-                b = le64toh(bo->entry.seqnum);
-
-                if (a < b)
+                if (a->seqnum < b->seqnum)
                         return -1;
-                if (a > b)
+                if (a->seqnum > b->seqnum)
                         return 1;
 
                 /* Wow! This is weird, different data but the same
@@ -485,39 +502,42 @@ static int compare_entry_order(JournalFile *af, Object *_ao,
                  * best of it and compare by time. */
         }
 
-        if (uuid_equal(ao->entry.boot_id, bo->entry.boot_id)) {
+        if (uuid_equal(a->boot_id, b->boot_id)) {
 
                 /* If the boot id matches, compare monotonic time */
-                a = le64toh(ao->entry.monotonic);
-                b = le64toh(bo->entry.monotonic);
-
-                if (a < b)
+                if (a->monotonic < b->monotonic)
                         return -1;
-                if (a > b)
+                if (a->monotonic > b->monotonic)
                         return 1;
         }
 
         /* Otherwise, compare UTC time */
-        a = le64toh(ao->entry.realtime);
-        b = le64toh(bo->entry.realtime);
-
-        if (a < b)
+        if (a->realtime < b->realtime)
                 return -1;
-        if (a > b)
+        if (a->realtime > b->realtime)
                 return 1;
 
         /* Finally, compare by contents */
-        a = le64toh(ao->entry.xor_hash);
-        b = le64toh(bo->entry.xor_hash);
-
-        if (a < b)
+        if (a->xor_hash < b->xor_hash)
                 return -1;
-        if (a > b)
+        if (a->xor_hash > b->xor_hash)
                 return 1;
 
         return 0;
 }
 
+static int compare_next_down(const void *_a, const void *_b) {
+        JournalFile *a = (JournalFile*) _a, *b = (JournalFile*) _b;
+
+        return compare_entry_order(a, &a->next_order, b, &b->next_order);
+}
+
+static int compare_next_up(const void *_a, const void *_b) {
+        JournalFile *a = (JournalFile*) _a, *b = (JournalFile*) _b;
+
+        return compare_entry_order(b, &b->next_order, a, &a->next_order);
+}
+
 _pure_ static int compare_with_location(JournalFile *af, Object *ao, Location *l) {
         uint64_t a;
 
@@ -578,6 +598,132 @@ _pure_ static int compare_with_location(JournalFile *af, Object *ao, Location *l
         return 0;
 }
 
+static MatchCacheItem *match_cache_item(sd_journal *j, Match *m, JournalFile *f) {
+        assert(j);
+        assert(m);
+        assert(m->type == MATCH_DISCRETE);
+        assert(f);
+
+        if (f->match_generation != j->match_generation) {
+                if (f->match_cache)
+                        memzero(f->match_cache, f->n_match_cache * sizeof(MatchCacheItem));
+                f->match_generation = j->match_generation;
+        }
+
+        if (m->idx >= f->n_match_cache) {
+                MatchCacheItem *a;
+
+                a = realloc(f->match_cache, j->n_match_leaves * sizeof(MatchCacheItem));
+                if (!a)
+                        return NULL;
+
+                memzero(a + f->n_match_cache, (j->n_match_leaves - f->n_match_cache) * sizeof(MatchCacheItem));
+                f->match_cache = a;
+                f->n_match_cache = j->n_match_leaves;
+        }
+
+        return f->match_cache + m->idx;
+}
+
+static int find_data_for_match(sd_journal *j, Match *m, JournalFile *f, uint64_t *offset) {
+        MatchCacheItem *c;
+        uint64_t tail;
+        int r;
+
+        assert(j);
+        assert(m);
+        assert(m->type == MATCH_DISCRETE);
+        assert(f);
+        assert(offset);
+
+        /* Data objects never move, so remember where the one of each
+         * concrete match is, instead of looking it up in the hash
+         * table over and over again. If it wasn't there, look again
+         * only after the file has grown. */
+
+        c = match_cache_item(j, m, f);
+        tail = le64toh(f->header->tail_object_offset);
+
+        if (c) {
+                if (c->data_offset == tail + 1)
+                        return 0;
+
+                if (c->data_offset > 0 && !(c->data_offset & 1)) {
+                        *offset = c->data_offset;
+                        return 1;
+                }
+        }
+
+        r = journal_file_find_data_object_with_hash(f, m->data, m->size, le64toh(m->le_hash), NULL, offset);
+        if (r < 0)
+                return r;
+
+        if (c)
+                c->data_offset = r > 0 ? *offset : tail + 1;
+
+        return r;
+}
+
+static bool match_cache_covers(MatchCacheItem *c, JournalFile *f, uint64_t p, direction_t direction) {
+        assert(c);
+        assert(f);
+
+        /* The entry found beyond some offset is also the one beyond
+         * every offset up to it, and entries are only ever appended,
+         * so an entry found stays valid until it was passed, and none
+         * found upwards stays none. */
+
+        if (c->after_offset == 0 || c->direction != direction)
+                return false;
+
+        if (direction == DIRECTION_DOWN) {
+                if (p < c->after_offset)
+                        return false;
+
+                if (c->entry_offset == 0)
+                        return c->n_entries == le64toh(f->header->n_entries);
+
+                return p <= c->entry_offset;
+        }
+
+        if (p > c->after_offset)
+                return false;
+
+        return c->entry_offset == 0 || p >= c->entry_offset;
+}
+
+static int file_may_match(sd_journal *j, Match *m, JournalFile *f) {
+        uint64_t dp;
+        Match *i;
+        int r;
+
+        assert(j);
+        assert(m);
+        assert(f);
+
+        /* Checks whether the data objects of the matches exist in
+         * the file in a combination that could make an entry match
+         * at all. The data object offsets are cached, so this is
+         * cheap. */
+
+        if (m->type == MATCH_DISCRETE)
+                return find_data_for_match(j, m, f, &dp);
+
+        for (i = m->matches; i; i = i->matches_next) {
+                r = file_may_match(j, i, f);
+                if (r < 0)
+                        return r;
+
+                if (m->type == MATCH_OR_TERM && r > 0)
+                        return 1;
+                if (m->type == MATCH_AND_TERM && r == 0)
+                        return 0;
+        }
+
+        /* Empty terms don't match anything */
+        return m->type == MATCH_AND_TERM && m->matches;
+}
+
 static int next_for_match(
                 sd_journal *j,
                 Match *m,
@@ -596,13 +742,50 @@ static int next_for_match(
         assert(f);
 
         if (m->type == MATCH_DISCRETE) {
+                MatchCacheItem *c;
                 uint64_t dp;
 
-                r = journal_file_find_data_object_with_hash(f, m->data, m->size, le64toh(m->le_hash), NULL, &dp);
+                r = find_data_for_match(j, m, f, &dp);
                 if (r <= 0)
                         return r;
 
-                return journal_file_move_to_entry_by_offset_for_data(f, dp, after_offset, direction, ret, offset);
+                /* OR terms ask all their matches for the next entry on
+                 * every step, while only the one which found the
+                 * current entry has to move on, so answer the others
+                 * from the entry they found before, instead of
+                 * bisecting their entry arrays again. */
+
+                c = match_cache_item(j, m, f);
+                if (c && match_cache_covers(c, f, after_offset, direction)) {
+                        if (c->entry_offset == 0)
+                                return 0;
+
+                        if (ret) {
+                                r = journal_file_move_to_object(f, OBJECT_ENTRY, c->entry_offset, ret);
+                                if (r < 0)
+                                        return r;
+                        }
+                        if (offset)
+                                *offset = c->entry_offset;
+
+                        return 1;
+                }
+
+                r = journal_file_move_to_entry_by_offset_for_data(f, dp, after_offset, direction, ret, &np);
+                if (r < 0)
+                        return r;
+
+                if (c) {
+                        c->after_offset = after_offset;
+                        c->entry_offset = r > 0 ? np : 0;
+                        c->n_entries = le64toh(f->header->n_entries);
+                        c->direction = direction;
+                }
+
+                if (r > 0 && offset)
+                        *offset = np;
+
+                return r;
 
         } else if (m->type == MATCH_OR_TERM) {
                 Match *i;
@@ -695,7 +878,7 @@ static int find_location_for_match(
         if (m->type == MATCH_DISCRETE) {
                 uint64_t dp;
 
-                r = journal_file_find_data_object_with_hash(f, m->data, m->size, le64toh(m->le_hash), NULL, &dp);
+                r = find_data_for_match(j, m, f, &dp);
                 if (r <= 0)
                         return r;
 
@@ -785,6 +968,46 @@ static int find_location_for_match(
         }
 }
 
+static bool location_at_offset(sd_journal *j, JournalFile *f) {
+        Location *l;
+        Object *o;
+
+        assert(j);
+        assert(f);
+
+        /* Checks whether the entry of the location is still where it
+         * was found, in the very same file, so that there's no need
+         * to search for it. Cursors carry the offset as a hint only,
+         * hence verify the entry before trusting it. */
+
+        l = &j->current_location;
+
+        if (!l->offset_set || !l->seqnum_set)
+                return false;
+
+        if (!uuid_equal(l->file_id, f->header->file_id) ||
+            !uuid_equal(l->seqnum_id, f->header->seqnum_id))
+                return false;
+
+        if (l->offset < le64toh(f->header->header_size) ||
+            l->offset > le64toh(f->header->tail_object_offset))
+                return false;
+
+        if (journal_file_move_to_object(f, OBJECT_ENTRY, l->offset, &o) < 0)
+                return false;
+
+        if (le64toh(o->entry.seqnum) != l->seqnum)
+                return false;
+
+        if (l->realtime_set && le64toh(o->entry.realtime) != l->realtime)
+                return false;
+
+        if (l->xor_hash_set && le64toh(o->entry.xor_hash) != l->xor_hash)
+                return false;
+
+        return true;
+}
+
 static int find_location_with_matches(
                 sd_journal *j,
                 JournalFile *f,
@@ -799,6 +1022,20 @@ static int find_location_with_matches(
         assert(ret);
         assert(offset);
 
+        if (location_at_offset(j, f)) {
+                uint64_t p = j->current_location.offset;
+
+                if (j->level0)
+                        return next_for_match(j, j->level0, f, p, direction, ret, offset);
+
+                r = journal_file_move_to_object(f, OBJECT_ENTRY, p, ret);
+                if (r < 0)
+                        return r;
+
+                *offset = p;
+                return 1;
+        }
+
         if (!j->level0) {
                 /* No matches is simple */
 
@@ -907,52 +1144,225 @@ static int next_beyond_location(sd_journal *j, JournalFile *f, direction_t direc
         }
 }
 
-static int real_journal_next(sd_journal *j, direction_t direction) {
-        JournalFile *f, *new_file = NULL;
-        uint64_t new_offset = 0;
-        uint64_t p = 0;
+static bool location_in_file(sd_journal *j, JournalFile *f, direction_t direction) {
+        Location *l;
+
+        assert(j);
+        assert(f);
+
+        /* Checks the entry ranges recorded in the file header
+         * against the seek location, so that files entirely before
+         * or after it don't need to be bisected. Monotonic locations
+         * are resolved through the boot ID data object instead. */
+
+        l = &j->current_location;
+
+        if (l->type != LOCATION_SEEK && l->type != LOCATION_DISCRETE)
+                return true;
+
+        if (f->header->n_entries == 0)
+                return false;
+
+        if (l->seqnum_set && uuid_equal(l->seqnum_id, f->header->seqnum_id)) {
+                if (direction == DIRECTION_DOWN)
+                        return le64toh(f->header->tail_entry_seqnum) >= l->seqnum;
+                else
+                        return le64toh(f->header->head_entry_seqnum) <= l->seqnum;
+        }
+
+        if (l->realtime_set && !l->monotonic_set) {
+                if (direction == DIRECTION_DOWN)
+                        return le64toh(f->header->tail_entry_realtime) >= l->realtime;
+                else
+                        return le64toh(f->header->head_entry_realtime) <= l->realtime;
+        }
+
+        return true;
+}
+
+static int file_may_hold_entries(sd_journal *j, JournalFile *f, direction_t direction) {
+        assert(j);
+        assert(f);
+
+        /* The location only matters when the file is looked at
+         * freshly, otherwise it is iterated from its current entry */
+        if ((f->last_direction != direction || f->current_offset <= 0) &&
+            !location_in_file(j, f, direction))
+                return 0;
+
+        if (j->level0)
+                return file_may_match(j, j->level0, f);
+
+        return 1;
+}
+
+static int queue_next(sd_journal *j, JournalFile *f, direction_t direction) {
+        Object *o;
+        uint64_t p;
+        int r;
+
+        assert(j);
+        assert(f);
+
+        /* Looks for the next entry of the file beyond the current
+         * location, and puts the file into the right spot of the
+         * merge queue, or into the set of files at their end */
+
+        /* Files which cannot hold any entries to show are treated
+         * like files without further entries */
+        r = file_may_hold_entries(j, f, direction);
+        if (r > 0)
+                r = next_beyond_location(j, f, direction, &o, &p);
+        else if (r == 0)
+                j->n_files_pruned++;
+        if (r < 0) {
+                log_debug("Can't iterate through %s, ignoring: %s", f->path, strerror(-r));
+                remove_file_real(j, f);
+                return 0;
+        } else if (r == 0) {
+                prioq_remove(j->files_by_next, f, &f->next_idx);
+                f->next_offset = 0;
+                f->next_n_entries = le64toh(f->header->n_entries);
+
+                /* Archived files won't ever grow again */
+                if (f->header->state == STATE_ARCHIVED) {
+                        set_remove(j->files_at_end, f);
+                        return 0;
+                }
+
+                return set_put(j->files_at_end, f);
+        }
+
+        set_remove(j->files_at_end, f);
+
+        f->next_offset = p;
+        entry_order_from_object(&f->next_order, o);
+
+        if (prioq_reshuffle(j->files_by_next, f, &f->next_idx) > 0)
+                return 0;
+
+        return prioq_put(j->files_by_next, f, &f->next_idx);
+}
+
+static int rebuild_next(sd_journal *j, direction_t direction) {
+        JournalFile *f;
+        Iterator i;
+        int r;
+
+        assert(j);
+
+        prioq_free(j->files_by_next);
+        j->files_by_next = prioq_new(direction == DIRECTION_DOWN ? compare_next_down : compare_next_up);
+        if (!j->files_by_next)
+                return -ENOMEM;
+
+        r = set_ensure_allocated(&j->files_at_end, trivial_hash_func, trivial_compare_func);
+        if (r < 0)
+                return r;
+
+        set_clear(j->files_at_end);
+        j->n_files_pruned = 0;
+
+        HASHMAP_FOREACH(f, j->files, i) {
+                r = queue_next(j, f, direction);
+                if (r < 0)
+                        return r;
+        }
+
+        if (j->n_files_pruned > 0)
+                log_debug("Skipping %u of %u files, they hold no entries beyond the location or matching.",
+                          j->n_files_pruned, hashmap_size(j->files));
+
+        j->next_direction = direction;
+        j->next_valid = true;
+
+        return 0;
+}
+
+static int update_next(sd_journal *j, direction_t direction) {
+        JournalFile *f;
         Iterator i;
+        int r;
+
+        assert(j);
+
+        /* Of the files in the queue only the one we returned the
+         * current entry from needs to move on, all the others still
+         * have the right entry queued */
+        if (j->current_file) {
+                r = queue_next(j, j->current_file, direction);
+                if (r < 0)
+                        return r;
+        }
+
+        /* Files that had no more entries might have grown since */
+        SET_FOREACH(f, j->files_at_end, i) {
+                if (le64toh(f->header->n_entries) == f->next_n_entries)
+                        continue;
+
+                r = queue_next(j, f, direction);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static int real_journal_next(sd_journal *j, direction_t direction) {
+        JournalFile *f;
         Object *o;
         int r;
 
         assert_return(j, -EINVAL);
         assert_return(!journal_pid_changed(j), -ECHILD);
 
-        HASHMAP_FOREACH(f, j->files, i) {
-                bool found;
+        release_fields(j);
 
-                r = next_beyond_location(j, f, direction, &o, &p);
-                if (r < 0) {
-                        log_debug("Can't iterate through %s, ignoring: %s", f->path, strerror(-r));
-                        remove_file_real(j, f);
-                        continue;
-                } else if (r == 0)
-                        continue;
+        /* Instead of looking at all files for every entry, keep the
+         * next entry of every file in a priority queue and only
+         * advance the file whose entry was returned */
+        if (!j->next_valid || j->next_direction != direction)
+                r = rebuild_next(j, direction);
+        else
+                r = update_next(j, direction);
+        if (r < 0) {
+                j->next_valid = false;
+                return r;
+        }
 
-                if (!new_file)
-                        found = true;
-                else {
-                        int k;
+        for (;;) {
+                int k;
 
-                        k = compare_entry_order(f, o, new_file, new_offset);
+                f = prioq_peek(j->files_by_next);
+                if (!f)
+                        return 0;
 
-                        found = direction == DIRECTION_DOWN ? k < 0 : k > 0;
+                r = journal_file_move_to_object(f, OBJECT_ENTRY, f->next_offset, &o);
+                if (r < 0) {
+                        j->next_valid = false;
+                        return r;
                 }
 
-                if (found) {
-                        new_file = f;
-                        new_offset = p;
-                }
-        }
+                if (j->current_location.type != LOCATION_DISCRETE)
+                        break;
 
-        if (!new_file)
-                return 0;
+                k = compare_with_location(f, o, &j->current_location);
+                if (direction == DIRECTION_DOWN ? k > 0 : k < 0)
+                        break;
 
-        r = journal_file_move_to_object(new_file, OBJECT_ENTRY, new_offset, &o);
-        if (r < 0)
-                return r;
+                /* The same entry exists in another file and was
+                 * returned from there already, skip it here */
+                f->current_offset = f->next_offset;
+                f->last_direction = direction;
+
+                r = queue_next(j, f, direction);
+                if (r < 0) {
+                        j->next_valid = false;
+                        return r;
+                }
+        }
 
-        set_location(j, LOCATION_DISCRETE, new_file, o, direction, new_offset);
+        set_location(j, LOCATION_DISCRETE, f, o, direction, f->next_offset);
 
         return 1;
 }
@@ -1006,7 +1416,7 @@ _public_ int sd_journal_previous_skip(sd_journal *j, uint64_t skip) {
 _public_ int sd_journal_get_cursor(sd_journal *j, char **cursor) {
         Object *o;
         int r;
-        char bid[33], sid[33];
+        char bid[33], sid[33], fid[33];
 
         assert_return(j, -EINVAL);
         assert_return(!journal_pid_changed(j), -ECHILD);
@@ -1021,13 +1431,17 @@ _public_ int sd_journal_get_cursor(sd_journal *j, char **cursor) {
 
         uuid_to_str(j->current_file->header->seqnum_id, sid);
         uuid_to_str(o->entry.boot_id, bid);
+        uuid_to_str(j->current_file->header->file_id, fid);
 
+        /* The file ID and offset are a hint only, to find the entry
+         * without searching as long as the file is around */
         if (asprintf(cursor,
-                     "s=%s;i=%"PRIx64";b=%s;m=%"PRIx64";t=%"PRIx64";x=%"PRIx64,
+                     "s=%s;i=%"PRIx64";b=%s;m=%"PRIx64";t=%"PRIx64";x=%"PRIx64";f=%s;o=%"PRIx64,
                      sid, le64toh(o->entry.seqnum),
                      bid, le64toh(o->entry.monotonic),
                      le64toh(o->entry.realtime),
-                     le64toh(o->entry.xor_hash)) < 0)
+                     le64toh(o->entry.xor_hash),
+                     fid, j->current_file->current_offset) < 0)
                 return -ENOMEM;
 
         return 0;
@@ -1036,15 +1450,17 @@ _public_ int sd_journal_get_cursor(sd_journal *j, char **cursor) {
 _public_ int sd_journal_seek_cursor(sd_journal *j, const char *cursor) {
         const char *word, *state;
         size_t l;
-        unsigned long long seqnum, monotonic, realtime, xor_hash;
+        unsigned long long seqnum, monotonic, realtime, xor_hash, offset;
         bool
                 seqnum_id_set = false,
                 seqnum_set = false,
                 boot_id_set = false,
                 monotonic_set = false,
                 realtime_set = false,
-                xor_hash_set = false;
-        uuid_t seqnum_id, boot_id;
+                xor_hash_set = false,
+                file_id_set = false,
+                offset_set = false;
+        uuid_t seqnum_id, boot_id, file_id;
 
         assert_return(j, -EINVAL);
         assert_return(!journal_pid_changed(j), -ECHILD);
@@ -1098,6 +1514,18 @@ _public_ int sd_journal_seek_cursor(sd_journal *j, const char *cursor) {
                         if (sscanf(item+2, "%llx", &xor_hash) != 1)
                                 k = -EINVAL;
                         break;
+
+                case 'f':
+                        file_id_set = true;
+                        if (uuid_parse(item+2, &file_id) < 0)
+                                k = -EINVAL;
+                        break;
+
+                case 'o':
+                        offset_set = true;
+                        if (sscanf(item+2, "%llx", &offset) != 1)
+                                k = -EINVAL;
+                        break;
                 }
 
                 free(item);
@@ -1137,6 +1565,12 @@ _public_ int sd_journal_seek_cursor(sd_journal *j, const char *cursor) {
                 j->current_location.xor_hash_set = true;
         }
 
+        if (file_id_set && offset_set && offset > 0) {
+                j->current_location.file_id = file_id;
+                j->current_location.offset = (uint64_t) offset;
+                j->current_location.offset_set = true;
+        }
+
         return 0;
 }
 
@@ -1230,39 +1664,253 @@ _public_ int sd_journal_seek_monotonic_usec(sd_journal *j, uuid_t boot_id, uint6
         j->current_location.monotonic = usec;
         j->current_location.monotonic_set = true;
 
-        return 0;
-}
+        return 0;
+}
+
+_public_ int sd_journal_seek_realtime_usec(sd_journal *j, uint64_t usec) {
+        assert_return(j, -EINVAL);
+        assert_return(!journal_pid_changed(j), -ECHILD);
+
+        reset_location(j);
+        j->current_location.type = LOCATION_SEEK;
+        j->current_location.realtime = usec;
+        j->current_location.realtime_set = true;
+
+        return 0;
+}
+
+_public_ int sd_journal_seek_head(sd_journal *j) {
+        assert_return(j, -EINVAL);
+        assert_return(!journal_pid_changed(j), -ECHILD);
+
+        reset_location(j);
+        j->current_location.type = LOCATION_HEAD;
+
+        return 0;
+}
+
+_public_ int sd_journal_seek_tail(sd_journal *j) {
+        assert_return(j, -EINVAL);
+        assert_return(!journal_pid_changed(j), -ECHILD);
+
+        reset_location(j);
+        j->current_location.type = LOCATION_TAIL;
+
+        return 0;
+}
+
+/* The only concrete match, if the matches consist of one */
+static Match *match_single(Match *m) {
+        while (m && m->type != MATCH_DISCRETE) {
+                if (!m->matches || m->matches->matches_next)
+                        return NULL;
+
+                m = m->matches;
+        }
+
+        return m;
+}
+
+static int count_since_realtime(sd_journal *j, Match *m, uint64_t realtime, uint64_t *ret) {
+        JournalFile *f;
+        Iterator i;
+        uint64_t sum = 0, n, p = 0;
+        int r;
+
+        HASHMAP_FOREACH(f, j->files, i) {
+                if (m) {
+                        r = find_data_for_match(j, m, f, &p);
+                        if (r < 0)
+                                return r;
+                        if (r == 0)
+                                continue;
+                }
+
+                r = journal_file_count_entries_since_realtime(f, p, realtime, &n);
+                if (r < 0)
+                        return r;
+
+                sum += n;
+        }
+
+        *ret = sum;
+
+        return 0;
+}
+
+/* Moves to the entry of the file next to the realtime timestamp, of the
+ * match if there is one. Returns 0 if there is no such entry. */
+static int move_to_realtime(sd_journal *j, Match *m, JournalFile *f, uint64_t realtime,
+                            direction_t direction, EntryOrder *ret) {
+        uint64_t p = 0;
+        Object *o;
+        int r;
+
+        if (m) {
+                r = find_data_for_match(j, m, f, &p);
+                if (r <= 0)
+                        return r;
+
+                r = journal_file_move_to_entry_by_realtime_for_data(f, p, realtime, direction, &o, NULL);
+        } else
+                r = journal_file_move_to_entry_by_realtime(f, realtime, direction, &o, NULL);
+        if (r <= 0)
+                return r;
+
+        entry_order_from_object(ret, o);
+
+        return 1;
+}
+
+/* Checks that the entries before the realtime timestamp come first in
+ * the order the files are merged in, so that the entries counted from
+ * it are the last ones. Files are merged by seqnum or monotonic time
+ * where they can, and a clock stepped back between entries of two
+ * files breaks the assumption even if each file is ordered. */
+static int check_window_order(sd_journal *j, Match *m, uint64_t realtime) {
+        _cleanup_free_ JournalFile **files = NULL;
+        _cleanup_free_ EntryOrder *before = NULL, *after = NULL;
+        _cleanup_free_ bool *has_before = NULL, *has_after = NULL;
+        JournalFile *f;
+        Iterator it;
+        unsigned n = 0, a, b;
+        int r;
+
+        files = new(JournalFile*, hashmap_size(j->files));
+        before = new(EntryOrder, hashmap_size(j->files));
+        after = new(EntryOrder, hashmap_size(j->files));
+        has_before = new0(bool, hashmap_size(j->files));
+        has_after = new0(bool, hashmap_size(j->files));
+        if (!files || !before || !after || !has_before || !has_after)
+                return -ENOMEM;
+
+        HASHMAP_FOREACH(f, j->files, it) {
+                if (realtime > 0) {
+                        r = move_to_realtime(j, m, f, realtime - 1, DIRECTION_UP, before + n);
+                        if (r < 0)
+                                return r;
+                        has_before[n] = r > 0;
+                }
+
+                r = move_to_realtime(j, m, f, realtime, DIRECTION_DOWN, after + n);
+                if (r < 0)
+                        return r;
+                has_after[n] = r > 0;
+
+                files[n++] = f;
+        }
+
+        for (a = 0; a < n; a++) {
+                if (!has_before[a])
+                        continue;
+
+                for (b = 0; b < n; b++) {
+                        if (a == b || !has_after[b])
+                                continue;
+
+                        if (compare_entry_order(files[a], before + a, files[b], after + b) >= 0)
+                                return 0;
+                }
+        }
+
+        return 1;
+}
+
+/* Whether every file with entries is ordered by realtime */
+static bool files_realtime_ordered(sd_journal *j) {
+        JournalFile *f;
+        Iterator i;
+
+        HASHMAP_FOREACH(f, j->files, i)
+                if (f->header->n_entries > 0 && !JOURNAL_HEADER_REALTIME_ORDERED(f->header))
+                        return false;
+
+        return true;
+}
+
+int journal_realtime_ordered(sd_journal *j, uint64_t realtime) {
+        assert(j);
+
+        if (!files_realtime_ordered(j))
+                return 0;
+
+        return check_window_order(j, NULL, realtime);
+}
+
+int journal_seek_tail_window(sd_journal *j, uint64_t n) {
+        JournalFile *f;
+        Iterator i;
+        Match *m = NULL;
+        uint64_t lo = USEC_INFINITY, hi = 0, c = 0, k;
+        int r;
+
+        assert(j);
+
+        if (j->level0) {
+                m = match_single(j->level0);
+                if (!m)
+                        return -EOPNOTSUPP;
+        }
+
+        if (n == 0) {
+                sd_journal_seek_tail(j);
+                return sd_journal_previous(j);
+        }
+
+        /* Entries can only be counted by bisection if no clock step
+         * sent realtime back within a file */
+        if (!files_realtime_ordered(j))
+                return -EOPNOTSUPP;
+
+        HASHMAP_FOREACH(f, j->files, i) {
+                if (f->header->n_entries == 0)
+                        continue;
+
+                lo = MIN(lo, le64toh(f->header->head_entry_realtime));
+                hi = MAX(hi, le64toh(f->header->tail_entry_realtime));
+        }
 
-_public_ int sd_journal_seek_realtime_usec(sd_journal *j, uint64_t usec) {
-        assert_return(j, -EINVAL);
-        assert_return(!journal_pid_changed(j), -ECHILD);
+        if (lo <= hi) {
+                r = count_since_realtime(j, m, lo, &c);
+                if (r < 0)
+                        return r;
+        }
 
-        reset_location(j);
-        j->current_location.type = LOCATION_SEEK;
-        j->current_location.realtime = usec;
-        j->current_location.realtime_set = true;
+        if (c <= n) {
+                sd_journal_seek_head(j);
+                return sd_journal_next(j);
+        }
 
-        return 0;
-}
+        /* Look for the latest time with at least n entries at or
+         * after it. Entries sharing that time are skipped below. */
+        hi++;
+        while (hi - lo > 1) {
+                uint64_t t = lo + (hi - lo) / 2;
 
-_public_ int sd_journal_seek_head(sd_journal *j) {
-        assert_return(j, -EINVAL);
-        assert_return(!journal_pid_changed(j), -ECHILD);
+                r = count_since_realtime(j, m, t, &k);
+                if (r < 0)
+                        return r;
 
-        reset_location(j);
-        j->current_location.type = LOCATION_HEAD;
+                if (k >= n) {
+                        lo = t;
+                        c = k;
+                } else
+                        hi = t;
+        }
 
-        return 0;
-}
+        r = check_window_order(j, m, lo);
+        if (r < 0)
+                return r;
+        if (r == 0)
+                return -EOPNOTSUPP;
 
-_public_ int sd_journal_seek_tail(sd_journal *j) {
-        assert_return(j, -EINVAL);
-        assert_return(!journal_pid_changed(j), -ECHILD);
+        sd_journal_seek_realtime_usec(j, lo);
 
-        reset_location(j);
-        j->current_location.type = LOCATION_TAIL;
+        r = sd_journal_next_skip(j, c - n + 1);
+        if (r < 0)
+                return r;
 
-        return 0;
+        return r > 0;
 }
 
 static bool file_has_type_prefix(const char *prefix, const char *filename) {
@@ -1301,6 +1949,16 @@ static bool file_type_wanted(int flags, const char *filename) {
         return false;
 }
 
+/* Tells writers that notifications are wanted for the file. Readers
+ * which poll the headers don't need them. */
+static void follow_file(JournalFile *f) {
+        int r;
+
+        r = journal_file_follow(f);
+        if (r < 0)
+                log_debug("Failed to lock %s for following, ignoring: %s", f->path, strerror(-r));
+}
+
 static int add_any_file(sd_journal *j, const char *path) {
         JournalFile *f = NULL;
         int r;
@@ -1316,7 +1974,7 @@ static int add_any_file(sd_journal *j, const char *path) {
                 return set_put_error(j, -ETOOMANYREFS);
         }
 
-        r = journal_file_open(path, O_RDONLY, 0, false, NULL, j->mmap, NULL, &f);
+        r = journal_file_open(path, O_RDONLY, 0, false, false, NULL, j->mmap, NULL, &f);
         if (r < 0)
                 return r;
 
@@ -1330,6 +1988,11 @@ static int add_any_file(sd_journal *j, const char *path) {
 
         log_debug("File %s added.", f->path);
 
+        if (j->inotify_fd >= 0 && j->poll_usec == 0)
+                follow_file(f);
+
+        /* The new file needs to be considered for merging */
+        j->next_valid = false;
         j->current_invalidate_counter ++;
 
         return 0;
@@ -1382,6 +2045,8 @@ static void remove_file_real(sd_journal *j, JournalFile *f) {
         assert(f);
 
         hashmap_remove(j->files, f->path);
+        prioq_remove(j->files_by_next, f, &f->next_idx);
+        set_remove(j->files_at_end, f);
 
         log_debug("File %s removed.", f->path);
 
@@ -1795,11 +2460,13 @@ fail:
 _public_ void sd_journal_close(sd_journal *j) {
         Directory *d;
         JournalFile *f;
+        unsigned i;
 
         if (!j)
                 return;
 
         sd_journal_flush_matches(j);
+        release_fields(j);
 
         while ((f = hashmap_steal_first(j->files)))
                 journal_file_close(f);
@@ -1822,8 +2489,17 @@ _public_ void sd_journal_close(sd_journal *j) {
                 mmap_cache_unref(j->mmap);
         }
 
+        for (i = 0; i < j->n_fields_buffer; i++)
+                free(j->fields_buffer[i]);
+        free(j->fields_buffer);
+        free(j->fields_buffer_size);
+
+        prioq_free(j->files_by_next);
+        set_free(j->files_at_end);
+
         free(j->path);
         free(j->unique_field);
+        set_free_free(j->unique_values);
         set_free(j->errors);
         free(j);
 }
@@ -1888,6 +2564,84 @@ _public_ int sd_journal_get_monotonic_usec(sd_journal *j, uint64_t *ret, uuid_t
         return 0;
 }
 
+static bool field_absent(JournalFile *f, const char *field) {
+        unsigned i;
+
+        assert(f);
+        assert(field);
+
+        if (!JOURNAL_HEADER_CONTAINS(f->header, n_fields))
+                return false;
+
+        /* Fields are only added to files, never removed */
+        for (i = 0; i < MISSED_FIELDS_MAX; i++) {
+                MissedField *m = f->missed_fields + i;
+
+                if (m->absent &&
+                    m->n_fields == le64toh(f->header->n_fields) &&
+                    streq(m->field, field))
+                        return true;
+        }
+
+        return false;
+}
+
+/* Looks for the field object of a field missed in an entry only when
+ * the field was missed before, so that a field which is just rare in
+ * the file is looked up once, and one which isn't in it at all is
+ * remembered as absent */
+static int field_missed(JournalFile *f, const char *field, size_t field_length) {
+        MissedField *m = NULL;
+        unsigned i;
+        int r;
+
+        assert(f);
+        assert(field);
+
+        if (!JOURNAL_HEADER_CONTAINS(f->header, n_fields))
+                return 0;
+
+        for (i = 0; i < MISSED_FIELDS_MAX; i++)
+                if (f->missed_fields[i].field && streq(f->missed_fields[i].field, field)) {
+                        m = f->missed_fields + i;
+                        break;
+                }
+
+        if (!m) {
+                char *c;
+
+                c = strdup(field);
+                if (!c)
+                        return -ENOMEM;
+
+                m = f->missed_fields + f->missed_fields_next;
+                f->missed_fields_next = (f->missed_fields_next + 1) % MISSED_FIELDS_MAX;
+
+                free(m->field);
+                zero(*m);
+                m->field = c;
+
+                return 0;
+        }
+
+        /* Present fields stay present, absent ones are looked up
+         * again once new fields were added */
+        if (m->probed &&
+            (!m->absent || m->n_fields == le64toh(f->header->n_fields)))
+                return 0;
+
+        m->n_fields = le64toh(f->header->n_fields);
+
+        r = journal_file_find_field_object(f, field, field_length, NULL, NULL);
+        if (r < 0)
+                return r;
+
+        m->probed = true;
+        m->absent = r == 0;
+
+        return 0;
+}
+
 static bool field_is_valid(const char *field) {
         const char *p;
 
@@ -1921,7 +2675,7 @@ _public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **
         uint64_t i, n;
         size_t field_length;
         int r;
-        Object *o;
+        Object *e, *o;
 
         assert_return(j, -EINVAL);
         assert_return(!journal_pid_changed(j), -ECHILD);
@@ -1937,26 +2691,32 @@ _public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **
         if (f->current_offset <= 0)
                 return -EADDRNOTAVAIL;
 
-        r = journal_file_move_to_object(f, OBJECT_ENTRY, f->current_offset, &o);
+        field_length = strlen(field);
+
+        /* A field that has no field object in this file cannot be
+         * part of the entry, so don't look at any of its items */
+        if (field_absent(f, field))
+                return -ENOENT;
+
+        r = journal_file_move_to_object(f, OBJECT_ENTRY, f->current_offset, &e);
         if (r < 0)
                 return r;
 
-        field_length = strlen(field);
-
-        n = journal_file_entry_n_items(o);
+        /* The entry and the data objects are mapped through different
+         * mmap contexts, hence the entry stays valid while we iterate
+         * over its items */
+        n = journal_file_entry_n_items(e);
         for (i = 0; i < n; i++) {
                 uint64_t p, l;
-                le64_t le_hash;
                 size_t t;
                 int compression;
 
-                p = le64toh(o->entry.items[i].object_offset);
-                le_hash = o->entry.items[i].hash;
+                p = le64toh(e->entry.items[i].object_offset);
                 r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
                 if (r < 0)
                         return r;
 
-                if (le_hash != o->data.hash)
+                if (e->entry.items[i].hash != o->data.hash)
                         return -EBADMSG;
 
                 l = le64toh(o->object.size) - offsetof(Object, data.payload);
@@ -2000,13 +2760,186 @@ _public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **
 
                         return 0;
                 }
+        }
+
+        r = field_missed(f, field, field_length);
+        if (r < 0)
+                return r;
+
+        return -ENOENT;
+}
+
+static int fields_buffer_ensure(sd_journal *j, unsigned n) {
+        void **b;
+        size_t *s;
+
+        assert(j);
+
+        if (j->n_fields_buffer >= n)
+                return 0;
+
+        b = realloc(j->fields_buffer, n * sizeof(void*));
+        if (!b)
+                return -ENOMEM;
+        j->fields_buffer = b;
+
+        s = realloc(j->fields_buffer_size, n * sizeof(size_t));
+        if (!s)
+                return -ENOMEM;
+        j->fields_buffer_size = s;
+
+        memzero(j->fields_buffer + j->n_fields_buffer, (n - j->n_fields_buffer) * sizeof(void*));
+        memzero(j->fields_buffer_size + j->n_fields_buffer, (n - j->n_fields_buffer) * sizeof(size_t));
+        j->n_fields_buffer = n;
+
+        return 0;
+}
+
+_public_ int sd_journal_get_fields(sd_journal *j, const char * const *fields, unsigned n_fields, const void **data, size_t *size) {
+        JournalFile *f;
+        uint64_t i, n;
+        size_t max_length = 0;
+        unsigned k, found = 0;
+        int r;
+        Object *e, *o;
+
+        assert_return(j, -EINVAL);
+        assert_return(!journal_pid_changed(j), -ECHILD);
+        assert_return(fields || n_fields == 0, -EINVAL);
+        assert_return(data || n_fields == 0, -EINVAL);
+        assert_return(size || n_fields == 0, -EINVAL);
+
+        /* Until a field is found, its size slot caches the length of
+         * its name, and the data slot stays NULL */
+        for (k = 0; k < n_fields; k++) {
+                assert_return(fields[k] && field_is_valid(fields[k]), -EINVAL);
+
+                data[k] = NULL;
+                size[k] = strlen(fields[k]);
+                max_length = MAX(max_length, size[k]);
+        }
+
+        f = j->current_file;
+        if (!f)
+                return -EADDRNOTAVAIL;
+
+        if (f->current_offset <= 0)
+                return -EADDRNOTAVAIL;
+
+        /* Data which isn't compressed is returned from where it is
+         * mapped. Moving on to the next data object must not unmap
+         * the windows of the previous ones, and they need to stay
+         * mapped until the next call or until the read pointer moves */
+        release_fields(j);
+        mmap_cache_pin(j->mmap);
+        j->fields_pinned = true;
+
+        r = journal_file_move_to_object(f, OBJECT_ENTRY, f->current_offset, &e);
+        if (r < 0)
+                return r;
 
-                r = journal_file_move_to_object(f, OBJECT_ENTRY, f->current_offset, &o);
+        n = journal_file_entry_n_items(e);
+        for (i = 0; i < n && found < n_fields; i++) {
+                const char *payload, *eq;
+                uint64_t p, l;
+                size_t t, field_length;
+                int compression;
+                void **buffer = NULL;
+
+                p = le64toh(e->entry.items[i].object_offset);
+                r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
                 if (r < 0)
                         return r;
+
+                if (e->entry.items[i].hash != o->data.hash)
+                        return -EBADMSG;
+
+                l = le64toh(o->object.size) - offsetof(Object, data.payload);
+                t = (size_t) l;
+
+                /* We can't read objects larger than 4G on a 32bit machine */
+                if ((uint64_t) t != l)
+                        return -E2BIG;
+
+                compression = o->object.flags & OBJECT_COMPRESSION_MASK;
+                if (compression) {
+#if defined(HAVE_XZ) || defined(HAVE_LZ4)
+                        /* Decompress into the spare buffer after those
+                         * of the fields, which is swapped with the
+                         * buffer of the field it turns out to be. Only
+                         * as much as is needed to look at the field
+                         * name is asked for, but LZ4 always returns all
+                         * of it, which is then used as it is. */
+                        r = fields_buffer_ensure(j, n_fields + 1);
+                        if (r < 0)
+                                return r;
+
+                        r = decompress_blob(compression,
+                                            o->data.payload, l,
+                                            &j->fields_buffer[n_fields], &j->fields_buffer_size[n_fields], &t,
+                                            max_length + 1);
+                        if (r < 0)
+                                return r;
+
+                        payload = j->fields_buffer[n_fields];
+#else
+                        return -EPROTONOSUPPORT;
+#endif
+                } else
+                        payload = (const char*) o->data.payload;
+
+                eq = memchr(payload, '=', MIN(t, max_length + 1));
+                if (!eq)
+                        continue;
+
+                field_length = eq - payload;
+
+                for (k = 0; k < n_fields; k++) {
+                        if (data[k] ||
+                            size[k] != field_length ||
+                            memcmp(fields[k], payload, field_length) != 0)
+                                continue;
+
+                        if (compression && !buffer) {
+                                void *b;
+                                size_t a;
+
+                                b = j->fields_buffer[k];
+                                j->fields_buffer[k] = j->fields_buffer[n_fields];
+                                j->fields_buffer[n_fields] = b;
+
+                                a = j->fields_buffer_size[k];
+                                j->fields_buffer_size[k] = j->fields_buffer_size[n_fields];
+                                j->fields_buffer_size[n_fields] = a;
+
+                                buffer = &j->fields_buffer[k];
+
+                                /* XZ stopped after the field name */
+                                if (t == max_length + 1 &&
+                                    (j->data_threshold <= 0 || t < j->data_threshold)) {
+                                        r = decompress_blob(compression,
+                                                            o->data.payload, l,
+                                                            buffer, &j->fields_buffer_size[k], &t,
+                                                            j->data_threshold);
+                                        if (r < 0)
+                                                return r;
+
+                                        payload = *buffer;
+                                }
+                        }
+
+                        data[k] = compression ? *buffer : o->data.payload;
+                        size[k] = t;
+
+                        found++;
+                }
         }
 
-        return -ENOENT;
+        for (k = 0; k < n_fields; k++)
+                if (!data[k])
+                        size[k] = 0;
+
+        return (int) found;
 }
 
 static int return_data(sd_journal *j, JournalFile *f, Object *o, const void **data, size_t *size) {
@@ -2043,10 +2976,10 @@ static int return_data(sd_journal *j, JournalFile *f, Object *o, const void **da
                 *size = t;
         }
 
-        return 0;
+        return !compression;
 }
 
-_public_ int sd_journal_enumerate_data(sd_journal *j, const void **data, size_t *size) {
+int journal_enumerate_data_object(sd_journal *j, const void **data, size_t *size, Object **ret, uint64_t *offset) {
         JournalFile *f;
         uint64_t p, n;
         le64_t le_hash;
@@ -2086,11 +3019,32 @@ _public_ int sd_journal_enumerate_data(sd_journal *j, const void **data, size_t
         if (r < 0)
                 return r;
 
+        if (ret)
+                *ret = o;
+        if (offset)
+                *offset = p;
+
         j->current_field ++;
 
         return 1;
 }
 
+_public_ int sd_journal_enumerate_data(sd_journal *j, const void **data, size_t *size) {
+        return journal_enumerate_data_object(j, data, size, NULL, NULL);
+}
+
+void journal_pin_data(sd_journal *j) {
+        assert(j);
+
+        mmap_cache_pin(j->mmap);
+}
+
+void journal_unpin_data(sd_journal *j) {
+        assert(j);
+
+        mmap_cache_unpin(j->mmap);
+}
+
 _public_ void sd_journal_restart_data(sd_journal *j) {
         if (!j)
                 return;
@@ -2099,6 +3053,8 @@ _public_ void sd_journal_restart_data(sd_journal *j) {
 }
 
 _public_ int sd_journal_get_fd(sd_journal *j) {
+        JournalFile *f;
+        Iterator i;
         int r;
 
         assert_return(j, -EINVAL);
@@ -2111,6 +3067,10 @@ _public_ int sd_journal_get_fd(sd_journal *j) {
         if (r < 0)
                 return r;
 
+        if (j->poll_usec == 0)
+                HASHMAP_FOREACH(f, j->files, i)
+                        follow_file(f);
+
         /* Iterate through all dirs again, to add them to the
          * inotify */
         if (j->no_new_files)
@@ -2251,6 +3211,58 @@ _public_ int sd_journal_process(sd_journal *j) {
         }
 }
 
+void journal_set_poll_interval(sd_journal *j, usec_t usec) {
+        assert(j);
+
+        j->poll_usec = usec;
+}
+
+/* Whether files at their end got new entries, as seen in their headers */
+static bool files_grown(sd_journal *j) {
+        JournalFile *f;
+        Iterator i;
+
+        SET_FOREACH(f, j->files_at_end, i)
+                if (le64toh(f->header->n_entries) != f->next_n_entries)
+                        return true;
+
+        return false;
+}
+
+static int wait_polling(sd_journal *j, uint64_t timeout_usec) {
+        usec_t until = USEC_INFINITY;
+        int r;
+
+        if (timeout_usec != (uint64_t) -1)
+                until = now(CLOCK_MONOTONIC) + timeout_usec;
+
+        for (;;) {
+                usec_t n, t = j->poll_usec;
+
+                if (files_grown(j))
+                        return SD_JOURNAL_APPEND;
+
+                if (until != USEC_INFINITY) {
+                        n = now(CLOCK_MONOTONIC);
+                        if (n >= until)
+                                return SD_JOURNAL_NOP;
+
+                        t = MIN(t, until - n);
+                }
+
+                r = fd_wait_for_event(j->inotify_fd, POLLIN, t);
+                if (r == -EINTR)
+                        continue;
+                if (r < 0)
+                        return r;
+                if (r > 0) {
+                        r = sd_journal_process(j);
+                        if (r != SD_JOURNAL_NOP)
+                                return r;
+                }
+        }
+}
+
 _public_ int sd_journal_wait(sd_journal *j, uint64_t timeout_usec) {
         int r;
 
@@ -2272,6 +3284,9 @@ _public_ int sd_journal_wait(sd_journal *j, uint64_t timeout_usec) {
                 return determine_change(j);
         }
 
+        if (j->poll_usec > 0)
+                return wait_polling(j, timeout_usec);
+
         do {
                 r = fd_wait_for_event(j->inotify_fd, POLLIN, timeout_usec);
         } while (r == -EINTR);
@@ -2366,6 +3381,7 @@ void journal_print_header(sd_journal *j) {
         Iterator i;
         JournalFile *f;
         bool newline = false;
+        unsigned n_pruned = 0;
 
         assert(j);
 
@@ -2376,7 +3392,20 @@ void journal_print_header(sd_journal *j) {
                         newline = true;
 
                 journal_file_print_header(f);
+
+                if (j->level0) {
+                        int r;
+
+                        r = file_may_match(j, j->level0, f);
+                        if (r == 0)
+                                n_pruned++;
+
+                        printf("Pruned by Matches: %s\n", r < 0 ? "unknown" : yes_no(r == 0));
+                }
         }
+
+        if (j->level0)
+                printf("\n%u of %u files pruned by matches.\n", n_pruned, hashmap_size(j->files));
 }
 
 _public_ int sd_journal_get_usage(sd_journal *j, uint64_t *bytes) {
@@ -2401,6 +3430,27 @@ _public_ int sd_journal_get_usage(sd_journal *j, uint64_t *bytes) {
         return 0;
 }
 
+/* A value returned by sd_journal_enumerate_unique(), keyed by the hash
+ * of the full data object, which comes first so that it can be hashed
+ * like a plain uint64_t */
+typedef struct UniqueValue {
+        uint64_t hash;
+        size_t size;
+        uint8_t data[];
+} UniqueValue;
+
+static int unique_value_compare_func(const void *a, const void *b) {
+        const UniqueValue *x = a, *y = b;
+
+        if (x->hash != y->hash)
+                return x->hash < y->hash ? -1 : 1;
+
+        if (x->size != y->size)
+                return x->size < y->size ? -1 : 1;
+
+        return memcmp(x->data, y->data, x->size);
+}
+
 _public_ int sd_journal_query_unique(sd_journal *j, const char *field) {
         char *f;
 
@@ -2417,12 +3467,14 @@ _public_ int sd_journal_query_unique(sd_journal *j, const char *field) {
         j->unique_field = f;
         j->unique_file = NULL;
         j->unique_offset = 0;
+        set_clear_free(j->unique_values);
 
         return 0;
 }
 
 _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_t *l) {
         size_t k;
+        int r;
 
         assert_return(j, -EINVAL);
         assert_return(!journal_pid_changed(j), -ECHILD);
@@ -2432,6 +3484,10 @@ _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_
 
         k = strlen(j->unique_field);
 
+        r = set_ensure_allocated(&j->unique_values, uint64_hash_func, unique_value_compare_func);
+        if (r < 0)
+                return r;
+
         if (!j->unique_file) {
                 j->unique_file = hashmap_first(j->files);
                 if (!j->unique_file)
@@ -2440,13 +3496,10 @@ _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_
         }
 
         for (;;) {
-                JournalFile *of;
-                Iterator i;
+                UniqueValue *v;
                 Object *o;
                 const void *odata;
                 size_t ol;
-                bool found;
-                int r;
 
                 /* Proceed to next data object in the field's linked list */
                 if (j->unique_offset == 0) {
@@ -2509,38 +3562,28 @@ _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_
                         return -EBADMSG;
                 }
 
-                /* OK, now let's see if we already returned this data
-                 * object by checking if it exists in the earlier
-                 * traversed files. */
-                found = false;
-                HASHMAP_FOREACH(of, j->files, i) {
-                        Object *oo;
-                        uint64_t op;
-
-                        if (of == j->unique_file)
-                                break;
-
-                        /* Skip this file it didn't have any fields
-                         * indexed */
-                        if (JOURNAL_HEADER_CONTAINS(of->header, n_fields) &&
-                            le64toh(of->header->n_fields) <= 0)
-                                continue;
-
-                        r = journal_file_find_data_object_with_hash(of, odata, ol, le64toh(o->data.hash), &oo, &op);
-                        if (r < 0)
-                                return r;
+                /* OK, now let's see if we already returned this
+                 * value, from this or an earlier traversed file. The
+                 * returned data might be cut at the threshold, hence
+                 * it is keyed together with the hash of the full
+                 * data. */
+                v = malloc(offsetof(UniqueValue, data) + ol);
+                if (!v)
+                        return -ENOMEM;
 
-                        if (r > 0)
-                                found = true;
-                }
+                v->hash = le64toh(o->data.hash);
+                v->size = ol;
+                memcpy(v->data, odata, ol);
 
-                if (found)
+                r = set_consume(j->unique_values, v);
+                if (r == -EEXIST)
                         continue;
-
-                r = return_data(j, j->unique_file, o, data, l);
                 if (r < 0)
                         return r;
 
+                *data = v->data;
+                *l = v->size;
+
                 return 1;
         }
 }
@@ -2551,6 +3594,7 @@ _public_ void sd_journal_restart_unique(sd_journal *j) {
 
         j->unique_file = NULL;
         j->unique_offset = 0;
+        set_clear_free(j->unique_values);
 }
 
 _public_ int sd_journal_set_data_threshold(sd_journal *j, size_t sz) {
@@ -28,6 +28,7 @@ typedef enum OutputMode {
         OUTPUT_SHORT_MONOTONIC,
         OUTPUT_VERBOSE,
         OUTPUT_EXPORT,
+        OUTPUT_BINARY,
         OUTPUT_JSON,
         OUTPUT_JSON_PRETTY,
         OUTPUT_JSON_SSE,
@@ -149,6 +149,17 @@ bool utf8_is_printable_newline(const char* str, size_t length, bool newline) {
         for (p = (const uint8_t*) str; length;) {
                 int encoded_len, val;
 
+                /* Plain ASCII is the common case, don't decode it */
+                if (*p < 0x80) {
+                        if ((*p < ' ' && *p != '\t' && (*p != '\n' || !newline)) ||
+                            *p == 0x7F)
+                                return false;
+
+                        length--;
+                        p++;
+                        continue;
+                }
+
                 encoded_len = utf8_encoded_valid_unichar((const char *) p);
                 val = utf8_encoded_to_unichar((const char*) p);
 
@@ -29,6 +29,7 @@
 #include "journal-def.h"
 #include "hashmap.h"
 #include "set.h"
+#include "prioq.h"
 #include "journal-file.h"
 
 typedef struct Match Match;
@@ -50,6 +51,7 @@ struct Match {
         char *data;
         size_t size;
         le64_t le_hash;
+        unsigned idx; /* slot in the per-file data offset cache */
 
         /* For terms */
         Match *matches;
@@ -86,6 +88,12 @@ struct Location {
         uuid_t boot_id;
 
         uint64_t xor_hash;
+
+        /* Where the entry is stored, if known, so that it needn't be
+         * searched for in that file */
+        bool offset_set;
+        uuid_t file_id;
+        uint64_t offset;
 };
 
 struct Directory {
@@ -107,15 +115,35 @@ struct sd_journal {
 
         Match *level0, *level1, *level2;
 
+        /* Number of concrete matches, and a counter bumped whenever
+         * the matches change, invalidating the per-file caches of
+         * their data objects */
+        unsigned n_match_leaves;
+        unsigned match_generation;
+
+        /* Files with an entry beyond the current location, ordered by
+         * that entry for merging, and the remaining non-archived files
+         * which need to be checked again when they grow */
+        Prioq *files_by_next;
+        Set *files_at_end;
+        direction_t next_direction;
+        bool next_valid;
+        unsigned n_files_pruned;
+
         pid_t original_pid;
 
         int inotify_fd;
         unsigned current_invalidate_counter, last_invalidate_counter;
         usec_t last_process_usec;
 
+        /* How often sd_journal_wait() looks at the headers of the
+         * files at their end for new entries, 0 if it doesn't */
+        usec_t poll_usec;
+
         char *unique_field;
         JournalFile *unique_file;
         uint64_t unique_offset;
+        Set *unique_values;
 
         int flags;
 
@@ -123,6 +151,16 @@ struct sd_journal {
 
         size_t data_threshold;
 
+        /* Decompression buffers for sd_journal_get_fields(), one per
+         * requested field */
+        void **fields_buffer;
+        size_t *fields_buffer_size;
+        unsigned n_fields_buffer;
+
+        /* Whether the mmap cache is pinned for the data returned by
+         * the last sd_journal_get_fields() */
+        bool fields_pinned;
+
         Hashmap *directories_by_path;
         Hashmap *directories_by_wd;
 
@@ -130,8 +168,40 @@ struct sd_journal {
 };
 
 char *journal_make_match_string(sd_journal *j);
+
+/* Like sd_journal_enumerate_data(), and returns the data object of the
+ * current file with its offset. Unless the object is compressed, the
+ * data points into it rather than into a decompression buffer, which
+ * is reused by the next call. */
+int journal_enumerate_data_object(sd_journal *j, const void **data, size_t *size, Object **ret, uint64_t *offset);
+
+/* Keeps everything which is mapped now or later mapped until unpinned,
+ * so mapped data stays valid while the journal moves on */
+void journal_pin_data(sd_journal *j);
+void journal_unpin_data(sd_journal *j);
 void journal_print_header(sd_journal *j);
 
+/* Makes sd_journal_wait() also look for new entries in the headers of
+ * the files every usec. The headers are shared with the writer through
+ * the mapping, so entries are noticed even if the writer doesn't call
+ * journal_file_post_change() for them, and the reader doesn't ask writers
+ * to. New and removed files are still noticed through inotify. */
+void journal_set_poll_interval(sd_journal *j, usec_t usec);
+
+/* Moves to the first of the last n entries, counting the entries of the
+ * files after a point in time instead of stepping back through them one
+ * by one. Returns 1 if there is such an entry, 0 if there are no entries
+ * and -EOPNOTSUPP if the matches are more than a single field value, or
+ * if realtime can't be shown to follow the order entries are merged in,
+ * as after the clock was stepped back. */
+int journal_seek_tail_window(sd_journal *j, uint64_t n);
+
+/* Returns 1 if realtime doesn't go back within any of the files, and the
+ * entries before the realtime timestamp come before the ones at or after
+ * it in the order the files are merged in. Seeking to the timestamp then
+ * splits the entries at it exactly. */
+int journal_realtime_ordered(sd_journal *j, uint64_t realtime);
+
 DEFINE_TRIVIAL_CLEANUP_FUNC(sd_journal*, sd_journal_close);
 #define _cleanup_journal_close_ _cleanup_(sd_journal_closep)
 
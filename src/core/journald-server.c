@@ -46,6 +46,7 @@
 #define USER_JOURNALS_MAX 1024
 
 #define DEFAULT_SYNC_INTERVAL_USEC (5*USEC_PER_MINUTE)
+#define DEFAULT_NOTIFY_INTERVAL_USEC (10*USEC_PER_MSEC)
 #define DEFAULT_MAX_FILE_USEC USEC_PER_MONTH
 
 #define RECHECK_AVAILABLE_SPACE_USEC (30*USEC_PER_SEC)
@@ -150,6 +151,23 @@ void server_fix_perms(Server *s, JournalFile *f) {
                 log_warning("Failed to fix access mode on %s, ignoring: %s", f->path, strerror(-r));
 }
 
+static void server_setup_journal(Server *s, JournalFile *f) {
+        server_fix_perms(s, f);
+
+        f->notify_interval = s->notify_interval_usec;
+        f->notify_followers_only = s->notify_followers_only;
+}
+
+/* Collects the number of notifications suppressed, before the file is
+ * closed */
+static void server_count_notify(Server *s, JournalFile *f) {
+        if (!f)
+                return;
+
+        s->n_notify_suppressed += f->n_notify_suppressed;
+        f->n_notify_suppressed = 0;
+}
+
 static JournalFile* find_journal(Server *s, uid_t uid) {
         _cleanup_free_ char *p = NULL;
         int r;
@@ -179,14 +197,15 @@ static JournalFile* find_journal(Server *s, uid_t uid) {
                 /* Too many open? Then let's close one */
                 f = hashmap_steal_first(s->user_journals);
                 assert(f);
+                server_count_notify(s, f);
                 journal_file_close(f);
         }
 
-        r = journal_file_open_reliably(p, O_RDWR|O_CREAT, 0640, s->compress, &s->system_metrics, s->mmap, NULL, &f);
+        r = journal_file_open_reliably(p, O_RDWR|O_CREAT, 0640, s->compress, s->index_messages, &s->system_metrics, s->mmap, NULL, &f);
         if (r < 0)
                 return s->system_journal;
 
-        server_fix_perms(s, f);
+        server_setup_journal(s, f);
 
         r = hashmap_put(s->user_journals, UINT32_TO_PTR(uid), f);
         if (r < 0) {
@@ -205,7 +224,9 @@ static int do_rotate(Server *s, JournalFile **f, const char* name,
         if (!*f)
                 return -EINVAL;
 
-        r = journal_file_rotate(f, s->compress);
+        server_count_notify(s, *f);
+
+        r = journal_file_rotate(f, s->compress, s->index_messages);
         if (r < 0)
                 if (*f)
                         log_error("Failed to rotate %s: %s",
@@ -214,7 +235,7 @@ static int do_rotate(Server *s, JournalFile **f, const char* name,
                         log_error("Failed to create new %s journal: %s",
                                   name, strerror(-r));
         else
-                server_fix_perms(s, *f);
+                server_setup_journal(s, *f);
         return r;
 }
 
@@ -262,6 +283,91 @@ void server_sync(Server *s) {
 
         s->sync_seqnum = s->seqnum;
         s->sync_time = now(CLOCK_MONOTONIC);
+
+        server_count_notify(s, s->system_journal);
+        server_count_notify(s, s->runtime_journal);
+        HASHMAP_FOREACH_KEY(f, k, s->user_journals, i)
+                server_count_notify(s, f);
+
+        log_debug("%"PRIu64" change notifications suppressed so far.", s->n_notify_suppressed);
+}
+
+static usec_t notify_pending(usec_t due, JournalFile *f) {
+        usec_t t;
+
+        if (!f)
+                return due;
+
+        t = journal_file_notify_pending(f);
+        if (t > 0 && (due == 0 || t < due))
+                due = t;
+
+        return due;
+}
+
+static void server_arm_notify(Server *s, usec_t due) {
+        struct itimerspec its = {};
+
+        if (due == 0 || s->notify_armed)
+                return;
+
+        timespec_store(&its.it_value, due);
+
+        if (timerfd_settime(s->notify_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+                log_error("Failed to arm notification timer: %m");
+                return;
+        }
+
+        s->notify_armed = true;
+}
+
+/* Arms the timer to send the notification held back for the file */
+static void server_schedule_notify(Server *s, JournalFile *f) {
+        if (f->notify_pending)
+                server_arm_notify(s, f->notify_timestamp + f->notify_interval);
+}
+
+static int dispatch_notify(int fd, uint32_t events, void *userdata) {
+        Server *s = userdata;
+        JournalFile *f;
+        Iterator i;
+        usec_t due = 0;
+        uint64_t x;
+
+        assert(s);
+        assert(fd == s->notify_fd);
+
+        if (read(fd, &x, sizeof(x)) < 0 && errno != EAGAIN)
+                log_error("Failed to read notification timer: %m");
+
+        s->notify_armed = false;
+
+        due = notify_pending(due, s->system_journal);
+        due = notify_pending(due, s->runtime_journal);
+        HASHMAP_FOREACH(f, s->user_journals, i)
+                due = notify_pending(due, f);
+
+        server_arm_notify(s, due);
+
+        return 0;
+}
+
+static int server_open_notify_timer(Server *s) {
+        if (s->notify_interval_usec == 0)
+                return 0;
+
+        s->notify_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+        if (s->notify_fd < 0) {
+                log_error("Failed to create notification timer: %m");
+                return -errno;
+        }
+
+        if (epollfd_add(s->server.epoll, s->notify_fd, EPOLLIN, dispatch_notify, s) < 0) {
+                log_error("Failed to add notification timer to event loop: %m");
+                return -errno;
+        }
+
+        return 0;
 }
 
 static void do_vacuum(Server *s, JournalFile *f, const char* path,
@@ -380,6 +486,7 @@ static void write_to_journal(Server *s, uid_t realuid, struct iovec *iovec, unsi
 
         r = journal_file_append_entry(f, NULL, iovec, n, &s->seqnum, NULL, NULL);
         if (r >= 0) {
+                server_schedule_notify(s, f);
                 server_schedule_sync(s, priority);
                 return;
         }
@@ -410,8 +517,10 @@ static void write_to_journal(Server *s, uid_t realuid, struct iovec *iovec, unsi
                         size += iovec[i].iov_len;
 
                 log_error("Failed to write entry (%d items, %zu bytes) despite vacuuming, ignoring: %s", n, size, strerror(-r));
-        } else
+        } else {
+                server_schedule_notify(s, f);
                 server_schedule_sync(s, priority);
+        }
 }
 
 int dispatch_message_real(
@@ -543,10 +652,10 @@ static int system_journal_open(Server *s) {
             access(JOURNAL_RUNDIR "/flushed", F_OK) >= 0) {
 
                 fn = JOURNAL_LOGDIR "/system.journal";
-                r = journal_file_open_reliably(fn, O_RDWR|O_CREAT, 0640, s->compress, &s->system_metrics, s->mmap, NULL, &s->system_journal);
+                r = journal_file_open_reliably(fn, O_RDWR|O_CREAT, 0640, s->compress, s->index_messages, &s->system_metrics, s->mmap, NULL, &s->system_journal);
 
                 if (r >= 0)
-                        server_fix_perms(s, s->system_journal);
+                        server_setup_journal(s, s->system_journal);
                 else if (r < 0) {
                         if (r != -ENOENT && r != -EROFS)
                                 log_warning("Failed to open system journal: %s", strerror(-r));
@@ -567,7 +676,7 @@ static int system_journal_open(Server *s) {
                          * if it already exists, so that we can flush
                          * it into the system journal */
 
-                        r = journal_file_open(fn, O_RDWR, 0640, s->compress, &s->runtime_metrics, s->mmap, NULL, &s->runtime_journal);
+                        r = journal_file_open(fn, O_RDWR, 0640, s->compress, s->index_messages, &s->runtime_metrics, s->mmap, NULL, &s->runtime_journal);
                         free(fn);
 
                         if (r < 0) {
@@ -584,7 +693,7 @@ static int system_journal_open(Server *s) {
 
                         (void) mkdir(JOURNAL_RUNDIR "/log", 0755);
 
-                        r = journal_file_open_reliably(fn, O_RDWR|O_CREAT, 0640, s->compress, &s->runtime_metrics, s->mmap, NULL, &s->runtime_journal);
+                        r = journal_file_open_reliably(fn, O_RDWR|O_CREAT, 0640, s->compress, s->index_messages, &s->runtime_metrics, s->mmap, NULL, &s->runtime_journal);
                         free(fn);
 
                         if (r < 0) {
@@ -594,7 +703,7 @@ static int system_journal_open(Server *s) {
                 }
 
                 if (s->runtime_journal)
-                        server_fix_perms(s, s->runtime_journal);
+                        server_setup_journal(s, s->runtime_journal);
         }
 
         available_space(s, true);
@@ -675,6 +784,7 @@ int server_flush_to_var(Server *s) {
 finish:
         journal_file_post_change(s->system_journal);
 
+        server_count_notify(s, s->runtime_journal);
         journal_file_close(s->runtime_journal);
         s->runtime_journal = NULL;
 
@@ -906,6 +1016,9 @@ int server_init(Server *s) {
         s->sync_interval_usec = DEFAULT_SYNC_INTERVAL_USEC;
         s->sync_time = -1;
 
+        s->notify_interval_usec = DEFAULT_NOTIFY_INTERVAL_USEC;
+        s->notify_fd = -1;
+
         s->forward_to_syslog = false;
 
         s->max_file_usec = DEFAULT_MAX_FILE_USEC;
@@ -955,6 +1068,10 @@ int server_init(Server *s) {
         if (r < 0)
                 return r;
 
+        r = server_open_notify_timer(s);
+        if (r < 0)
+                return r;
+
         s->rate_limit = journal_rate_limit_new(s->rate_limit_interval, s->rate_limit_burst);
         if (!s->rate_limit)
                 return -ENOMEM;
@@ -970,19 +1087,29 @@ void server_done(Server *s) {
         JournalFile *f;
         assert(s);
 
+        server_count_notify(s, s->system_journal);
         if (s->system_journal)
                 journal_file_close(s->system_journal);
 
+        server_count_notify(s, s->runtime_journal);
         if (s->runtime_journal)
                 journal_file_close(s->runtime_journal);
 
-        while ((f = hashmap_steal_first(s->user_journals)))
+        while ((f = hashmap_steal_first(s->user_journals))) {
+                server_count_notify(s, f);
                 journal_file_close(f);
+        }
 
         hashmap_free(s->user_journals);
 
+        if (s->n_notify_suppressed > 0)
+                log_info("Suppressed %"PRIu64" change notifications, as nobody followed or they came too often.",
+                         s->n_notify_suppressed);
+
         server_stop(&s->server);
 
+        safe_close(s->notify_fd);
+
         if (s->rate_limit)
                 journal_rate_limit_free(s->rate_limit);
 
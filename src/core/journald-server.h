@@ -63,6 +63,7 @@ typedef struct Server {
         JournalMetrics system_metrics;
 
         bool compress;
+        bool index_messages;
 
         bool forward_to_syslog;
         bool forward_to_console;
@@ -89,6 +90,15 @@ typedef struct Server {
 
         uint64_t sync_seqnum;
         usec_t sync_time;
+
+        /* Readers are told about new entries at most once per
+         * interval, by a timer for the last ones, and optionally only
+         * while they hold the follow lock */
+        usec_t notify_interval_usec;
+        bool notify_followers_only;
+        int notify_fd;
+        bool notify_armed;
+        uint64_t n_notify_suppressed;
 } Server;
 
 #define N_IOVEC_META_FIELDS 20
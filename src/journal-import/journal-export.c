@@ -0,0 +1,565 @@
+/*
+ * Copyright © 2018 - Vitaliy Perevertun
+ *
+ * This file is part of journal
+ *
+ * This file is licensed under the MIT license.
+ * See the file LICENSE.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "journal-export.h"
+#include "log.h"
+#include "macro.h"
+#include "util.h"
+
+#define READ_SIZE (256U*1024U)
+
+struct JournalExportReader {
+        int fd;
+
+        /* Read but not yet parsed are the bytes from start to end */
+        uint8_t *buffer;
+        size_t allocated, start, end;
+
+        struct iovec *iovec;
+        size_t iovec_allocated;
+};
+
+int journal_export_reader_new(int fd, JournalExportReader **ret) {
+        JournalExportReader *r;
+
+        assert(fd >= 0);
+        assert(ret);
+
+        r = new0(JournalExportReader, 1);
+        if (!r)
+                return -ENOMEM;
+
+        r->fd = fd;
+
+        *ret = r;
+        return 0;
+}
+
+void journal_export_reader_free(JournalExportReader *r) {
+        if (!r)
+                return;
+
+        free(r->iovec);
+        free(r->buffer);
+        free(r);
+}
+
+int journal_export_reader_push(JournalExportReader *r, const void *data, size_t size) {
+        assert(r);
+        assert(data || size == 0);
+
+        if (!GREEDY_REALLOC(r->buffer, r->allocated, r->end + size))
+                return -ENOMEM;
+
+        memcpy(r->buffer + r->end, data, size);
+        r->end += size;
+
+        return 0;
+}
+
+/* Makes sure that at least n bytes from start on are buffered. Returns
+ * 0 if the stream ends before. */
+static int reader_fill(JournalExportReader *r, size_t n) {
+
+        if (r->end - r->start >= n)
+                return 1;
+
+        if (n > JOURNAL_EXPORT_ENTRY_SIZE_MAX) {
+                log_error("Entry in export stream too large.");
+                return -EBADMSG;
+        }
+
+        if (r->start > 0) {
+                memmove(r->buffer, r->buffer + r->start, r->end - r->start);
+                r->end -= r->start;
+                r->start = 0;
+        }
+
+        while (r->end < n) {
+                ssize_t k;
+
+                if (!GREEDY_REALLOC(r->buffer, r->allocated, MAX(n, r->end + READ_SIZE)))
+                        return -ENOMEM;
+
+                k = read(r->fd, r->buffer + r->end, r->allocated - r->end);
+                if (k < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        return -errno;
+                }
+
+                if (k == 0)
+                        return 0;
+
+                r->end += k;
+        }
+
+        return 1;
+}
+
+static int parse_number(const uint8_t *p, size_t l, bool hex, uint64_t *ret) {
+        uint64_t v = 0;
+        size_t i;
+
+        if (l == 0 || l > 16 + !hex * 4)
+                return -EINVAL;
+
+        for (i = 0; i < l; i++) {
+                int d;
+
+                if (hex)
+                        d = unhexchar(p[i]);
+                else
+                        d = p[i] >= '0' && p[i] <= '9' ? p[i] - '0' : -1;
+                if (d < 0)
+                        return -EINVAL;
+
+                if (!hex && v > (UINT64_MAX - d) / 10)
+                        return -ERANGE;
+
+                v = v * (hex ? 16 : 10) + d;
+        }
+
+        *ret = v;
+        return 0;
+}
+
+/* Takes the sequence number from the i= item of a cursor */
+static int parse_cursor(const uint8_t *p, size_t l, uint64_t *seqnum) {
+        const uint8_t *end = p + l;
+
+        while (p < end) {
+                const uint8_t *item;
+
+                item = p;
+                p = memchr(item, ';', end - item);
+                if (!p)
+                        p = end;
+
+                if (p - item > 2 && item[0] == 'i' && item[1] == '=')
+                        return parse_number(item + 2, p - item - 2, true, seqnum);
+
+                p++;
+        }
+
+        return -EINVAL;
+}
+
+/* Handles a field starting with two underscores */
+static int parse_meta(const uint8_t *p, size_t l, JournalBinaryEntry *e, bool *realtime) {
+        const uint8_t *eq;
+        size_t n;
+        int k;
+
+        eq = memchr(p, '=', l);
+        if (!eq)
+                return 0;
+
+        n = eq - p;
+        eq++;
+        l -= n + 1;
+
+        if (n == 20 && memcmp(p, "__REALTIME_TIMESTAMP", n) == 0) {
+                k = parse_number(eq, l, false, &e->ts.realtime);
+                if (k < 0) {
+                        log_error("Invalid realtime timestamp in export stream.");
+                        return -EBADMSG;
+                }
+
+                *realtime = true;
+        } else if (n == 21 && memcmp(p, "__MONOTONIC_TIMESTAMP", n) == 0) {
+                k = parse_number(eq, l, false, &e->ts.monotonic);
+                if (k < 0) {
+                        log_error("Invalid monotonic timestamp in export stream.");
+                        return -EBADMSG;
+                }
+        } else if (n == 8 && memcmp(p, "__CURSOR", n) == 0) {
+                /* A cursor of another kind is no reason to give up */
+                if (parse_cursor(eq, l, &e->seqnum) < 0)
+                        e->seqnum = 0;
+        }
+
+        return 0;
+}
+
+static int add_field(JournalExportReader *r, unsigned n, size_t offset, size_t l) {
+
+        if (!GREEDY_REALLOC(r->iovec, r->iovec_allocated, n + 1))
+                return -ENOMEM;
+
+        /* The buffer may still move, hence keep the offset from the
+         * start of the entry for now */
+        r->iovec[n].iov_base = (void*) (uintptr_t) offset;
+        r->iovec[n].iov_len = l;
+
+        return 0;
+}
+
+int journal_export_read_entry(JournalExportReader *r, JournalBinaryEntry *e) {
+        size_t pos = 0, scanned = 0;
+        bool started = false, realtime = false;
+        unsigned n = 0, i;
+        int k;
+
+        assert(r);
+        assert(e);
+
+        zero(*e);
+
+        /* Parses lines from start + pos on, leaving the buffer alone
+         * until the entry is complete */
+        for (;;) {
+                uint8_t *p, *nl = NULL;
+                le64_t le_size;
+                uint64_t size;
+                size_t l;
+
+                while (r->end - r->start > scanned) {
+                        nl = memchr(r->buffer + r->start + scanned, '\n', r->end - r->start - scanned);
+                        if (nl)
+                                break;
+
+                        scanned = r->end - r->start;
+                }
+
+                if (!nl) {
+                        k = reader_fill(r, r->end - r->start + 1);
+                        if (k < 0)
+                                return k;
+                        if (k > 0)
+                                continue;
+
+                        if (r->end - r->start > pos) {
+                                log_error("Export stream ends in the middle of a line.");
+                                return -EBADMSG;
+                        }
+
+                        if (!started)
+                                return 0;
+
+                        /* The last entry may lack the empty line */
+                        break;
+                }
+
+                p = r->buffer + r->start + pos;
+                l = nl - p;
+
+                if (l == 0) {
+                        pos++;
+                        scanned = pos;
+
+                        if (started)
+                                break;
+
+                        /* Empty lines before an entry */
+                        r->start += pos;
+                        pos = scanned = 0;
+                        continue;
+                }
+
+                started = true;
+
+                if (memchr(p, '=', l)) {
+                        if (p[0] == '=') {
+                                log_error("Field without name in export stream.");
+                                return -EBADMSG;
+                        }
+
+                        if (l >= 2 && p[0] == '_' && p[1] == '_') {
+                                k = parse_meta(p, l, e, &realtime);
+                                if (k < 0)
+                                        return k;
+                        } else {
+                                if (l == 9 + 32 && memcmp(p, "_BOOT_ID=", 9) == 0) {
+                                        char s[33];
+
+                                        memcpy(s, p + 9, 32);
+                                        s[32] = 0;
+                                        uuid_parse(s, &e->boot_id);
+                                }
+
+                                k = add_field(r, n++, pos, l);
+                                if (k < 0)
+                                        return k;
+                        }
+
+                        pos += l + 1;
+                        scanned = pos;
+                        continue;
+                }
+
+                /* The name of a binary field, followed by the size,
+                 * the data and a line break */
+                k = reader_fill(r, pos + l + 1 + sizeof(le_size));
+                if (k < 0)
+                        return k;
+                if (k == 0) {
+                        log_error("Export stream ends in the middle of a field.");
+                        return -EBADMSG;
+                }
+
+                memcpy(&le_size, r->buffer + r->start + pos + l + 1, sizeof(le_size));
+                size = le64toh(le_size);
+                if (size > JOURNAL_EXPORT_ENTRY_SIZE_MAX) {
+                        log_error("Field in export stream too large.");
+                        return -EBADMSG;
+                }
+
+                k = reader_fill(r, pos + l + 1 + sizeof(le_size) + size + 1);
+                if (k < 0)
+                        return k;
+                if (k == 0) {
+                        log_error("Export stream ends in the middle of a field.");
+                        return -EBADMSG;
+                }
+
+                p = r->buffer + r->start + pos;
+                if (p[l + 1 + sizeof(le_size) + size] != '\n') {
+                        log_error("Invalid binary field in export stream.");
+                        return -EBADMSG;
+                }
+
+                if (!(l >= 2 && p[0] == '_' && p[1] == '_')) {
+                        /* Moves the name next to the data, which
+                         * makes FIELD=VALUE of it */
+                        memmove(p + sizeof(le_size), p, l);
+                        p[sizeof(le_size) + l] = '=';
+
+                        k = add_field(r, n++, pos + sizeof(le_size), l + 1 + size);
+                        if (k < 0)
+                                return k;
+                }
+
+                pos += l + 1 + sizeof(le_size) + size + 1;
+                scanned = pos;
+        }
+
+        if (!realtime) {
+                log_error("Entry without realtime timestamp in export stream.");
+                return -EBADMSG;
+        }
+
+        for (i = 0; i < n; i++)
+                r->iovec[i].iov_base = r->buffer + r->start + (uintptr_t) r->iovec[i].iov_base;
+
+        e->iovec = r->iovec;
+        e->n_iovec = n;
+
+        /* The fields point into the buffer, which is moved no earlier
+         * than by the next call */
+        r->start += pos;
+
+        return 1;
+}
+
+#ifdef TESTS
+#include <fcntl.h>
+#include <stdio.h>
+
+#include "hash/hash.h"
+#include "journal-internal.h"
+#include "logs-show.h"
+
+static void append(JournalFile *f, unsigned i) {
+        static char big[5000];
+        char message[64], key[32], boot[9 + 33] = "_BOOT_ID=";
+        const char bin[] = "BIN=a\001\000\377\n";
+        struct iovec iovec[6];
+        dual_timestamp ts;
+        unsigned n = 0;
+
+        dual_timestamp_get(&ts);
+
+        snprintf(message, sizeof(message), "MESSAGE=message %u\nline", i);
+        snprintf(key, sizeof(key), "KEY=%u", i / 2);
+
+        /* The export format takes the boot ID from the entry */
+        journal_uuid_to_str(f->header->boot_id, boot + 9);
+
+        IOVEC_SET_STRING(iovec[n++], message);
+        IOVEC_SET_STRING(iovec[n++], key);
+        IOVEC_SET_STRING(iovec[n++], boot);
+
+        if (i % 100 == 0) {
+                memcpy(big, "BIG=", 4);
+                memset(big + 4, 'a' + i % 26, sizeof(big) - 4);
+                iovec[n].iov_base = big;
+                iovec[n++].iov_len = sizeof(big);
+        }
+
+        if (i % 7 == 0) {
+                iovec[n].iov_base = (char*) bin;
+                iovec[n++].iov_len = sizeof(bin) - 1;
+        }
+
+        assert_se(journal_file_append_entry(f, &ts, iovec, n, NULL, NULL, NULL) == 0);
+}
+
+static void entry_info(sd_journal *j, uint64_t info[6]) {
+        const void *data;
+        size_t length;
+        uuid_t boot_id;
+        Object *o;
+
+        assert_se(journal_file_move_to_object(j->current_file, OBJECT_ENTRY, j->current_file->current_offset, &o) >= 0);
+        info[0] = le64toh(o->entry.seqnum);
+
+        assert_se(sd_journal_get_realtime_usec(j, &info[1]) >= 0);
+        assert_se(sd_journal_get_monotonic_usec(j, &info[2], &boot_id) >= 0);
+        info[3] = boot_id.qwords[0] ^ boot_id.qwords[1];
+
+        /* The fields may be stored in a different order */
+        info[4] = info[5] = 0;
+        SD_JOURNAL_FOREACH_DATA(j, data, length) {
+                uint64_t h;
+
+                hash64(data, length, &h);
+                info[4] += h;
+                info[5]++;
+        }
+}
+
+static int read_string(const char *s, size_t l, JournalBinaryEntry *e, JournalExportReader **reader) {
+        static int fd = -1;
+
+        journal_export_reader_free(*reader);
+        *reader = NULL;
+        safe_close(fd);
+
+        fd = open("string", O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC, 0666);
+        assert_se(fd >= 0);
+        assert_se(write(fd, s, l) == (ssize_t) l);
+        assert_se(lseek(fd, 0, SEEK_SET) == 0);
+
+        assert_se(journal_export_reader_new(fd, reader) >= 0);
+
+        return journal_export_read_entry(*reader, e);
+}
+
+#define READ_STRING(s, e, reader) read_string(s, sizeof(s) - 1, e, reader)
+
+int main(int argc, char *argv[]) {
+        char t[] = "/tmp/journal-export-XXXXXX";
+        const char *a[] = { "a.journal", NULL }, *b[] = { "b.journal", NULL };
+        JournalExportReader *reader = NULL;
+        JournalBinaryEntry e;
+        JournalFile *f;
+        sd_journal *ja, *jb;
+        FILE *out;
+        uuid_t boot_id = {};
+        uint64_t n = 0, n_imported = 0;
+        unsigned i;
+        char c;
+        int fd, k;
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open("a.journal", O_RDWR|O_CREAT, 0666, true, false, NULL, NULL, NULL, &f) == 0);
+
+        for (i = 0; i < 2000; i++)
+                append(f, i);
+
+        /* Entries of another boot, with smaller monotonic timestamps */
+        boot_id.bytes[0] = 1;
+        journal_file_set_boot_id(f, boot_id);
+        for (i = 0; i < 10; i++)
+                append(f, i);
+
+        journal_file_close(f);
+
+        assert_se(sd_journal_open_files(&ja, a, 0) >= 0);
+
+        out = fopen("stream", "we");
+        assert_se(out);
+        output_buffer_stream(out);
+
+        SD_JOURNAL_FOREACH(ja) {
+                assert_se(output_journal(out, ja, OUTPUT_EXPORT, 0, 0, NULL) >= 0);
+                n++;
+        }
+
+        assert_se(output_flush(out) >= 0);
+        fclose(out);
+        output_free_scratch();
+
+        assert_se(journal_file_open("b.journal", O_RDWR|O_CREAT, 0666, true, false, NULL, NULL, NULL, &f) == 0);
+
+        fd = open("stream", O_RDONLY|O_CLOEXEC);
+        assert_se(fd >= 0);
+
+        /* Part of the stream was read already */
+        assert_se(read(fd, &c, 1) == 1);
+        assert_se(journal_export_reader_new(fd, &reader) >= 0);
+        assert_se(journal_export_reader_push(reader, &c, 1) >= 0);
+
+        while ((k = journal_export_read_entry(reader, &e)) > 0) {
+                assert_se(journal_binary_append_entry(f, &e) >= 0);
+                n_imported++;
+        }
+        assert_se(k == 0);
+
+        journal_export_reader_free(reader);
+        reader = NULL;
+        safe_close(fd);
+
+        journal_file_close(f);
+
+        log_info("%"PRIu64" entries imported", n_imported);
+        assert_se(n_imported == n);
+
+        assert_se(sd_journal_open_files(&jb, b, 0) >= 0);
+
+        sd_journal_seek_head(ja);
+        sd_journal_seek_head(jb);
+        for (i = 0; i < n; i++) {
+                uint64_t x[6], y[6];
+
+                assert_se(sd_journal_next(ja) > 0);
+                assert_se(sd_journal_next(jb) > 0);
+
+                entry_info(ja, x);
+                entry_info(jb, y);
+                assert_se(memcmp(x, y, sizeof(x)) == 0);
+        }
+        assert_se(sd_journal_next(jb) == 0);
+
+        sd_journal_close(ja);
+        sd_journal_close(jb);
+
+        /* Streams written by hand */
+        assert_se(READ_STRING("\n\n__REALTIME_TIMESTAMP=5\nA=b\n__OTHER=1\n__CURSOR=s=0;i=1f\n", &e, &reader) == 1);
+        assert_se(e.ts.realtime == 5);
+        assert_se(e.seqnum == 0x1f);
+        assert_se(e.n_iovec == 1);
+        assert_se(e.iovec[0].iov_len == 3 && memcmp(e.iovec[0].iov_base, "A=b", 3) == 0);
+        assert_se(journal_export_read_entry(reader, &e) == 0);
+
+        assert_se(READ_STRING("", &e, &reader) == 0);
+        assert_se(READ_STRING("A=b\n\n", &e, &reader) == -EBADMSG);
+        assert_se(READ_STRING("__REALTIME_TIMESTAMP=x\n\n", &e, &reader) == -EBADMSG);
+        assert_se(READ_STRING("__REALTIME_TIMESTAMP=5\nA=b", &e, &reader) == -EBADMSG);
+        assert_se(READ_STRING("__REALTIME_TIMESTAMP=5\nA\n\002\000\000\000\000\000\000", &e, &reader) == -EBADMSG);
+        assert_se(READ_STRING("__REALTIME_TIMESTAMP=5\nA\n\001\000\000\000\000\000\000\000xy\n", &e, &reader) == -EBADMSG);
+
+        journal_export_reader_free(reader);
+
+        assert_se(rm_rf_dangerous(t, false, true, false) >= 0);
+
+        return 0;
+}
+#endif // TESTS
@@ -0,0 +1,45 @@
+/*
+ * Copyright © 2018 - Vitaliy Perevertun
+ *
+ * This file is part of journal
+ *
+ * This file is licensed under the MIT license.
+ * See the file LICENSE.
+ */
+
+#pragma once
+
+#include "journal-binary.h"
+
+/* Reader of the export format, as written by journalctl -o export.
+ * Entries are separated by empty lines. A field is either a line
+ *
+ *     FIELD=VALUE
+ *
+ * or, if the value is not printable text, the field name on its own line
+ * followed by the size of the value as little endian 64 bit number, the
+ * value and a line break.
+ *
+ * Of the fields starting with two underscores, __REALTIME_TIMESTAMP and
+ * __MONOTONIC_TIMESTAMP give the timestamps and the i= item of __CURSOR
+ * the sequence number of an entry. The others are left out. The boot ID
+ * is taken from the _BOOT_ID field, which is kept. */
+
+/* Larger entries are refused */
+#define JOURNAL_EXPORT_ENTRY_SIZE_MAX (768U*1024U*1024U)
+
+typedef struct JournalExportReader JournalExportReader;
+
+int journal_export_reader_new(int fd, JournalExportReader **ret);
+void journal_export_reader_free(JournalExportReader *r);
+
+/* Passes bytes already read from the file descriptor, which are parsed
+ * before anything read later */
+int journal_export_reader_push(JournalExportReader *r, const void *data, size_t size);
+
+/* Returns 1 and the next entry, or 0 at the end of the stream. The
+ * fields stay valid until the next entry is read. */
+int journal_export_read_entry(JournalExportReader *r, JournalBinaryEntry *e);
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(JournalExportReader*, journal_export_reader_free);
+#define _cleanup_journal_export_reader_free_ _cleanup_(journal_export_reader_freep)
@@ -0,0 +1,440 @@
+/*
+ * Copyright © 2018 - Vitaliy Perevertun
+ *
+ * This file is part of journal
+ *
+ * This file is licensed under the MIT license.
+ * See the file LICENSE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "journal-binary.h"
+#include "journal-export.h"
+#include "journal-def.h"
+#include "log.h"
+#include "macro.h"
+#include "util.h"
+
+/* The largest file size journald picks by default. It also sizes the
+ * hash tables, which keeps imports fast. */
+#define DEFAULT_SPLIT_SIZE (128ULL*1024ULL*1024ULL)
+
+/* Entries appended before readers are told about them */
+#define IMPORT_BATCH 4096U
+
+typedef enum ImportFormat {
+        IMPORT_AUTO,
+        IMPORT_EXPORT,
+        IMPORT_BINARY,
+} ImportFormat;
+
+static const char *arg_output = NULL;
+static ImportFormat arg_format = IMPORT_AUTO;
+static uint64_t arg_split_size = DEFAULT_SPLIT_SIZE;
+static usec_t arg_split_time = 0;
+static bool arg_compress = true;
+static bool arg_index_messages = false;
+
+typedef struct Importer {
+        JournalFile *file;
+        JournalMetrics metrics;
+        bool limit_size;
+
+        uint64_t n_entries;
+        unsigned n_files;
+        unsigned n_pending;
+} Importer;
+
+static void help(void) {
+
+        printf("%s [OPTIONS...] [FILE...]\n\n"
+               "Write entries read from export or binary streams into journal files.\n\n"
+               "  -h --help                Show this help text\n"
+               "     --version             Show package version\n"
+               "  -o --output=PATH         Write to the specified journal file\n"
+               "     --format=FORMAT       Read streams of the format (export, binary, auto)\n"
+               "     --split-size=BYTES    Continue in a new file when the file reaches the size\n"
+               "                           (default 128M, 0 for no limit)\n"
+               "     --split-time=TIME     Continue in a new file when the entries span the time\n"
+               "     --compress=BOOL       Compress large fields\n"
+               "     --index-messages      Index the words of messages\n"
+               , program_invocation_short_name);
+}
+
+static int parse_argv(int argc, char *argv[]) {
+
+        enum {
+                ARG_VERSION = 0x100,
+                ARG_FORMAT,
+                ARG_SPLIT_SIZE,
+                ARG_SPLIT_TIME,
+                ARG_COMPRESS,
+                ARG_INDEX_MESSAGES
+        };
+
+        static const struct option options[] = {
+                { "help",           no_argument,       NULL, 'h'                },
+                { "version" ,       no_argument,       NULL, ARG_VERSION        },
+                { "output",         required_argument, NULL, 'o'                },
+                { "format",         required_argument, NULL, ARG_FORMAT         },
+                { "split-size",     required_argument, NULL, ARG_SPLIT_SIZE     },
+                { "split-time",     required_argument, NULL, ARG_SPLIT_TIME     },
+                { "compress",       required_argument, NULL, ARG_COMPRESS       },
+                { "index-messages", no_argument,       NULL, ARG_INDEX_MESSAGES },
+                {}
+        };
+
+        int c, r;
+
+        assert(argc >= 0);
+        assert(argv);
+
+        while ((c = getopt_long(argc, argv, "ho:", options, NULL)) >= 0) {
+
+                switch (c) {
+
+                case 'h':
+                        help();
+                        return 0;
+
+                case ARG_VERSION:
+                        printf("journal-import: %s\n", VERSION);
+                        return 0;
+
+                case 'o':
+                        arg_output = optarg;
+                        break;
+
+                case ARG_FORMAT:
+                        if (streq(optarg, "export"))
+                                arg_format = IMPORT_EXPORT;
+                        else if (streq(optarg, "binary"))
+                                arg_format = IMPORT_BINARY;
+                        else if (streq(optarg, "auto"))
+                                arg_format = IMPORT_AUTO;
+                        else {
+                                log_error("Unknown format '%s'.", optarg);
+                                return -EINVAL;
+                        }
+                        break;
+
+                case ARG_SPLIT_SIZE: {
+                        off_t size;
+
+                        r = parse_size(optarg, 1024, &size);
+                        if (r < 0) {
+                                log_error("Failed to parse size '%s'.", optarg);
+                                return -EINVAL;
+                        }
+
+                        arg_split_size = size;
+                        break;
+                }
+
+                case ARG_SPLIT_TIME:
+                        r = parse_sec(optarg, &arg_split_time);
+                        if (r < 0) {
+                                log_error("Failed to parse time '%s'.", optarg);
+                                return -EINVAL;
+                        }
+                        break;
+
+                case ARG_COMPRESS:
+                        r = parse_boolean(optarg);
+                        if (r < 0) {
+                                log_error("Failed to parse boolean '%s'.", optarg);
+                                return -EINVAL;
+                        }
+
+                        arg_compress = r;
+                        break;
+
+                case ARG_INDEX_MESSAGES:
+                        arg_index_messages = true;
+                        break;
+
+                case '?':
+                        return -EINVAL;
+
+                default:
+                        assert_not_reached("Unhandled option");
+                }
+        }
+
+        if (!arg_output) {
+                log_error("No output file specified, use --output=.");
+                return -EINVAL;
+        }
+
+        if (!endswith(arg_output, ".journal")) {
+                log_error("Output file name must end in .journal.");
+                return -EINVAL;
+        }
+
+        return 1;
+}
+
+static int importer_open(Importer *i) {
+        JournalMetrics metrics = i->metrics;
+        JournalFile *f;
+        int r;
+
+        /* The sequence numbers continue from the previous file. Without
+         * metrics, files grow without limit. */
+        r = journal_file_open(arg_output, O_RDWR|O_CREAT|O_EXCL, 0640,
+                              arg_compress, arg_index_messages,
+                              i->limit_size ? &metrics : NULL, NULL, i->file, &f);
+        if (r < 0) {
+                log_error("Failed to create %s: %s", arg_output, strerror(-r));
+                return r;
+        }
+
+        f->defer_post_change = true;
+
+        if (i->file)
+                journal_file_close(i->file);
+
+        i->file = f;
+        i->n_files++;
+
+        return 0;
+}
+
+static void importer_post_change(Importer *i) {
+        if (i->n_pending == 0)
+                return;
+
+        journal_file_post_change(i->file);
+        i->n_pending = 0;
+}
+
+/* Moves the file out of the way, named after its first entry. Unlike
+ * journal_file_rotate(), which names archives after the second of the
+ * first entry, this never replaces files written before. */
+static int importer_split(Importer *i) {
+        _cleanup_free_ char *p = NULL;
+        JournalFile *f = i->file;
+        int r;
+
+        importer_post_change(i);
+
+        r = asprintf(&p, "%.*s-%016"PRIx64"-%016"PRIx64".journal",
+                     (int) strlen(arg_output) - 8, arg_output,
+                     le64toh(f->header->head_entry_seqnum),
+                     le64toh(f->header->head_entry_realtime));
+        if (r < 0)
+                return log_oom();
+
+        if (link(f->path, p) < 0 || unlink(f->path) < 0) {
+                r = -errno;
+                log_error("Failed to rename %s to %s: %s", f->path, p, strerror(-r));
+                return r;
+        }
+
+        f->header->state = STATE_ARCHIVED;
+
+        return importer_open(i);
+}
+
+static bool importer_file_full(int r) {
+
+        /* -E2BIG   Hit the split size
+           -EFBIG   Hit the file system limit */
+
+        return r == -E2BIG || r == -EFBIG;
+}
+
+static int importer_append(Importer *i, const JournalBinaryEntry *e) {
+        JournalFile *f = i->file;
+        int r;
+
+        if (arg_split_time > 0 && f->header->n_entries > 0 &&
+            e->ts.realtime >= le64toh(f->header->head_entry_realtime) + arg_split_time) {
+                r = importer_split(i);
+                if (r < 0)
+                        return r;
+        }
+
+        r = journal_binary_append_entry(i->file, e);
+        if (importer_file_full(r) && i->file->header->n_entries > 0) {
+                log_debug("%s: Split size reached, continuing in a new file.", i->file->path);
+
+                r = importer_split(i);
+                if (r < 0)
+                        return r;
+
+                r = journal_binary_append_entry(i->file, e);
+        }
+        if (r < 0) {
+                log_error("Failed to write entry to %s: %s", i->file->path, strerror(-r));
+                return r;
+        }
+
+        i->n_entries++;
+
+        if (++i->n_pending >= IMPORT_BATCH)
+                importer_post_change(i);
+
+        return 0;
+}
+
+/* Reads the magic of binary streams, or as much of the beginning of the
+ * stream as there is */
+static ssize_t read_head(int fd, char *buf, size_t size) {
+        size_t n = 0;
+
+        while (n < size) {
+                ssize_t k;
+
+                k = read(fd, buf + n, size - n);
+                if (k < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        return -errno;
+                }
+
+                if (k == 0)
+                        break;
+
+                n += k;
+        }
+
+        return n;
+}
+
+static int import_fd(Importer *i, int fd, const char *name) {
+        _cleanup_journal_binary_reader_free_ JournalBinaryReader *binary = NULL;
+        _cleanup_journal_export_reader_free_ JournalExportReader *export = NULL;
+        char head[sizeof(JOURNAL_BINARY_MAGIC) - 1];
+        ImportFormat format = arg_format;
+        JournalBinaryEntry e;
+        ssize_t n;
+        int r;
+
+        n = read_head(fd, head, sizeof(head));
+        if (n < 0) {
+                log_error("Failed to read %s: %s", name, strerror(-n));
+                return n;
+        }
+
+        if (format == IMPORT_AUTO)
+                format = n == sizeof(head) && memcmp(head, JOURNAL_BINARY_MAGIC, n) == 0 ?
+                        IMPORT_BINARY : IMPORT_EXPORT;
+
+        if (format == IMPORT_BINARY) {
+                r = journal_binary_reader_new(fd, &binary);
+                if (r >= 0)
+                        r = journal_binary_reader_push(binary, head, n);
+        } else {
+                r = journal_export_reader_new(fd, &export);
+                if (r >= 0)
+                        r = journal_export_reader_push(export, head, n);
+        }
+        if (r < 0)
+                return log_oom();
+
+        for (;;) {
+                if (binary)
+                        r = journal_binary_read_entry(binary, &e);
+                else
+                        r = journal_export_read_entry(export, &e);
+                if (r < 0) {
+                        log_error("Failed to read entry from %s: %s", name, strerror(-r));
+                        return r;
+                }
+                if (r == 0)
+                        break;
+
+                r = importer_append(i, &e);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+int main(int argc, char *argv[]) {
+        Importer importer = {};
+        char ts[FORMAT_TIMESPAN_MAX];
+        usec_t start, elapsed;
+        int r, k;
+
+        setlocale(LC_ALL, "");
+        log_parse_environment();
+        log_open();
+
+        r = parse_argv(argc, argv);
+        if (r <= 0)
+                goto finish;
+
+        if (arg_split_size > 0) {
+                journal_reset_metrics(&importer.metrics);
+                importer.metrics.max_size = arg_split_size;
+                importer.metrics.keep_free = 0;
+                importer.limit_size = true;
+        }
+
+        start = now(CLOCK_MONOTONIC);
+
+        r = importer_open(&importer);
+        if (r < 0)
+                goto finish;
+
+        if (optind >= argc)
+                r = import_fd(&importer, STDIN_FILENO, "standard input");
+        else {
+                int i;
+
+                for (i = optind; i < argc; i++) {
+                        _cleanup_close_ int fd = -1;
+
+                        if (streq(argv[i], "-")) {
+                                r = import_fd(&importer, STDIN_FILENO, "standard input");
+                                if (r < 0)
+                                        break;
+
+                                continue;
+                        }
+
+                        fd = open(argv[i], O_RDONLY|O_CLOEXEC);
+                        if (fd < 0) {
+                                log_error("Failed to open %s: %m", argv[i]);
+                                r = -errno;
+                                break;
+                        }
+
+                        r = import_fd(&importer, fd, argv[i]);
+                        if (r < 0)
+                                break;
+                }
+        }
+
+        importer_post_change(&importer);
+
+        k = journal_file_set_offline(importer.file);
+        if (k < 0 && r >= 0) {
+                log_error("Failed to write %s: %s", importer.file->path, strerror(-k));
+                r = k;
+        }
+
+        journal_file_close(importer.file);
+
+        elapsed = MAX(now(CLOCK_MONOTONIC) - start, (usec_t) 1);
+
+        log_info("Imported %"PRIu64" entries into %u files in %s, %"PRIu64" entries/s.",
+                 importer.n_entries, importer.n_files,
+                 format_timespan(ts, sizeof(ts), elapsed, USEC_PER_MSEC),
+                 (uint64_t) (importer.n_entries * USEC_PER_SEC / elapsed));
+
+finish:
+        return r < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,493 @@
+/*
+ * Copyright © 2018 - Vitaliy Perevertun
+ *
+ * This file is part of journal
+ *
+ * This file is licensed under the MIT license.
+ * See the file LICENSE.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "journal-binary.h"
+#include "log.h"
+#include "macro.h"
+#include "util.h"
+
+#define READ_SIZE (256U*1024U)
+
+struct JournalBinaryReader {
+        int fd;
+        bool magic;
+
+        /* Read but not yet parsed are the bytes from start to end */
+        uint8_t *buffer;
+        size_t allocated, start, end;
+
+        struct iovec *kept;
+        size_t kept_allocated;
+        unsigned n_kept;
+        size_t kept_size;
+
+        struct iovec *iovec;
+        size_t iovec_allocated;
+};
+
+int journal_binary_reader_new(int fd, JournalBinaryReader **ret) {
+        JournalBinaryReader *r;
+
+        assert(fd >= 0);
+        assert(ret);
+
+        r = new0(JournalBinaryReader, 1);
+        if (!r)
+                return -ENOMEM;
+
+        r->fd = fd;
+
+        *ret = r;
+        return 0;
+}
+
+static void reader_reset(JournalBinaryReader *r) {
+        unsigned i;
+
+        for (i = 0; i < r->n_kept; i++)
+                free(r->kept[i].iov_base);
+
+        r->n_kept = 0;
+        r->kept_size = 0;
+}
+
+void journal_binary_reader_free(JournalBinaryReader *r) {
+        if (!r)
+                return;
+
+        reader_reset(r);
+
+        free(r->kept);
+        free(r->iovec);
+        free(r->buffer);
+        free(r);
+}
+
+int journal_binary_reader_push(JournalBinaryReader *r, const void *data, size_t size) {
+        assert(r);
+        assert(data || size == 0);
+
+        if (!GREEDY_REALLOC(r->buffer, r->allocated, r->end + size))
+                return -ENOMEM;
+
+        memcpy(r->buffer + r->end, data, size);
+        r->end += size;
+
+        return 0;
+}
+
+/* Makes sure that at least n bytes are buffered. Returns 0 if the
+ * stream ends before anything was buffered. */
+static int reader_fill(JournalBinaryReader *r, size_t n) {
+
+        if (r->end - r->start >= n)
+                return 1;
+
+        if (r->start > 0) {
+                memmove(r->buffer, r->buffer + r->start, r->end - r->start);
+                r->end -= r->start;
+                r->start = 0;
+        }
+
+        while (r->end < n) {
+                ssize_t k;
+
+                if (!GREEDY_REALLOC(r->buffer, r->allocated, MAX(n, r->end + READ_SIZE)))
+                        return -ENOMEM;
+
+                k = read(r->fd, r->buffer + r->end, r->allocated - r->end);
+                if (k < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        return -errno;
+                }
+
+                if (k == 0) {
+                        if (r->end == 0)
+                                return 0;
+
+                        log_error("Binary stream ends in the middle of a record.");
+                        return -EBADMSG;
+                }
+
+                r->end += k;
+        }
+
+        return 1;
+}
+
+static int parse_entry(JournalBinaryReader *r, const uint8_t *p, size_t size, JournalBinaryEntry *e) {
+        JournalBinaryEntryHeader h;
+        const uint8_t *end = p + size;
+        unsigned i, n;
+
+        if (size < sizeof(h))
+                return -EBADMSG;
+
+        memcpy(&h, p, sizeof(h));
+        p += sizeof(h);
+
+        n = le32toh(h.n_fields);
+
+        /* Every field takes four bytes at least */
+        if (n > (size - sizeof(h)) / sizeof(le32_t))
+                return -EBADMSG;
+
+        if (!GREEDY_REALLOC(r->iovec, r->iovec_allocated, MAX(n, 1U)))
+                return -ENOMEM;
+
+        for (i = 0; i < n; i++) {
+                le32_t le_ref;
+                le64_t le_size;
+                uint32_t ref;
+                uint64_t l;
+
+                if ((size_t) (end - p) < sizeof(le_ref))
+                        return -EBADMSG;
+
+                memcpy(&le_ref, p, sizeof(le_ref));
+                p += sizeof(le_ref);
+                ref = le32toh(le_ref);
+
+                if (ref != JOURNAL_BINARY_LITERAL && ref != JOURNAL_BINARY_LITERAL_KEEP) {
+                        if (ref >= r->n_kept)
+                                return -EBADMSG;
+
+                        r->iovec[i] = r->kept[ref];
+                        continue;
+                }
+
+                if ((size_t) (end - p) < sizeof(le_size))
+                        return -EBADMSG;
+
+                memcpy(&le_size, p, sizeof(le_size));
+                p += sizeof(le_size);
+                l = le64toh(le_size);
+
+                if (l > (uint64_t) (end - p))
+                        return -EBADMSG;
+
+                if (ref == JOURNAL_BINARY_LITERAL_KEEP) {
+                        void *d;
+
+                        if (r->n_kept >= JOURNAL_BINARY_KEEP_MAX ||
+                            r->kept_size + l > JOURNAL_BINARY_KEEP_SIZE_MAX)
+                                return -EBADMSG;
+
+                        if (!GREEDY_REALLOC(r->kept, r->kept_allocated, r->n_kept + 1))
+                                return -ENOMEM;
+
+                        d = memdup(p, MAX(l, 1U));
+                        if (!d)
+                                return -ENOMEM;
+
+                        r->kept[r->n_kept].iov_base = d;
+                        r->kept[r->n_kept].iov_len = l;
+                        r->n_kept++;
+                        r->kept_size += l;
+                }
+
+                r->iovec[i].iov_base = (void*) p;
+                r->iovec[i].iov_len = l;
+                p += l;
+        }
+
+        if (p != end)
+                return -EBADMSG;
+
+        e->seqnum = le64toh(h.seqnum);
+        e->ts.realtime = le64toh(h.realtime);
+        e->ts.monotonic = le64toh(h.monotonic);
+        e->boot_id = h.boot_id;
+        e->iovec = r->iovec;
+        e->n_iovec = n;
+
+        return 0;
+}
+
+int journal_binary_read_entry(JournalBinaryReader *r, JournalBinaryEntry *e) {
+        int k;
+
+        assert(r);
+        assert(e);
+
+        if (!r->magic) {
+                k = reader_fill(r, sizeof(JOURNAL_BINARY_MAGIC) - 1);
+                if (k <= 0)
+                        return k;
+
+                if (memcmp(r->buffer + r->start, JOURNAL_BINARY_MAGIC, sizeof(JOURNAL_BINARY_MAGIC) - 1) != 0) {
+                        log_error("Not a binary journal stream.");
+                        return -EBADMSG;
+                }
+
+                r->start += sizeof(JOURNAL_BINARY_MAGIC) - 1;
+                r->magic = true;
+        }
+
+        for (;;) {
+                JournalBinaryRecordHeader h;
+                uint64_t size;
+                const uint8_t *p;
+
+                k = reader_fill(r, sizeof(h));
+                if (k <= 0)
+                        return k;
+
+                memcpy(&h, r->buffer + r->start, sizeof(h));
+                size = le64toh(h.size);
+
+                if (size < sizeof(h) || size > JOURNAL_BINARY_RECORD_SIZE_MAX) {
+                        log_error("Invalid record size %"PRIu64" in binary stream.", size);
+                        return -EBADMSG;
+                }
+
+                k = reader_fill(r, size);
+                if (k < 0)
+                        return k;
+                if (k == 0)
+                        return -EBADMSG;
+
+                p = r->buffer + r->start;
+
+                /* The fields point into the buffer, which is moved
+                 * no earlier than by the next call */
+                r->start += size;
+
+                if (h.type == JOURNAL_BINARY_RESET)
+                        reader_reset(r);
+                else if (h.type == JOURNAL_BINARY_ENTRY) {
+                        k = parse_entry(r, p, size, e);
+                        if (k < 0) {
+                                if (k == -EBADMSG)
+                                        log_error("Invalid entry record in binary stream.");
+                                return k;
+                        }
+
+                        return 1;
+                }
+        }
+}
+
+int journal_binary_append_entry(JournalFile *f, const JournalBinaryEntry *e) {
+        uint64_t seqnum;
+
+        assert(f);
+        assert(e);
+
+        journal_file_set_boot_id(f, e->boot_id);
+
+        /* The file takes the larger one of its next sequence number
+         * and the one following what is passed */
+        seqnum = e->seqnum > 0 ? e->seqnum - 1 : 0;
+
+        return journal_file_append_entry(f, &e->ts, e->iovec, e->n_iovec, &seqnum, NULL, NULL);
+}
+
+int journal_binary_import(JournalFile *f, int fd, uint64_t *n_entries) {
+        _cleanup_journal_binary_reader_free_ JournalBinaryReader *r = NULL;
+        JournalBinaryEntry e;
+        uint64_t n = 0;
+        int k;
+
+        assert(f);
+        assert(fd >= 0);
+
+        k = journal_binary_reader_new(fd, &r);
+        if (k < 0)
+                return k;
+
+        while ((k = journal_binary_read_entry(r, &e)) > 0) {
+                k = journal_binary_append_entry(f, &e);
+                if (k < 0)
+                        return k;
+
+                n++;
+        }
+        if (k < 0)
+                return k;
+
+        if (n_entries)
+                *n_entries = n;
+
+        return 0;
+}
+
+#ifdef TESTS
+#include <fcntl.h>
+#include <stdio.h>
+
+#include "hash/hash.h"
+#include "journal-internal.h"
+#include "logs-show.h"
+
+static void append(JournalFile *f, unsigned i) {
+        static char big[5000];
+        char message[64], key[32];
+        const char bin[] = "BIN=a\001\000\377";
+        struct iovec iovec[6];
+        dual_timestamp ts;
+        unsigned n = 0;
+
+        dual_timestamp_get(&ts);
+
+        snprintf(message, sizeof(message), "MESSAGE=message %u", i);
+        snprintf(key, sizeof(key), "KEY=%u", i / 2);
+
+        IOVEC_SET_STRING(iovec[n++], message);
+        IOVEC_SET_STRING(iovec[n++], key);
+        IOVEC_SET_STRING(iovec[n++], i % 3 ? "_COMM=sshd" : "_COMM=cron");
+
+        if (i % 100 == 0) {
+                memcpy(big, "BIG=", 4);
+                memset(big + 4, 'a' + i % 26, sizeof(big) - 4);
+                iovec[n].iov_base = big;
+                iovec[n++].iov_len = sizeof(big);
+        }
+
+        if (i % 7 == 0) {
+                iovec[n].iov_base = (char*) bin;
+                iovec[n++].iov_len = sizeof(bin) - 1;
+                IOVEC_SET_STRING(iovec[n++], key);
+        }
+
+        assert_se(journal_file_append_entry(f, &ts, iovec, n, NULL, NULL, NULL) == 0);
+}
+
+static void entry_info(sd_journal *j, uint64_t info[6]) {
+        const void *data;
+        size_t length;
+        uuid_t boot_id;
+        Object *o;
+
+        assert_se(journal_file_move_to_object(j->current_file, OBJECT_ENTRY, j->current_file->current_offset, &o) >= 0);
+        info[0] = le64toh(o->entry.seqnum);
+
+        assert_se(sd_journal_get_realtime_usec(j, &info[1]) >= 0);
+        assert_se(sd_journal_get_monotonic_usec(j, &info[2], &boot_id) >= 0);
+        info[3] = boot_id.qwords[0] ^ boot_id.qwords[1];
+
+        /* The fields may be stored in a different order */
+        info[4] = info[5] = 0;
+        SD_JOURNAL_FOREACH_DATA(j, data, length) {
+                uint64_t h;
+
+                hash64(data, length, &h);
+                info[4] += h;
+                info[5]++;
+        }
+}
+
+int main(int argc, char *argv[]) {
+        char t[] = "/tmp/journal-binary-XXXXXX";
+        const char *a[] = { "a.journal", NULL }, *b[] = { "b.journal", NULL };
+        JournalBinaryReader *reader;
+        JournalBinaryEntry e;
+        JournalFile *f;
+        sd_journal *ja, *jb;
+        FILE *out;
+        uuid_t boot_id = {};
+        uint64_t n = 0, n_imported;
+        unsigned i;
+        int fd;
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open("a.journal", O_RDWR|O_CREAT, 0666, true, false, NULL, NULL, NULL, &f) == 0);
+
+        /* More fields to keep than the reader may keep at once */
+        for (i = 0; i < JOURNAL_BINARY_KEEP_MAX * 2 + 1000; i++)
+                append(f, i);
+
+        /* Entries of another boot, with smaller monotonic timestamps */
+        boot_id.bytes[0] = 1;
+        journal_file_set_boot_id(f, boot_id);
+        for (i = 0; i < 10; i++)
+                append(f, i);
+
+        journal_file_close(f);
+
+        assert_se(sd_journal_open_files(&ja, a, 0) >= 0);
+
+        out = fopen("stream", "we");
+        assert_se(out);
+        output_buffer_stream(out);
+
+        SD_JOURNAL_FOREACH(ja) {
+                assert_se(output_journal(out, ja, OUTPUT_BINARY, 0, 0, NULL) >= 0);
+                n++;
+        }
+
+        assert_se(output_flush(out) >= 0);
+        fclose(out);
+        output_free_scratch();
+
+        assert_se(journal_file_open("b.journal", O_RDWR|O_CREAT, 0666, true, false, NULL, NULL, NULL, &f) == 0);
+
+        fd = open("stream", O_RDONLY|O_CLOEXEC);
+        assert_se(fd >= 0);
+        assert_se(journal_binary_import(f, fd, &n_imported) >= 0);
+        safe_close(fd);
+
+        journal_file_close(f);
+
+        log_info("%"PRIu64" entries imported", n_imported);
+        assert_se(n_imported == n);
+
+        assert_se(sd_journal_open_files(&jb, b, 0) >= 0);
+
+        sd_journal_seek_head(ja);
+        sd_journal_seek_head(jb);
+        for (i = 0; i < n; i++) {
+                uint64_t x[6], y[6];
+
+                assert_se(sd_journal_next(ja) > 0);
+                assert_se(sd_journal_next(jb) > 0);
+
+                entry_info(ja, x);
+                entry_info(jb, y);
+                assert_se(memcmp(x, y, sizeof(x)) == 0);
+        }
+        assert_se(sd_journal_next(jb) == 0);
+
+        sd_journal_close(ja);
+        sd_journal_close(jb);
+
+        /* A stream which is cut off, or isn't one */
+        assert_se(truncate("stream", 1000) >= 0);
+        fd = open("stream", O_RDONLY|O_CLOEXEC);
+        assert_se(fd >= 0);
+        assert_se(journal_binary_reader_new(fd, &reader) >= 0);
+        while ((i = journal_binary_read_entry(reader, &e)) == 1)
+                ;
+        assert_se((int) i == -EBADMSG);
+        journal_binary_reader_free(reader);
+        safe_close(fd);
+
+        fd = open("a.journal", O_RDONLY|O_CLOEXEC);
+        assert_se(fd >= 0);
+        assert_se(journal_binary_reader_new(fd, &reader) >= 0);
+        assert_se(journal_binary_read_entry(reader, &e) == -EBADMSG);
+        journal_binary_reader_free(reader);
+        safe_close(fd);
+
+        assert_se(rm_rf_dangerous(t, false, true, false) >= 0);
+
+        return 0;
+}
+#endif // TESTS
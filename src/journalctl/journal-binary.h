@@ -0,0 +1,101 @@
+/*
+ * Copyright © 2018 - Vitaliy Perevertun
+ *
+ * This file is part of journal
+ *
+ * This file is licensed under the MIT license.
+ * See the file LICENSE.
+ */
+
+#pragma once
+
+#include <sys/uio.h>
+
+#include "journal.h"
+#include "journal-file.h"
+#include "sparse-endian.h"
+#include "util.h"
+
+/* Binary stream of entries, as written by journalctl -o binary. Unlike
+ * the export format, it needs neither escaping nor scanning for line
+ * breaks. It starts with the magic, followed by records. Each record
+ * starts with a header holding its size, including the header, and its
+ * type. Records of unknown types are skipped.
+ *
+ * An entry record holds the sequence number, timestamps, boot ID and
+ * number of fields of the entry, followed by the fields. Each field
+ * starts with a reference:
+ *
+ *     JOURNAL_BINARY_LITERAL       followed by the size and the data
+ *     JOURNAL_BINARY_LITERAL_KEEP  likewise, and the data is kept in
+ *                                  the dictionary under the next index
+ *     anything else                the index of data kept before
+ *
+ * A reset record empties the dictionary. Writers keep no more than
+ * JOURNAL_BINARY_KEEP_MAX fields and JOURNAL_BINARY_KEEP_SIZE_MAX bytes
+ * in it, so that data stored once on disk is sent once while the
+ * reader's memory stays bounded. All numbers are little endian. */
+
+#define JOURNAL_BINARY_MAGIC "JRNLBIN1"
+
+#define JOURNAL_BINARY_LITERAL ((uint32_t) -1)
+#define JOURNAL_BINARY_LITERAL_KEEP ((uint32_t) -2)
+
+#define JOURNAL_BINARY_KEEP_MAX 16384U
+#define JOURNAL_BINARY_KEEP_SIZE_MAX (16U*1024U*1024U)
+
+/* Larger records are refused by readers */
+#define JOURNAL_BINARY_RECORD_SIZE_MAX (1024ULL*1024ULL*1024ULL)
+
+enum {
+        JOURNAL_BINARY_ENTRY = 'E',
+        JOURNAL_BINARY_RESET = 'R',
+};
+
+typedef struct JournalBinaryRecordHeader {
+        le64_t size;
+        uint8_t type;
+        uint8_t reserved[7];
+} _packed_ JournalBinaryRecordHeader;
+
+typedef struct JournalBinaryEntryHeader {
+        JournalBinaryRecordHeader record;
+        le64_t seqnum;
+        le64_t realtime;
+        le64_t monotonic;
+        uuid_t boot_id;
+        le32_t n_fields;
+        le32_t reserved;
+} _packed_ JournalBinaryEntryHeader;
+
+/* An entry read from a stream. The fields stay valid until the next
+ * entry is read. */
+typedef struct JournalBinaryEntry {
+        uint64_t seqnum;
+        dual_timestamp ts;
+        uuid_t boot_id;
+        struct iovec *iovec;
+        unsigned n_iovec;
+} JournalBinaryEntry;
+
+typedef struct JournalBinaryReader JournalBinaryReader;
+
+int journal_binary_reader_new(int fd, JournalBinaryReader **ret);
+void journal_binary_reader_free(JournalBinaryReader *r);
+
+/* Passes bytes already read from the file descriptor, which are parsed
+ * before anything read later */
+int journal_binary_reader_push(JournalBinaryReader *r, const void *data, size_t size);
+
+/* Returns 1 and the next entry, or 0 at the end of the stream */
+int journal_binary_read_entry(JournalBinaryReader *r, JournalBinaryEntry *e);
+
+/* Appends the entry with its timestamps, boot ID and, unless the file
+ * is past it already, its sequence number */
+int journal_binary_append_entry(JournalFile *f, const JournalBinaryEntry *e);
+
+/* Appends all entries read from the stream */
+int journal_binary_import(JournalFile *f, int fd, uint64_t *n_entries);
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(JournalBinaryReader*, journal_binary_reader_free);
+#define _cleanup_journal_binary_reader_free_ _cleanup_(journal_binary_reader_freep)
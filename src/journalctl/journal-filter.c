@@ -0,0 +1,1075 @@
+/*
+ * Copyright © 2018 - Vitaliy Perevertun
+ *
+ * This file is part of journal
+ *
+ * This file is licensed under the MIT license.
+ * See the file LICENSE.
+ */
+
+#include <errno.h>
+#include <regex.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash/hash.h"
+#include "journal-file.h"
+#include "journal-filter.h"
+#include "journal-internal.h"
+#include "log.h"
+#include "macro.h"
+#include "util.h"
+
+#define FIELD_CHARS "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_"
+
+/* Words are verified with a bit mask of the tokens found */
+#define WORDS_TOKENS_MAX 64U
+
+/* The most messages found through the token index which are added as
+ * matches. Every step through ORed matches looks at all of them, so
+ * beyond that testing the entries one by one is cheaper. */
+#define WORDS_MATCHES_MAX 1024U
+
+typedef enum FilterNodeType {
+        FILTER_AND,
+        FILTER_OR,
+        FILTER_NOT,
+        FILTER_TERM
+} FilterNodeType;
+
+typedef enum FilterOp {
+        FILTER_EXISTS,
+        FILTER_EQUAL,
+        FILTER_CONTAINS,
+        FILTER_REGEX,
+        FILTER_LESS,
+        FILTER_LESS_EQUAL,
+        FILTER_GREATER,
+        FILTER_GREATER_EQUAL,
+        FILTER_WORDS
+} FilterOp;
+
+typedef struct FilterToken {
+        const char *p;
+        size_t size;
+        uint64_t hash;
+} FilterToken;
+
+typedef struct FilterNode FilterNode;
+
+struct FilterNode {
+        FilterNodeType type;
+
+        /* For AND, OR and NOT, the latter only uses a */
+        FilterNode *a, *b;
+
+        /* For terms */
+        FilterOp op;
+        unsigned field;
+        char *value;
+        size_t value_size;
+        long long number;
+        regex_t regex;
+        bool regex_compiled;
+        FilterToken *tokens;
+        unsigned n_tokens;
+
+        /* Equality terms which are known to hold for all entries,
+         * since they were added as matches */
+        bool matched;
+};
+
+struct JournalFilter {
+        FilterNode *root;
+
+        /* The distinct fields of all terms, and their data of the
+         * current entry, which sd_journal_get_fields() keeps valid
+         * until it is called again or the journal moves on */
+        char **fields;
+        unsigned n_fields;
+        size_t n_fields_allocated;
+        const void **data;
+        size_t *size;
+        bool have_data;
+
+        /* NUL terminated copy of a value, for regexec() and the
+         * number parser */
+        char *buffer;
+        size_t buffer_size;
+};
+
+typedef struct FilterValue {
+        void *data;
+        size_t size;
+} FilterValue;
+
+typedef struct FilterParser {
+        JournalFilter *filter;
+        const char *expr;
+        const char *p;
+} FilterParser;
+
+static void filter_node_free(FilterNode *n) {
+        if (!n)
+                return;
+
+        filter_node_free(n->a);
+        filter_node_free(n->b);
+
+        free(n->value);
+        free(n->tokens);
+        if (n->regex_compiled)
+                regfree(&n->regex);
+
+        free(n);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(FilterNode*, filter_node_free);
+#define _cleanup_filter_node_free_ _cleanup_(filter_node_freep)
+
+void journal_filter_free(JournalFilter *f) {
+        if (!f)
+                return;
+
+        filter_node_free(f->root);
+
+        while (f->n_fields > 0)
+                free(f->fields[--f->n_fields]);
+        free(f->fields);
+
+        free(f->data);
+        free(f->size);
+        free(f->buffer);
+        free(f);
+}
+
+static void skip_space(FilterParser *p) {
+        p->p += strspn(p->p, WHITESPACE);
+}
+
+static int parse_error(FilterParser *p, const char *what) {
+        log_error("Failed to parse filter at position %zu, %s: %s",
+                  (size_t) (p->p - p->expr) + 1, what, p->expr);
+        return -EINVAL;
+}
+
+static int filter_add_field(JournalFilter *f, const char *field, size_t n, unsigned *ret) {
+        unsigned i;
+        char *s;
+
+        for (i = 0; i < f->n_fields; i++)
+                if (strlen(f->fields[i]) == n && memcmp(f->fields[i], field, n) == 0) {
+                        *ret = i;
+                        return 0;
+                }
+
+        if (!GREEDY_REALLOC(f->fields, f->n_fields_allocated, f->n_fields + 1))
+                return -ENOMEM;
+
+        s = strndup(field, n);
+        if (!s)
+                return -ENOMEM;
+
+        f->fields[f->n_fields] = s;
+        *ret = f->n_fields++;
+        return 0;
+}
+
+static int parse_value(FilterParser *p, char **ret, size_t *ret_size) {
+        _cleanup_free_ char *v = NULL;
+        size_t n = 0;
+
+        if (*p->p != '"') {
+                /* Bare values end at white space and at the
+                 * operators which may follow a term */
+                n = strcspn(p->p, WHITESPACE "()&|");
+
+                v = strndup(p->p, n);
+                if (!v)
+                        return -ENOMEM;
+
+                p->p += n;
+        } else {
+                const char *s;
+
+                v = new(char, strlen(p->p));
+                if (!v)
+                        return -ENOMEM;
+
+                for (s = p->p + 1; *s != '"'; s++) {
+                        if (*s == 0)
+                                return parse_error(p, "unterminated quote");
+
+                        if (*s == '\\') {
+                                if (s[1] != '"' && s[1] != '\\')
+                                        return parse_error(p, "invalid escape");
+                                s++;
+                        }
+
+                        v[n++] = *s;
+                }
+
+                v[n] = 0;
+                p->p = s + 1;
+        }
+
+        *ret = v;
+        *ret_size = n;
+        v = NULL;
+
+        return 0;
+}
+
+static int parse_term(FilterParser *p, FilterNode **ret) {
+        _cleanup_filter_node_free_ FilterNode *n = NULL;
+        const char *field;
+        bool negate = false;
+        size_t l;
+        int r;
+
+        field = p->p;
+        l = strspn(field, FIELD_CHARS);
+        if (l <= 0)
+                return parse_error(p, "expected field name");
+
+        if (field[0] == '_' && field[1] == '_')
+                return parse_error(p, "field names may not start with \"__\"");
+
+        p->p += l;
+
+        n = new0(FilterNode, 1);
+        if (!n)
+                return -ENOMEM;
+
+        n->type = FILTER_TERM;
+
+        r = filter_add_field(p->filter, field, l, &n->field);
+        if (r < 0)
+                return r;
+
+        if (startswith(p->p, "=~")) {
+                n->op = FILTER_REGEX;
+                p->p += 2;
+        } else if (startswith(p->p, "!=")) {
+                n->op = FILTER_EQUAL;
+                negate = true;
+                p->p += 2;
+        } else if (startswith(p->p, "<=")) {
+                n->op = FILTER_LESS_EQUAL;
+                p->p += 2;
+        } else if (startswith(p->p, ">=")) {
+                n->op = FILTER_GREATER_EQUAL;
+                p->p += 2;
+        } else if (*p->p == '=') {
+                n->op = FILTER_EQUAL;
+                p->p++;
+        } else if (*p->p == '~') {
+                n->op = FILTER_CONTAINS;
+                p->p++;
+        } else if (*p->p == '<') {
+                n->op = FILTER_LESS;
+                p->p++;
+        } else if (*p->p == '>') {
+                n->op = FILTER_GREATER;
+                p->p++;
+        } else
+                n->op = FILTER_EXISTS;
+
+        if (n->op != FILTER_EXISTS) {
+                r = parse_value(p, &n->value, &n->value_size);
+                if (r < 0)
+                        return r;
+        }
+
+        switch (n->op) {
+
+        case FILTER_REGEX:
+                r = regcomp(&n->regex, n->value, REG_EXTENDED|REG_NOSUB);
+                if (r != 0)
+                        return parse_error(p, "invalid regular expression");
+
+                n->regex_compiled = true;
+                break;
+
+        case FILTER_LESS:
+        case FILTER_LESS_EQUAL:
+        case FILTER_GREATER:
+        case FILTER_GREATER_EQUAL:
+                r = safe_atolli(n->value, &n->number);
+                if (r < 0)
+                        return parse_error(p, "invalid number");
+                break;
+
+        default:
+                break;
+        }
+
+        if (negate) {
+                FilterNode *m;
+
+                m = new0(FilterNode, 1);
+                if (!m)
+                        return -ENOMEM;
+
+                m->type = FILTER_NOT;
+                m->a = n;
+                n = m;
+        }
+
+        *ret = n;
+        n = NULL;
+
+        return 0;
+}
+
+static int parse_or(FilterParser *p, FilterNode **ret);
+
+static int parse_unary(FilterParser *p, FilterNode **ret) {
+        FilterNode *n = NULL;
+        int r;
+
+        skip_space(p);
+
+        if (*p->p == '!') {
+                FilterNode *m;
+
+                p->p++;
+
+                r = parse_unary(p, &n);
+                if (r < 0)
+                        return r;
+
+                m = new0(FilterNode, 1);
+                if (!m) {
+                        filter_node_free(n);
+                        return -ENOMEM;
+                }
+
+                m->type = FILTER_NOT;
+                m->a = n;
+                n = m;
+
+        } else if (*p->p == '(') {
+                p->p++;
+
+                r = parse_or(p, &n);
+                if (r < 0)
+                        return r;
+
+                skip_space(p);
+
+                if (*p->p != ')') {
+                        filter_node_free(n);
+                        return parse_error(p, "expected ')'");
+                }
+
+                p->p++;
+
+        } else {
+                r = parse_term(p, &n);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = n;
+        return 0;
+}
+
+static int parse_binary(FilterParser *p, FilterNodeType type, FilterNode **ret) {
+        const char *token = type == FILTER_AND ? "&&" : "||";
+        FilterNode *n = NULL;
+        int r;
+
+        r = type == FILTER_AND ? parse_unary(p, &n) : parse_binary(p, FILTER_AND, &n);
+        if (r < 0)
+                return r;
+
+        for (;;) {
+                FilterNode *m, *b = NULL;
+
+                skip_space(p);
+
+                if (!startswith(p->p, token))
+                        break;
+
+                p->p += 2;
+
+                r = type == FILTER_AND ? parse_unary(p, &b) : parse_binary(p, FILTER_AND, &b);
+                if (r < 0) {
+                        filter_node_free(n);
+                        return r;
+                }
+
+                m = new0(FilterNode, 1);
+                if (!m) {
+                        filter_node_free(n);
+                        filter_node_free(b);
+                        return -ENOMEM;
+                }
+
+                m->type = type;
+                m->a = n;
+                m->b = b;
+                n = m;
+        }
+
+        *ret = n;
+        return 0;
+}
+
+static int parse_or(FilterParser *p, FilterNode **ret) {
+        return parse_binary(p, FILTER_OR, ret);
+}
+
+static int filter_alloc_data(JournalFilter *f) {
+        free(f->data);
+        free(f->size);
+
+        f->data = new(const void*, f->n_fields);
+        f->size = new(size_t, f->n_fields);
+        if (!f->data || !f->size)
+                return -ENOMEM;
+
+        return 0;
+}
+
+int journal_filter_parse(const char *expr, JournalFilter **ret) {
+        _cleanup_journal_filter_free_ JournalFilter *f = NULL;
+        FilterParser p = {
+                .expr = expr,
+                .p = expr,
+        };
+        int r;
+
+        assert(expr);
+        assert(ret);
+
+        f = new0(JournalFilter, 1);
+        if (!f)
+                return -ENOMEM;
+
+        p.filter = f;
+
+        r = parse_or(&p, &f->root);
+        if (r < 0)
+                return r;
+
+        skip_space(&p);
+        if (*p.p != 0)
+                return parse_error(&p, "unexpected trailing characters");
+
+        r = filter_alloc_data(f);
+        if (r < 0)
+                return r;
+
+        *ret = f;
+        f = NULL;
+
+        return 0;
+}
+
+int journal_filter_add_words(JournalFilter **f, const char *words) {
+        _cleanup_filter_node_free_ FilterNode *n = NULL;
+        size_t allocated = 0, l;
+        const char *t;
+        int r;
+
+        assert(f);
+        assert(words);
+
+        n = new0(FilterNode, 1);
+        if (!n)
+                return -ENOMEM;
+
+        n->type = FILTER_TERM;
+        n->op = FILTER_WORDS;
+
+        n->value = strdup(words);
+        if (!n->value)
+                return -ENOMEM;
+
+        n->value_size = strlen(words);
+
+        for (t = n->value; (t = journal_file_next_token(t, n->value + n->value_size, &l)); t += l) {
+                if (n->n_tokens >= WORDS_TOKENS_MAX) {
+                        log_error("Too many words, at most %u are supported: %s", WORDS_TOKENS_MAX, words);
+                        return -EINVAL;
+                }
+
+                if (!GREEDY_REALLOC(n->tokens, allocated, n->n_tokens + 1))
+                        return -ENOMEM;
+
+                n->tokens[n->n_tokens].p = t;
+                n->tokens[n->n_tokens].size = l;
+                hash64(t, l, &n->tokens[n->n_tokens].hash);
+                n->n_tokens++;
+        }
+
+        if (n->n_tokens <= 0) {
+                log_error("No words to look for: %s", words);
+                return -EINVAL;
+        }
+
+        if (!*f) {
+                *f = new0(JournalFilter, 1);
+                if (!*f)
+                        return -ENOMEM;
+        }
+
+        r = filter_add_field(*f, "MESSAGE", strlen("MESSAGE"), &n->field);
+        if (r < 0)
+                return r;
+
+        if ((*f)->root) {
+                FilterNode *m;
+
+                m = new0(FilterNode, 1);
+                if (!m)
+                        return -ENOMEM;
+
+                m->type = FILTER_AND;
+                m->a = (*f)->root;
+                m->b = n;
+                (*f)->root = m;
+        } else
+                (*f)->root = n;
+
+        n = NULL;
+
+        return filter_alloc_data(*f);
+}
+
+static bool words_match(FilterNode *n, const char *v, size_t size) {
+        uint64_t found = 0, all;
+        const char *t;
+        unsigned i;
+        size_t l;
+
+        all = n->n_tokens >= 64 ? (uint64_t) -1 : (1ULL << n->n_tokens) - 1;
+
+        for (t = v; (t = journal_file_next_token(t, v + size, &l)); t += l) {
+                for (i = 0; i < n->n_tokens; i++)
+                        if (n->tokens[i].size == l && memcmp(n->tokens[i].p, t, l) == 0)
+                                found |= 1ULL << i;
+
+                if (found == all)
+                        return true;
+        }
+
+        return false;
+}
+
+static int find_words_in_file(FilterNode *n, JournalFile *f, FilterValue **values, unsigned *n_values, size_t *allocated) {
+        uint64_t *lists[WORDS_TOKENS_MAX] = {}, sizes[WORDS_TOKENS_MAX] = {}, pos[WORDS_TOKENS_MAX] = {};
+        unsigned n_lists = 0, smallest = 0, i, k;
+        uint64_t x;
+        int r;
+
+        /* Intersect the posting lists of all tokens. They are sorted
+         * by offset, so the lists are walked in parallel, driven by
+         * the shortest one. */
+        for (i = 0; i < n->n_tokens; i++) {
+                Object *o;
+
+                if (n->tokens[i].size < JOURNAL_TOKEN_SIZE_MIN ||
+                    n->tokens[i].size > JOURNAL_TOKEN_SIZE_MAX)
+                        continue;
+
+                r = journal_file_find_token(f, n->tokens[i].hash, &o, NULL);
+                if (r <= 0) {
+                        /* None of the messages of this file has the token */
+                        if (r == 0)
+                                r = 1;
+                        goto finish;
+                }
+
+                r = journal_file_get_token_data(f, o, &lists[n_lists], &sizes[n_lists]);
+                if (r < 0)
+                        goto finish;
+
+                if (sizes[n_lists] < sizes[smallest])
+                        smallest = n_lists;
+
+                n_lists++;
+        }
+
+        for (x = 0; x < sizes[smallest]; x++) {
+                uint64_t d = lists[smallest][x];
+                const void *data;
+                size_t size;
+                Object *o;
+
+                for (k = 0; k < n_lists; k++) {
+                        if (k == smallest)
+                                continue;
+
+                        while (pos[k] < sizes[k] && lists[k][pos[k]] < d)
+                                pos[k]++;
+
+                        if (pos[k] >= sizes[k] || lists[k][pos[k]] != d)
+                                break;
+                }
+
+                if (k < n_lists)
+                        continue;
+
+                /* Colliding token hashes and the tokens which aren't
+                 * indexed are ruled out by the message itself */
+                r = journal_file_move_to_object(f, OBJECT_DATA, d, &o);
+                if (r < 0)
+                        goto finish;
+
+                r = journal_file_data_payload(f, o, &data, &size);
+                if (r < 0)
+                        goto finish;
+
+                if (size < 8 || memcmp(data, "MESSAGE=", 8) != 0 ||
+                    !words_match(n, (const char*) data + 8, size - 8))
+                        continue;
+
+                if (*n_values >= WORDS_MATCHES_MAX) {
+                        r = 0;
+                        goto finish;
+                }
+
+                if (!GREEDY_REALLOC(*values, *allocated, *n_values + 1)) {
+                        r = -ENOMEM;
+                        goto finish;
+                }
+
+                (*values)[*n_values].data = memdup(data, size);
+                if (!(*values)[*n_values].data) {
+                        r = -ENOMEM;
+                        goto finish;
+                }
+
+                (*values)[(*n_values)++].size = size;
+        }
+
+        r = 1;
+
+finish:
+        for (k = 0; k < n_lists; k++)
+                free(lists[k]);
+
+        return r;
+}
+
+static int add_words_matches(JournalFilter *f, FilterNode *n, sd_journal *j) {
+        FilterValue *values = NULL;
+        unsigned n_values = 0, k;
+        size_t allocated = 0;
+        JournalFile *jf;
+        Iterator i;
+        int r;
+
+        /* The index only helps if every file has one */
+        HASHMAP_FOREACH(jf, j->files, i)
+                if (!jf->token_hash_table)
+                        return 0;
+
+        for (k = 0; k < n->n_tokens; k++)
+                if (n->tokens[k].size >= JOURNAL_TOKEN_SIZE_MIN &&
+                    n->tokens[k].size <= JOURNAL_TOKEN_SIZE_MAX)
+                        break;
+
+        if (k >= n->n_tokens)
+                return 0;
+
+        HASHMAP_FOREACH(jf, j->files, i) {
+                r = find_words_in_file(n, jf, &values, &n_values, &allocated);
+                if (r <= 0) {
+                        if (r == 0)
+                                log_debug("More than %u messages contain the words, testing entries.", WORDS_MATCHES_MAX);
+                        goto finish;
+                }
+        }
+
+        log_debug("Found %u messages containing the words.", n_values);
+
+        r = sd_journal_add_conjunction(j);
+        if (r < 0)
+                goto finish;
+
+        if (n_values <= 0) {
+                _cleanup_free_ char *m = NULL;
+
+                /* A message equal to the words would contain them, so
+                 * as none was found this matches no entry at all */
+                m = strappend("MESSAGE=", n->value);
+                if (!m) {
+                        r = -ENOMEM;
+                        goto finish;
+                }
+
+                r = sd_journal_add_match(j, m, 0);
+                if (r < 0)
+                        goto finish;
+        }
+
+        for (k = 0; k < n_values; k++) {
+                r = sd_journal_add_match(j, values[k].data, values[k].size);
+                if (r < 0)
+                        goto finish;
+        }
+
+        n->matched = true;
+        r = 0;
+
+finish:
+        for (k = 0; k < n_values; k++)
+                free(values[k].data);
+        free(values);
+
+        return r;
+}
+
+static int add_matches_for_node(JournalFilter *f, FilterNode *n, sd_journal *j, bool lookup_words) {
+        _cleanup_free_ char *m = NULL;
+        size_t l;
+        int r;
+
+        /* Only equality terms and words which all entries have to
+         * satisfy can be resolved through the indexes */
+
+        if (n->type == FILTER_AND) {
+                r = add_matches_for_node(f, n->a, j, lookup_words);
+                if (r < 0)
+                        return r;
+
+                return add_matches_for_node(f, n->b, j, lookup_words);
+        }
+
+        if (n->type == FILTER_TERM && n->op == FILTER_WORDS)
+                return lookup_words ? add_words_matches(f, n, j) : 0;
+
+        if (n->type != FILTER_TERM || n->op != FILTER_EQUAL)
+                return 0;
+
+        l = strlen(f->fields[n->field]);
+
+        m = new(char, l + 1 + n->value_size);
+        if (!m)
+                return -ENOMEM;
+
+        memcpy(mempcpy(m, f->fields[n->field], l), "=", 1);
+        memcpy(m + l + 1, n->value, n->value_size);
+
+        /* Add every term as a conjunction of its own, so that terms
+         * on the same field aren't ORed, and terms are ANDed with
+         * all matches from the command line */
+        r = sd_journal_add_conjunction(j);
+        if (r < 0)
+                return r;
+
+        r = sd_journal_add_match(j, m, l + 1 + n->value_size);
+        if (r < 0)
+                return r;
+
+        n->matched = true;
+        return 0;
+}
+
+int journal_filter_add_matches(JournalFilter *f, sd_journal *j, bool lookup_words) {
+        assert(f);
+        assert(j);
+
+        return add_matches_for_node(f, f->root, j, lookup_words);
+}
+
+static const char *term_value(JournalFilter *f, FilterNode *n, size_t *size) {
+        size_t l;
+
+        if (!f->data[n->field])
+                return NULL;
+
+        l = strlen(f->fields[n->field]) + 1;
+
+        *size = f->size[n->field] - l;
+        return (const char*) f->data[n->field] + l;
+}
+
+static const char *term_value_string(JournalFilter *f, FilterNode *n) {
+        const char *v;
+        size_t size;
+
+        v = term_value(f, n, &size);
+        if (!v)
+                return NULL;
+
+        if (!GREEDY_REALLOC(f->buffer, f->buffer_size, size + 1))
+                return NULL;
+
+        memcpy(f->buffer, v, size);
+        f->buffer[size] = 0;
+
+        return f->buffer;
+}
+
+static int test_term(JournalFilter *f, FilterNode *n, sd_journal *j) {
+        const char *v;
+        size_t size;
+        long long x;
+        int r;
+
+        if (n->matched)
+                return 1;
+
+        if (!f->have_data) {
+                size_t threshold;
+
+                /* The fields are fetched in full, so that substrings
+                 * are found everywhere, and the threshold of the
+                 * caller is put back afterwards */
+                r = sd_journal_get_data_threshold(j, &threshold);
+                if (r < 0)
+                        return r;
+
+                sd_journal_set_data_threshold(j, 0);
+                r = sd_journal_get_fields(j, (const char* const*) f->fields, f->n_fields, f->data, f->size);
+                sd_journal_set_data_threshold(j, threshold);
+                if (r < 0)
+                        return r;
+
+                f->have_data = true;
+        }
+
+        switch (n->op) {
+
+        case FILTER_EXISTS:
+                return !!f->data[n->field];
+
+        case FILTER_EQUAL:
+                v = term_value(f, n, &size);
+                return v && size == n->value_size && memcmp(v, n->value, size) == 0;
+
+        case FILTER_CONTAINS:
+                v = term_value(f, n, &size);
+                return v && memmem(v, size, n->value, n->value_size);
+
+        case FILTER_REGEX:
+                v = term_value_string(f, n);
+                return v && regexec(&n->regex, v, 0, NULL, 0) == 0;
+
+        case FILTER_WORDS:
+                v = term_value(f, n, &size);
+                return v && words_match(n, v, size);
+
+        default:
+                v = term_value_string(f, n);
+                if (!v || safe_atolli(v, &x) < 0)
+                        return 0;
+
+                switch (n->op) {
+                case FILTER_LESS:
+                        return x < n->number;
+                case FILTER_LESS_EQUAL:
+                        return x <= n->number;
+                case FILTER_GREATER:
+                        return x > n->number;
+                default:
+                        return x >= n->number;
+                }
+        }
+}
+
+static int test_node(JournalFilter *f, FilterNode *n, sd_journal *j) {
+        int r;
+
+        switch (n->type) {
+
+        case FILTER_AND:
+        case FILTER_OR:
+                r = test_node(f, n->a, j);
+                if (r < 0)
+                        return r;
+
+                if ((n->type == FILTER_AND) != (r > 0))
+                        return r;
+
+                return test_node(f, n->b, j);
+
+        case FILTER_NOT:
+                r = test_node(f, n->a, j);
+                if (r < 0)
+                        return r;
+
+                return !r;
+
+        default:
+                return test_term(f, n, j);
+        }
+}
+
+int journal_filter_test(JournalFilter *f, sd_journal *j) {
+        assert(f);
+        assert(j);
+
+        /* The fields are only fetched once a term needs them */
+        f->have_data = false;
+
+        return test_node(f, f->root, j);
+}
+
+#ifdef TESTS
+#include <fcntl.h>
+#include <stdio.h>
+
+#include "journal-file.h"
+#include "journal-internal.h"
+
+static void append(JournalFile *f, const char *comm, const char *message, int priority) {
+        struct iovec iovec[3];
+        dual_timestamp ts;
+        char *c, *m, *p;
+
+        dual_timestamp_get(&ts);
+
+        assert_se(asprintf(&c, "_COMM=%s", comm) >= 0);
+        assert_se(asprintf(&m, "MESSAGE=%s", message) >= 0);
+        assert_se(asprintf(&p, "PRIORITY=%i", priority) >= 0);
+
+        IOVEC_SET_STRING(iovec[0], c);
+        IOVEC_SET_STRING(iovec[1], m);
+        IOVEC_SET_STRING(iovec[2], p);
+
+        assert_se(journal_file_append_entry(f, &ts, iovec, priority >= 0 ? 3 : 2, NULL, NULL, NULL) == 0);
+
+        free(c);
+        free(m);
+        free(p);
+}
+
+static unsigned count(sd_journal *j, const char *expr) {
+        _cleanup_journal_filter_free_ JournalFilter *f = NULL;
+        unsigned n = 0;
+
+        sd_journal_flush_matches(j);
+
+        assert_se(journal_filter_parse(expr, &f) >= 0);
+        assert_se(journal_filter_add_matches(f, j, true) >= 0);
+
+        /* Values are tested in full, whatever the threshold of the
+         * caller, which is left alone */
+        assert_se(sd_journal_set_data_threshold(j, 16) >= 0);
+
+        SD_JOURNAL_FOREACH(j) {
+                size_t threshold;
+                int r;
+
+                r = journal_filter_test(f, j);
+                assert_se(r >= 0);
+                n += r;
+
+                assert_se(sd_journal_get_data_threshold(j, &threshold) >= 0);
+                assert_se(threshold == 16);
+        }
+
+        log_info("%s: %u entries", expr, n);
+        return n;
+}
+
+static unsigned count_words(sd_journal *j, const char *words) {
+        unsigned n[2] = {}, k;
+
+        /* Looked up through the token index, and tested entry by
+         * entry, with the same result */
+        for (k = 0; k < 2; k++) {
+                _cleanup_journal_filter_free_ JournalFilter *f = NULL;
+                _cleanup_free_ char *m = NULL;
+
+                sd_journal_flush_matches(j);
+
+                assert_se(journal_filter_add_words(&f, words) >= 0);
+                assert_se(journal_filter_add_matches(f, j, k == 0) >= 0);
+
+                m = journal_make_match_string(j);
+                assert_se(m);
+                assert_se(streq(m, "none") == (k == 1));
+
+                SD_JOURNAL_FOREACH(j) {
+                        int r;
+
+                        r = journal_filter_test(f, j);
+                        assert_se(r >= 0);
+                        n[k] += r;
+                }
+        }
+
+        log_info("%s: %u entries", words, n[0]);
+        assert_se(n[0] == n[1]);
+
+        return n[0];
+}
+
+int main(int argc, char *argv[]) {
+        char t[] = "/tmp/journal-filter-XXXXXX";
+        JournalFile *f;
+        sd_journal *j;
+        JournalFilter *filter;
+        unsigned i;
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open("test.journal", O_RDWR|O_CREAT, 0666, true, true, NULL, NULL, NULL, &f) == 0);
+
+        for (i = 0; i < 10; i++) {
+                append(f, "sshd", "Failed password for root", 4);
+                append(f, "sshd", "Accepted publickey for user", 6);
+                append(f, "cron", "(root) CMD (run-parts /etc/cron.hourly)", 6);
+                append(f, "kernel", "Out of memory: Kill process", 2);
+        }
+
+        /* A message larger than the compression threshold */
+        append(f, "kernel", "Call Trace: aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa end of trace", -1);
+
+        journal_file_close(f);
+
+        assert_se(sd_journal_open_directory(&j, t, 0) >= 0);
+
+        assert_se(count(j, "_COMM=sshd") == 20);
+        assert_se(count(j, "_COMM=sshd && _COMM=cron") == 0);
+        assert_se(count(j, "_COMM!=sshd") == 21);
+        assert_se(count(j, "MESSAGE~password") == 10);
+        assert_se(count(j, "MESSAGE~\"end of trace\"") == 1);
+        assert_se(count(j, "MESSAGE=~\"^(Failed|Accepted) \"") == 20);
+        assert_se(count(j, "PRIORITY<=4") == 20);
+        assert_se(count(j, "PRIORITY>4 && !(_COMM=cron)") == 10);
+        assert_se(count(j, "_COMM=sshd && (MESSAGE~Failed || PRIORITY>=6)") == 20);
+        assert_se(count(j, "!PRIORITY") == 1);
+        assert_se(count(j, "_COMM=kernel || _COMM=cron") == 21);
+
+        assert_se(count_words(j, "password") == 10);
+        assert_se(count_words(j, "root") == 20);
+        assert_se(count_words(j, "for root") == 10);
+        assert_se(count_words(j, "Kill, memory!") == 10);
+        assert_se(count_words(j, "trace end") == 1);
+        assert_se(count_words(j, "pass") == 0);
+        assert_se(count_words(j, "root publickey") == 0);
+        assert_se(count_words(j, "CMD x") == 0);
+
+        assert_se(journal_filter_add_words(&filter, "...") == -EINVAL);
+        assert_se(!filter);
+
+        assert_se(journal_filter_parse("_COMM=", &filter) >= 0);
+        journal_filter_free(filter);
+
+        assert_se(journal_filter_parse("", &filter) == -EINVAL);
+        assert_se(journal_filter_parse("_COMM=sshd &&", &filter) == -EINVAL);
+        assert_se(journal_filter_parse("(_COMM=sshd", &filter) == -EINVAL);
+        assert_se(journal_filter_parse("PRIORITY<x", &filter) == -EINVAL);
+        assert_se(journal_filter_parse("MESSAGE=~\"(\"", &filter) == -EINVAL);
+        assert_se(journal_filter_parse("MESSAGE=\"x", &filter) == -EINVAL);
+        assert_se(journal_filter_parse("__CURSOR", &filter) == -EINVAL);
+        assert_se(journal_filter_parse("message=x", &filter) == -EINVAL);
+
+        sd_journal_close(j);
+
+        assert_se(rm_rf_dangerous(t, false, true, false) >= 0);
+
+        return 0;
+}
+#endif // TESTS
@@ -0,0 +1,51 @@
+/*
+ * Copyright © 2018 - Vitaliy Perevertun
+ *
+ * This file is part of journal
+ *
+ * This file is licensed under the MIT license.
+ * See the file LICENSE.
+ */
+
+#pragma once
+
+#include "journal.h"
+#include "util.h"
+
+/* Filter expressions over the fields of entries, as passed with
+ * journalctl --filter=, for example
+ *
+ *     _COMM=sshd && (MESSAGE~"Failed password" || PRIORITY<=3)
+ *
+ * Terms are combined with &&, || and !, and grouped with parentheses.
+ * A term is one of
+ *
+ *     FIELD              the field exists
+ *     FIELD=VALUE        the value equals VALUE
+ *     FIELD!=VALUE       the value doesn't equal VALUE
+ *     FIELD~VALUE        the value contains VALUE
+ *     FIELD=~REGEX       the value matches the extended regular expression
+ *     FIELD<NUMBER       the value is a number less than NUMBER, likewise
+ *                        for <=, > and >=
+ *
+ * Values may be quoted with double quotes, and then use \" and \\.
+ * Fields occurring several times in an entry are tested with their
+ * first value.
+ *
+ * Words, as passed with journalctl --grep=, match messages containing
+ * all of their tokens, see journal_file_next_token(). */
+
+typedef struct JournalFilter JournalFilter;
+
+int journal_filter_parse(const char *expr, JournalFilter **ret);
+int journal_filter_add_words(JournalFilter **f, const char *words);
+void journal_filter_free(JournalFilter *f);
+
+/* Adds the terms which can be resolved through the indexes as matches.
+ * Words are only looked up in the token index if lookup_words is set,
+ * as the matches found cover the messages written so far only. */
+int journal_filter_add_matches(JournalFilter *f, sd_journal *j, bool lookup_words);
+int journal_filter_test(JournalFilter *f, sd_journal *j);
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(JournalFilter*, journal_filter_free);
+#define _cleanup_journal_filter_free_ _cleanup_(journal_filter_freep)
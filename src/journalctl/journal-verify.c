@@ -20,7 +20,6 @@
 ***/
 
 #include <unistd.h>
-#include <sys/mman.h>
 #include <fcntl.h>
 #include <stddef.h>
 
@@ -33,7 +32,25 @@
 #include "journal-verify.h"
 #include "compress.h"
 
-static void draw_progress(uint64_t p, usec_t *last_usec) {
+/* Offsets of the objects of one type. Objects are found in the order
+ * of their offsets, so the offsets are sorted as they are added. */
+typedef struct OffsetSet {
+        uint64_t *items;
+        uint64_t n;
+        size_t allocated;
+} OffsetSet;
+
+typedef struct VerifyProgress {
+        journal_verify_progress_t callback;
+        void *userdata;
+} VerifyProgress;
+
+/* Shared between threads, so that errors found by one thread clear
+ * the progress bar drawn by another */
+static bool progress_drawn = false;
+
+void journal_verify_draw_progress(unsigned p, void *userdata) {
+        usec_t *last_usec = userdata;
         unsigned n, i, j, k;
         usec_t z, x;
 
@@ -47,9 +64,10 @@ static void draw_progress(uint64_t p, usec_t *last_usec) {
                 return;
 
         *last_usec = z;
+        __atomic_store_n(&progress_drawn, true, __ATOMIC_RELAXED);
 
         n = (3 * columns()) / 4;
-        j = (n * (unsigned) p) / 65535ULL;
+        j = (n * p) / 65535U;
         k = n - j;
 
         fputs("\r\x1B[?25l" ANSI_LIGHTGREEN_ON, stdout);
@@ -62,16 +80,16 @@ static void draw_progress(uint64_t p, usec_t *last_usec) {
         for (i = 0; i < k; i++)
                 fputs("\xe2\x96\x91", stdout);
 
-        printf(" %3"PRIu64"%%", 100U * p / 65535U);
+        printf(" %3u%%", 100U * p / 65535U);
 
         fputs("\r\x1B[?25h", stdout);
         fflush(stdout);
 }
 
-static void flush_progress(void) {
+void journal_verify_flush_progress(void) {
         unsigned n, i;
 
-        if (!on_tty())
+        if (!__atomic_exchange_n(&progress_drawn, false, __ATOMIC_RELAXED))
                 return;
 
         n = (3 * columns()) / 4;
@@ -85,19 +103,20 @@ static void flush_progress(void) {
         fflush(stdout);
 }
 
-#define debug(_offset, _fmt, ...) do{                                   \
-                flush_progress();                                       \
-                log_debug(OFSfmt": " _fmt, _offset, ##__VA_ARGS__);     \
+/* Files may be verified in parallel, so every message names its file */
+#define debug(_f, _offset, _fmt, ...) do{                               \
+                journal_verify_flush_progress();                        \
+                log_debug("%s:"OFSfmt": " _fmt, (_f)->path, (uint64_t)_offset, ##__VA_ARGS__); \
         } while(0)
 
-#define warning(_offset, _fmt, ...) do{                                 \
-                flush_progress();                                       \
-                log_warning(OFSfmt": " _fmt, _offset, ##__VA_ARGS__);   \
+#define warning(_f, _offset, _fmt, ...) do{                             \
+                journal_verify_flush_progress();                        \
+                log_warning("%s:"OFSfmt": " _fmt, (_f)->path, (uint64_t)_offset, ##__VA_ARGS__); \
         } while(0)
 
-#define error(_offset, _fmt, ...) do{                                   \
-                flush_progress();                                       \
-                log_error(OFSfmt": " _fmt, (uint64_t)_offset, ##__VA_ARGS__); \
+#define error(_f, _offset, _fmt, ...) do{                               \
+                journal_verify_flush_progress();                        \
+                log_error("%s:"OFSfmt": " _fmt, (_f)->path, (uint64_t)_offset, ##__VA_ARGS__); \
         } while(0)
 
 static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o) {
@@ -122,15 +141,15 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                 int compression, r;
 
                 if (le64toh(o->data.entry_offset) == 0)
-                        warning(offset, "unused data (entry_offset==0)");
+                        warning(f, offset, "unused data (entry_offset==0)");
 
                 if ((le64toh(o->data.entry_offset) == 0) ^ (le64toh(o->data.n_entries) == 0)) {
-                        error(offset, "bad n_entries: %"PRIu64, o->data.n_entries);
+                        error(f, offset, "bad n_entries: %"PRIu64, o->data.n_entries);
                         return -EBADMSG;
                 }
 
                 if (le64toh(o->object.size) - offsetof(DataObject, payload) <= 0) {
-                        error(offset, "bad object size (<= %zu): %"PRIu64,
+                        error(f, offset, "bad object size (<= %zu): %"PRIu64,
                               offsetof(DataObject, payload),
                               le64toh(o->object.size));
                         return -EBADMSG;
@@ -148,7 +167,7 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                                             le64toh(o->object.size) - offsetof(Object, data.payload),
                                             &b, &alloc, &b_size, 0);
                         if (r < 0) {
-                                error(offset, "%s decompression failed: %s",
+                                error(f, offset, "%s decompression failed: %s",
                                       object_compressed_to_string(compression), strerror(-r));
                                 return r;
                         }
@@ -158,7 +177,7 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                         hash64(o->data.payload, le64toh(o->object.size) - offsetof(Object, data.payload), &h2);
 
                 if (h1 != h2) {
-                        error(offset, "invalid hash (%08"PRIx64" vs. %08"PRIx64, h1, h2);
+                        error(f, offset, "invalid hash (%08"PRIx64" vs. %08"PRIx64, h1, h2);
                         return -EBADMSG;
                 }
 
@@ -166,7 +185,7 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                     !VALID64(o->data.next_field_offset) ||
                     !VALID64(o->data.entry_offset) ||
                     !VALID64(o->data.entry_array_offset)) {
-                        error(offset, "invalid offset (next_hash_offset="OFSfmt", next_field_offset="OFSfmt", entry_offset="OFSfmt", entry_array_offset="OFSfmt,
+                        error(f, offset, "invalid offset (next_hash_offset="OFSfmt", next_field_offset="OFSfmt", entry_offset="OFSfmt", entry_array_offset="OFSfmt,
                               o->data.next_hash_offset,
                               o->data.next_field_offset,
                               o->data.entry_offset,
@@ -179,7 +198,7 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
 
         case OBJECT_FIELD:
                 if (le64toh(o->object.size) - offsetof(FieldObject, payload) <= 0) {
-                        error(offset,
+                        error(f, offset,
                               "bad field size (<= %zu): %"PRIu64,
                               offsetof(FieldObject, payload),
                               le64toh(o->object.size));
@@ -188,7 +207,7 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
 
                 if (!VALID64(o->field.next_hash_offset) ||
                     !VALID64(o->field.head_data_offset)) {
-                        error(offset,
+                        error(f, offset,
                               "invalid offset (next_hash_offset="OFSfmt", head_data_offset="OFSfmt,
                               o->field.next_hash_offset,
                               o->field.head_data_offset);
@@ -198,7 +217,7 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
 
         case OBJECT_ENTRY:
                 if ((le64toh(o->object.size) - offsetof(EntryObject, items)) % sizeof(EntryItem) != 0) {
-                        error(offset,
+                        error(f, offset,
                               "bad entry size (<= %zu): %"PRIu64,
                               offsetof(EntryObject, items),
                               le64toh(o->object.size));
@@ -206,28 +225,28 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                 }
 
                 if ((le64toh(o->object.size) - offsetof(EntryObject, items)) / sizeof(EntryItem) <= 0) {
-                        error(offset,
+                        error(f, offset,
                               "invalid number items in entry: %"PRIu64,
                               (le64toh(o->object.size) - offsetof(EntryObject, items)) / sizeof(EntryItem));
                         return -EBADMSG;
                 }
 
                 if (le64toh(o->entry.seqnum) <= 0) {
-                        error(offset,
+                        error(f, offset,
                               "invalid entry seqnum: %"PRIx64,
                               le64toh(o->entry.seqnum));
                         return -EBADMSG;
                 }
 
                 if (!VALID_REALTIME(le64toh(o->entry.realtime))) {
-                        error(offset,
+                        error(f, offset,
                               "invalid entry realtime timestamp: %"PRIu64,
                               le64toh(o->entry.realtime));
                         return -EBADMSG;
                 }
 
                 if (!VALID_MONOTONIC(le64toh(o->entry.monotonic))) {
-                        error(offset,
+                        error(f, offset,
                               "invalid entry monotonic timestamp: %"PRIu64,
                               le64toh(o->entry.monotonic));
                         return -EBADMSG;
@@ -236,7 +255,7 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                 for (i = 0; i < journal_file_entry_n_items(o); i++) {
                         if (o->entry.items[i].object_offset == 0 ||
                             !VALID64(o->entry.items[i].object_offset)) {
-                                error(offset,
+                                error(f, offset,
                                       "invalid entry item (%"PRIu64"/%"PRIu64" offset: "OFSfmt,
                                       i, journal_file_entry_n_items(o),
                                       o->entry.items[i].object_offset);
@@ -248,11 +267,13 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
 
         case OBJECT_DATA_HASH_TABLE:
         case OBJECT_FIELD_HASH_TABLE:
+        case OBJECT_TOKEN_HASH_TABLE:
                 if ((le64toh(o->object.size) - offsetof(HashTableObject, items)) % sizeof(HashItem) != 0 ||
                     (le64toh(o->object.size) - offsetof(HashTableObject, items)) / sizeof(HashItem) <= 0) {
-                        error(offset,
+                        error(f, offset,
                               "invalid %s hash table size: %"PRIu64,
-                              o->object.type == OBJECT_DATA_HASH_TABLE ? "data" : "field",
+                              o->object.type == OBJECT_DATA_HASH_TABLE ? "data" :
+                              o->object.type == OBJECT_FIELD_HASH_TABLE ? "field" : "token",
                               le64toh(o->object.size));
                         return -EBADMSG;
                 }
@@ -260,18 +281,20 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                 for (i = 0; i < journal_file_hash_table_n_items(o); i++) {
                         if (o->hash_table.items[i].head_hash_offset != 0 &&
                             !VALID64(le64toh(o->hash_table.items[i].head_hash_offset))) {
-                                error(offset,
+                                error(f, offset,
                                       "invalid %s hash table item (%"PRIu64"/%"PRIu64") head_hash_offset: "OFSfmt,
-                                      o->object.type == OBJECT_DATA_HASH_TABLE ? "data" : "field",
+                                      o->object.type == OBJECT_DATA_HASH_TABLE ? "data" :
+                                      o->object.type == OBJECT_FIELD_HASH_TABLE ? "field" : "token",
                                       i, journal_file_hash_table_n_items(o),
                                       le64toh(o->hash_table.items[i].head_hash_offset));
                                 return -EBADMSG;
                         }
                         if (o->hash_table.items[i].tail_hash_offset != 0 &&
                             !VALID64(le64toh(o->hash_table.items[i].tail_hash_offset))) {
-                                error(offset,
+                                error(f, offset,
                                       "invalid %s hash table item (%"PRIu64"/%"PRIu64") tail_hash_offset: "OFSfmt,
-                                      o->object.type == OBJECT_DATA_HASH_TABLE ? "data" : "field",
+                                      o->object.type == OBJECT_DATA_HASH_TABLE ? "data" :
+                                      o->object.type == OBJECT_FIELD_HASH_TABLE ? "field" : "token",
                                       i, journal_file_hash_table_n_items(o),
                                       le64toh(o->hash_table.items[i].tail_hash_offset));
                                 return -EBADMSG;
@@ -279,9 +302,10 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
 
                         if ((o->hash_table.items[i].head_hash_offset != 0) !=
                             (o->hash_table.items[i].tail_hash_offset != 0)) {
-                                error(offset,
+                                error(f, offset,
                                       "invalid %s hash table item (%"PRIu64"/%"PRIu64"): head_hash_offset="OFSfmt" tail_hash_offset="OFSfmt,
-                                      o->object.type == OBJECT_DATA_HASH_TABLE ? "data" : "field",
+                                      o->object.type == OBJECT_DATA_HASH_TABLE ? "data" :
+                                      o->object.type == OBJECT_FIELD_HASH_TABLE ? "field" : "token",
                                       i, journal_file_hash_table_n_items(o),
                                       le64toh(o->hash_table.items[i].head_hash_offset),
                                       le64toh(o->hash_table.items[i].tail_hash_offset));
@@ -294,14 +318,14 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
         case OBJECT_ENTRY_ARRAY:
                 if ((le64toh(o->object.size) - offsetof(EntryArrayObject, items)) % sizeof(le64_t) != 0 ||
                     (le64toh(o->object.size) - offsetof(EntryArrayObject, items)) / sizeof(le64_t) <= 0) {
-                        error(offset,
+                        error(f, offset,
                               "invalid object entry array size: %"PRIu64,
                               le64toh(o->object.size));
                         return -EBADMSG;
                 }
 
                 if (!VALID64(o->entry_array.next_entry_array_offset)) {
-                        error(offset,
+                        error(f, offset,
                               "invalid object entry array next_entry_array_offset: "OFSfmt,
                               o->entry_array.next_entry_array_offset);
                         return -EBADMSG;
@@ -310,7 +334,7 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                 for (i = 0; i < journal_file_entry_array_n_items(o); i++)
                         if (le64toh(o->entry_array.items[i]) != 0 &&
                             !VALID64(le64toh(o->entry_array.items[i]))) {
-                                error(offset,
+                                error(f, offset,
                                       "invalid object entry array item (%"PRIu64"/%"PRIu64"): "OFSfmt,
                                       i, journal_file_entry_array_n_items(o),
                                       le64toh(o->entry_array.items[i]));
@@ -318,61 +342,101 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                         }
 
                 break;
+
+        case OBJECT_BLOOM:
+                if ((le64toh(o->object.size) - offsetof(BloomObject, bits)) % 64 != 0 ||
+                    (le64toh(o->object.size) - offsetof(BloomObject, bits)) <= 0) {
+                        error(f, offset,
+                              "invalid bloom filter size: %"PRIu64,
+                              le64toh(o->object.size));
+                        return -EBADMSG;
+                }
+
+                break;
+
+        case OBJECT_TOKEN:
+                if (le64toh(o->object.size) != sizeof(TokenObject)) {
+                        error(f, offset,
+                              "invalid token size: %"PRIu64,
+                              le64toh(o->object.size));
+                        return -EBADMSG;
+                }
+
+                if (le64toh(o->token.n_data) <= 0 ||
+                    !VALID64(le64toh(o->token.data_offset)) ||
+                    !VALID64(le64toh(o->token.data_array_offset)) ||
+                    !VALID64(le64toh(o->token.next_hash_offset)) ||
+                    (le64toh(o->token.n_data) > 1) != (o->token.data_array_offset != 0)) {
+                        error(f, offset,
+                              "invalid token object: n_data=%"PRIu64" data_offset="OFSfmt" data_array_offset="OFSfmt" next_hash_offset="OFSfmt,
+                              le64toh(o->token.n_data),
+                              le64toh(o->token.data_offset),
+                              le64toh(o->token.data_array_offset),
+                              le64toh(o->token.next_hash_offset));
+                        return -EBADMSG;
+                }
+
+                break;
         }
 
         return 0;
 }
 
-static int write_uint64(int fd, uint64_t p) {
-        ssize_t k;
+static void report_progress(const VerifyProgress *progress, unsigned p) {
+        if (progress->callback)
+                progress->callback(p, progress->userdata);
+}
 
-        k = write(fd, &p, sizeof(p));
-        if (k < 0)
-                return -errno;
-        if (k != sizeof(p))
-                return -EIO;
+static int offset_set_reserve(OffsetSet *s, uint64_t n) {
+        if (!GREEDY_REALLOC(s->items, s->allocated, n))
+                return -ENOMEM;
 
         return 0;
 }
 
-static int contains_uint64(MMapCache *m, int fd, uint64_t n, uint64_t p) {
-        uint64_t a, b;
+static int offset_set_add(OffsetSet *s, uint64_t p) {
         int r;
 
-        assert(m);
-        assert(fd >= 0);
+        assert(s);
+        assert(s->n == 0 || s->items[s->n - 1] < p);
 
-        /* Bisection ... */
+        r = offset_set_reserve(s, s->n + 1);
+        if (r < 0)
+                return r;
 
-        a = 0; b = n;
-        while (a < b) {
-                uint64_t c, *z;
+        s->items[s->n++] = p;
 
-                c = (a + b) / 2;
+        return 0;
+}
 
-                r = mmap_cache_get(m, fd, PROT_READ|PROT_WRITE, 0, false, c * sizeof(uint64_t), sizeof(uint64_t), NULL, (void **) &z);
-                if (r < 0)
-                        return r;
+static bool offset_set_contains(const OffsetSet *s, uint64_t p) {
+        uint64_t a = 0, b = s->n;
 
-                if (*z == p)
-                        return 1;
+        assert(s);
+
+        while (a < b) {
+                uint64_t c = (a + b) / 2;
 
-                if (a + 1 >= b)
-                        return 0;
+                if (s->items[c] == p)
+                        return true;
 
-                if (p < *z)
+                if (p < s->items[c])
                         b = c;
                 else
-                        a = c;
+                        a = c + 1;
         }
 
-        return 0;
+        return false;
+}
+
+static void offset_set_done(OffsetSet *s) {
+        free(s->items);
+        zero(*s);
 }
 
 static int entry_points_to_data(
                 JournalFile *f,
-                int entry_fd,
-                uint64_t n_entries,
+                const OffsetSet *entries,
                 uint64_t entry_p,
                 uint64_t data_p) {
 
@@ -382,10 +446,10 @@ static int entry_points_to_data(
         bool found = false;
 
         assert(f);
-        assert(entry_fd >= 0);
+        assert(entries);
 
-        if (!contains_uint64(f->mmap, entry_fd, n_entries, entry_p)) {
-                error(data_p,
+        if (!offset_set_contains(entries, entry_p)) {
+                error(f, data_p,
                       "data object references invalid entry at "OFSfmt, entry_p);
                 return -EBADMSG;
         }
@@ -402,7 +466,7 @@ static int entry_points_to_data(
                 }
 
         if (!found) {
-                error(entry_p,
+                error(f, entry_p,
                       "data object at "OFSfmt" not referenced by linked entry", data_p);
                 return -EBADMSG;
         }
@@ -446,7 +510,7 @@ static int entry_points_to_data(
                                         x = z;
                         }
 
-                        error(entry_p, "entry object doesn't exist in main entry array");
+                        error(f, entry_p, "entry object doesn't exist in main entry array");
                         return -EBADMSG;
                 }
 
@@ -460,23 +524,23 @@ static int entry_points_to_data(
 static int verify_data(
                 JournalFile *f,
                 Object *o, uint64_t p,
-                int entry_fd, uint64_t n_entries,
-                int entry_array_fd, uint64_t n_entry_arrays) {
+                const OffsetSet *entries,
+                const OffsetSet *entry_arrays) {
 
         uint64_t i, n, a, last, q;
         int r;
 
         assert(f);
         assert(o);
-        assert(entry_fd >= 0);
-        assert(entry_array_fd >= 0);
+        assert(entries);
+        assert(entry_arrays);
 
         n = le64toh(o->data.n_entries);
         a = le64toh(o->data.entry_array_offset);
 
         /* Entry array means at least two objects */
         if (a && n < 2) {
-                error(p,
+                error(f, p,
                       "entry array present (entry_array_offset="OFSfmt", but n_entries=%"PRIu64")",
                       a, n);
                 return -EBADMSG;
@@ -489,7 +553,7 @@ static int verify_data(
         assert(o->data.entry_offset);
 
         last = q = le64toh(o->data.entry_offset);
-        r = entry_points_to_data(f, entry_fd, n_entries, q, p);
+        r = entry_points_to_data(f, entries, q, p);
         if (r < 0)
                 return r;
 
@@ -498,12 +562,12 @@ static int verify_data(
                 uint64_t next, m, j;
 
                 if (a == 0) {
-                        error(p, "array chain too short");
+                        error(f, p, "array chain too short");
                         return -EBADMSG;
                 }
 
-                if (!contains_uint64(f->mmap, entry_array_fd, n_entry_arrays, a)) {
-                        error(p, "invalid array offset "OFSfmt, a);
+                if (!offset_set_contains(entry_arrays, a)) {
+                        error(f, p, "invalid array offset "OFSfmt, a);
                         return -EBADMSG;
                 }
 
@@ -513,7 +577,7 @@ static int verify_data(
 
                 next = le64toh(o->entry_array.next_entry_array_offset);
                 if (next != 0 && next <= a) {
-                        error(p, "array chain has cycle (jumps back from "OFSfmt" to "OFSfmt")",
+                        error(f, p, "array chain has cycle (jumps back from "OFSfmt" to "OFSfmt")",
                               a, next);
                         return -EBADMSG;
                 }
@@ -523,12 +587,12 @@ static int verify_data(
 
                         q = le64toh(o->entry_array.items[j]);
                         if (q <= last) {
-                                error(p, "data object's entry array not sorted");
+                                error(f, p, "data object's entry array not sorted");
                                 return -EBADMSG;
                         }
                         last = q;
 
-                        r = entry_points_to_data(f, entry_fd, n_entries, q, p);
+                        r = entry_points_to_data(f, entries, q, p);
                         if (r < 0)
                                 return r;
 
@@ -546,35 +610,33 @@ static int verify_data(
 
 static int verify_hash_table(
                 JournalFile *f,
-                int data_fd, uint64_t n_data,
-                int entry_fd, uint64_t n_entries,
-                int entry_array_fd, uint64_t n_entry_arrays,
-                usec_t *last_usec,
-                bool show_progress) {
+                const OffsetSet *data,
+                const OffsetSet *entries,
+                const OffsetSet *entry_arrays,
+                const VerifyProgress *progress) {
 
         uint64_t i, n;
         int r;
 
         assert(f);
-        assert(data_fd >= 0);
-        assert(entry_fd >= 0);
-        assert(entry_array_fd >= 0);
-        assert(last_usec);
+        assert(data);
+        assert(entries);
+        assert(entry_arrays);
+        assert(progress);
 
         n = le64toh(f->header->data_hash_table_size) / sizeof(HashItem);
         for (i = 0; i < n; i++) {
                 uint64_t last = 0, p;
 
-                if (show_progress)
-                        draw_progress(0xC000 + (0x3FFF * i / n), last_usec);
+                report_progress(progress, 0xC000 + (0x3FFF * i / n));
 
                 p = le64toh(f->data_hash_table[i].head_hash_offset);
                 while (p != 0) {
                         Object *o;
                         uint64_t next;
 
-                        if (!contains_uint64(f->mmap, data_fd, n_data, p)) {
-                                error(p, "invalid data object at hash entry %"PRIu64" of %"PRIu64,
+                        if (!offset_set_contains(data, p)) {
+                                error(f, p, "invalid data object at hash entry %"PRIu64" of %"PRIu64,
                                       i, n);
                                 return -EBADMSG;
                         }
@@ -585,18 +647,18 @@ static int verify_hash_table(
 
                         next = le64toh(o->data.next_hash_offset);
                         if (next != 0 && next <= p) {
-                                error(p, "hash chain has a cycle in hash entry %"PRIu64" of %"PRIu64,
+                                error(f, p, "hash chain has a cycle in hash entry %"PRIu64" of %"PRIu64,
                                       i, n);
                                 return -EBADMSG;
                         }
 
                         if (le64toh(o->data.hash) % n != i) {
-                                error(p, "hash value mismatch in hash entry %"PRIu64" of %"PRIu64,
+                                error(f, p, "hash value mismatch in hash entry %"PRIu64" of %"PRIu64,
                                       i, n);
                                 return -EBADMSG;
                         }
 
-                        r = verify_data(f, o, p, entry_fd, n_entries, entry_array_fd, n_entry_arrays);
+                        r = verify_data(f, o, p, entries, entry_arrays);
                         if (r < 0)
                                 return r;
 
@@ -605,7 +667,7 @@ static int verify_hash_table(
                 }
 
                 if (last != le64toh(f->data_hash_table[i].tail_hash_offset)) {
-                        error(p, "tail hash pointer mismatch in hash table");
+                        error(f, p, "tail hash pointer mismatch in hash table");
                         return -EBADMSG;
                 }
         }
@@ -641,14 +703,14 @@ static int data_object_in_hash_table(JournalFile *f, uint64_t hash, uint64_t p)
 static int verify_entry(
                 JournalFile *f,
                 Object *o, uint64_t p,
-                int data_fd, uint64_t n_data) {
+                const OffsetSet *data) {
 
         uint64_t i, n;
         int r;
 
         assert(f);
         assert(o);
-        assert(data_fd >= 0);
+        assert(data);
 
         n = journal_file_entry_n_items(o);
         for (i = 0; i < n; i++) {
@@ -658,8 +720,8 @@ static int verify_entry(
                 q = le64toh(o->entry.items[i].object_offset);
                 h = le64toh(o->entry.items[i].hash);
 
-                if (!contains_uint64(f->mmap, data_fd, n_data, q)) {
-                        error(p, "invalid data object of entry");
+                if (!offset_set_contains(data, q)) {
+                        error(f, p, "invalid data object of entry");
                                 return -EBADMSG;
                         }
 
@@ -668,7 +730,7 @@ static int verify_entry(
                         return r;
 
                 if (le64toh(u->data.hash) != h) {
-                        error(p, "hash mismatch for data object of entry");
+                        error(f, p, "hash mismatch for data object of entry");
                         return -EBADMSG;
                 }
 
@@ -676,7 +738,7 @@ static int verify_entry(
                 if (r < 0)
                         return r;
                 if (r == 0) {
-                        error(p, "data object missing from hash table");
+                        error(f, p, "data object missing from hash table");
                         return -EBADMSG;
                 }
         }
@@ -686,20 +748,19 @@ static int verify_entry(
 
 static int verify_entry_array(
                 JournalFile *f,
-                int data_fd, uint64_t n_data,
-                int entry_fd, uint64_t n_entries,
-                int entry_array_fd, uint64_t n_entry_arrays,
-                usec_t *last_usec,
-                bool show_progress) {
+                const OffsetSet *data,
+                const OffsetSet *entries,
+                const OffsetSet *entry_arrays,
+                const VerifyProgress *progress) {
 
         uint64_t i = 0, a, n, last = 0;
         int r;
 
         assert(f);
-        assert(data_fd >= 0);
-        assert(entry_fd >= 0);
-        assert(entry_array_fd >= 0);
-        assert(last_usec);
+        assert(data);
+        assert(entries);
+        assert(entry_arrays);
+        assert(progress);
 
         n = le64toh(f->header->n_entries);
         a = le64toh(f->header->entry_array_offset);
@@ -707,16 +768,15 @@ static int verify_entry_array(
                 uint64_t next, m, j;
                 Object *o;
 
-                if (show_progress)
-                        draw_progress(0x8000 + (0x3FFF * i / n), last_usec);
+                report_progress(progress, 0x8000 + (0x3FFF * i / n));
 
                 if (a == 0) {
-                        error(a, "array chain too short at %"PRIu64" of %"PRIu64, i, n);
+                        error(f, a, "array chain too short at %"PRIu64" of %"PRIu64, i, n);
                         return -EBADMSG;
                 }
 
-                if (!contains_uint64(f->mmap, entry_array_fd, n_entry_arrays, a)) {
-                        error(a, "invalid array %"PRIu64" of %"PRIu64, i, n);
+                if (!offset_set_contains(entry_arrays, a)) {
+                        error(f, a, "invalid array %"PRIu64" of %"PRIu64, i, n);
                         return -EBADMSG;
                 }
 
@@ -726,7 +786,7 @@ static int verify_entry_array(
 
                 next = le64toh(o->entry_array.next_entry_array_offset);
                 if (next != 0 && next <= a) {
-                        error(a,
+                        error(f, a,
                               "array chain has cycle at %"PRIu64" of %"PRIu64" (jumps back from to "OFSfmt")",
                               i, n, next);
                         return -EBADMSG;
@@ -738,14 +798,14 @@ static int verify_entry_array(
 
                         p = le64toh(o->entry_array.items[j]);
                         if (p <= last) {
-                                error(a, "entry array not sorted at %"PRIu64" of %"PRIu64,
+                                error(f, a, "entry array not sorted at %"PRIu64" of %"PRIu64,
                                       i, n);
                                 return -EBADMSG;
                         }
                         last = p;
 
-                        if (!contains_uint64(f->mmap, entry_fd, n_entries, p)) {
-                                error(a, "invalid array entry at %"PRIu64" of %"PRIu64,
+                        if (!offset_set_contains(entries, p)) {
+                                error(f, a, "invalid array entry at %"PRIu64" of %"PRIu64,
                                       i, n);
                                 return -EBADMSG;
                         }
@@ -754,7 +814,7 @@ static int verify_entry_array(
                         if (r < 0)
                                 return r;
 
-                        r = verify_entry(f, o, p, data_fd, n_data);
+                        r = verify_entry(f, o, p, data);
                         if (r < 0)
                                 return r;
 
@@ -770,9 +830,16 @@ static int verify_entry_array(
         return 0;
 }
 
-int journal_file_verify(
+/* Makes room for the offsets the header announces, as far as the file
+ * could hold that many objects */
+static int reserve_offsets(JournalFile *f, OffsetSet *s, uint64_t n) {
+        return offset_set_reserve(s, MIN(n, le64toh(f->header->tail_object_offset) / sizeof(ObjectHeader) + 1));
+}
+
+int journal_file_verify_with_progress(
                 JournalFile *f,
-                bool show_progress) {
+                journal_verify_progress_t callback,
+                void *userdata) {
         int r;
         Object *o;
         uint64_t p = 0;
@@ -780,50 +847,38 @@ int journal_file_verify(
         uint64_t entry_seqnum = 0, entry_monotonic = 0, entry_realtime = 0;
         uuid_t entry_boot_id;
         bool entry_seqnum_set = false, entry_monotonic_set = false, entry_realtime_set = false, found_main_entry_array = false;
-        uint64_t n_weird = 0, n_objects = 0, n_entries = 0, n_data = 0, n_fields = 0, n_data_hash_tables = 0, n_field_hash_tables = 0, n_entry_arrays = 0;
-        usec_t last_usec = 0;
-        char data_fn[] = "/var/tmp/journal-verify-data-XXXXXX";
-        char entry_fn[] = "/var/tmp/journal-verify-entry-XXXXXX";
-        char entry_array_fn[] = "/var/tmp/journal-verify-entry-array-XXXXXX";
-        int data_fd = -1, entry_fd = -1, entry_array_fd = -1;
+        uint64_t n_weird = 0, n_objects = 0, n_entries = 0, n_data = 0, n_fields = 0, n_data_hash_tables = 0, n_field_hash_tables = 0, n_entry_arrays = 0, n_blooms = 0, n_tokens = 0, n_token_hash_tables = 0;
+        VerifyProgress progress = {
+                .callback = callback,
+                .userdata = userdata,
+        };
+        OffsetSet data = {}, entries = {}, entry_arrays = {};
         unsigned i;
         bool found_last;
         assert(f);
 
-        data_fd = mkstemp(data_fn);
-        if (data_fd < 0) {
-                log_error("Failed to create data file: %m");
-                r = -errno;
-                goto fail;
-        }
-        unlink(data_fn);
-
-        entry_fd = mkstemp(entry_fn);
-        if (entry_fd < 0) {
-                log_error("Failed to create entry file: %m");
-                r = -errno;
+        /* The offsets are kept in memory, a few bytes for every
+         * object of the file */
+        r = reserve_offsets(f, &entries, le64toh(f->header->n_entries));
+        if (r >= 0 && JOURNAL_HEADER_CONTAINS(f->header, n_data))
+                r = reserve_offsets(f, &data, le64toh(f->header->n_data));
+        if (r >= 0 && JOURNAL_HEADER_CONTAINS(f->header, n_entry_arrays))
+                r = reserve_offsets(f, &entry_arrays, le64toh(f->header->n_entry_arrays));
+        if (r < 0) {
+                log_oom();
                 goto fail;
         }
-        unlink(entry_fn);
 
-        entry_array_fd = mkstemp(entry_array_fn);
-        if (entry_array_fd < 0) {
-                log_error("Failed to create entry array file: %m");
-                r = -errno;
-                goto fail;
-        }
-        unlink(entry_array_fn);
-
-        if (f->header->compatible_flags != 0)
+        if (le32toh(f->header->compatible_flags) & ~HEADER_COMPATIBLE_SUPPORTED)
         {
-                log_error("Cannot verify file with unknown extensions.");
+                log_error("Cannot verify %s with unknown extensions.", f->path);
                 r = -ENOTSUP;
                 goto fail;
         }
 
         for (i = 0; i < sizeof(f->header->reserved); i++)
                 if (f->header->reserved[i] != 0) {
-                        error(offsetof(Header, reserved[i]), "reserved field is non-zero");
+                        error(f, offsetof(Header, reserved[i]), "reserved field is non-zero");
                         r = -EBADMSG;
                         goto fail;
                 }
@@ -833,17 +888,16 @@ int journal_file_verify(
 
         p = le64toh(f->header->header_size);
         while (p != 0) {
-                if (show_progress)
-                        draw_progress(0x7FFF * p / le64toh(f->header->tail_object_offset), &last_usec);
+                report_progress(&progress, 0x7FFF * p / le64toh(f->header->tail_object_offset));
 
                 r = journal_file_move_to_object(f, -1, p, &o);
                 if (r < 0) {
-                        error(p, "invalid object");
+                        error(f, p, "invalid object");
                         goto fail;
                 }
 
                 if (p > le64toh(f->header->tail_object_offset)) {
-                        error(offsetof(Header, tail_object_offset), "invalid tail object pointer");
+                        error(f, offsetof(Header, tail_object_offset), "invalid tail object pointer");
                         r = -EBADMSG;
                         goto fail;
                 }
@@ -855,25 +909,25 @@ int journal_file_verify(
 
                 r = journal_file_object_verify(f, p, o);
                 if (r < 0) {
-                        error(p, "invalid object contents: %s", strerror(-r));
+                        error(f, p, "invalid object contents: %s", strerror(-r));
                         goto fail;
                 }
 
                 if ((o->object.flags & OBJECT_COMPRESSED_XZ) &&
                     (o->object.flags & OBJECT_COMPRESSED_LZ4)) {
-                        error(p, "objected with double compression");
+                        error(f, p, "objected with double compression");
                         r = -EINVAL;
                         goto fail;
                 }
 
                 if ((o->object.flags & OBJECT_COMPRESSED_XZ) && !JOURNAL_HEADER_COMPRESSED_XZ(f->header)) {
-                        error(p, "XZ compressed object in file without XZ compression");
+                        error(f, p, "XZ compressed object in file without XZ compression");
                         r = -EBADMSG;
                         goto fail;
                 }
 
                 if ((o->object.flags & OBJECT_COMPRESSED_LZ4) && !JOURNAL_HEADER_COMPRESSED_LZ4(f->header)) {
-                        error(p, "LZ4 compressed object in file without LZ4 compression");
+                        error(f, p, "LZ4 compressed object in file without LZ4 compression");
                         r = -EBADMSG;
                         goto fail;
                 }
@@ -881,10 +935,16 @@ int journal_file_verify(
                 switch (o->object.type) {
 
                 case OBJECT_DATA:
-                        r = write_uint64(data_fd, p);
+                        r = offset_set_add(&data, p);
                         if (r < 0)
                                 goto fail;
 
+                        if (!journal_file_bloom_may_contain(f, le64toh(o->data.hash))) {
+                                error(f, p, "data object missing from bloom filter");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
                         n_data++;
                         break;
 
@@ -893,20 +953,20 @@ int journal_file_verify(
                         break;
 
                 case OBJECT_ENTRY:
-                        r = write_uint64(entry_fd, p);
+                        r = offset_set_add(&entries, p);
                         if (r < 0)
                                 goto fail;
 
                         if (!entry_seqnum_set &&
                             le64toh(o->entry.seqnum) != le64toh(f->header->head_entry_seqnum)) {
-                                error(p, "head entry sequence number incorrect");
+                                error(f, p, "head entry sequence number incorrect");
                                 r = -EBADMSG;
                                 goto fail;
                         }
 
                         if (entry_seqnum_set &&
                             entry_seqnum >= le64toh(o->entry.seqnum)) {
-                                error(p, "entry sequence number out of synchronization");
+                                error(f, p, "entry sequence number out of synchronization");
                                 r = -EBADMSG;
                                 goto fail;
                         }
@@ -917,7 +977,7 @@ int journal_file_verify(
                         if (entry_monotonic_set &&
                             uuid_equal(entry_boot_id, o->entry.boot_id) &&
                             entry_monotonic > le64toh(o->entry.monotonic)) {
-                                log_error("Entry timestamp out of synchronization at "OFSfmt, p);
+                                error(f, p, "entry timestamp out of synchronization");
                                 r = -EBADMSG;
                                 goto fail;
                         }
@@ -928,7 +988,15 @@ int journal_file_verify(
 
                         if (!entry_realtime_set &&
                             le64toh(o->entry.realtime) != le64toh(f->header->head_entry_realtime)) {
-                                error(p, "head entry realtime timestamp incorrect");
+                                error(f, p, "head entry realtime timestamp incorrect");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        if (entry_realtime_set &&
+                            JOURNAL_HEADER_REALTIME_ORDERED(f->header) &&
+                            entry_realtime > le64toh(o->entry.realtime)) {
+                                error(f, p, "entry realtime timestamp out of order in realtime ordered file");
                                 r = -EBADMSG;
                                 goto fail;
                         }
@@ -941,14 +1009,14 @@ int journal_file_verify(
 
                 case OBJECT_DATA_HASH_TABLE:
                         if (n_data_hash_tables > 1) {
-                                error(p, "more than one data hash table");
+                                error(f, p, "more than one data hash table");
                                 r = -EBADMSG;
                                 goto fail;
                         }
 
                         if (le64toh(f->header->data_hash_table_offset) != p + offsetof(HashTableObject, items) ||
                             le64toh(f->header->data_hash_table_size) != le64toh(o->object.size) - offsetof(HashTableObject, items)) {
-                                error(p, "header fields for data hash table invalid");
+                                error(f, p, "header fields for data hash table invalid");
                                 r = -EBADMSG;
                                 goto fail;
                         }
@@ -958,14 +1026,14 @@ int journal_file_verify(
 
                 case OBJECT_FIELD_HASH_TABLE:
                         if (n_field_hash_tables > 1) {
-                                error(p, "more than one field hash table");
+                                error(f, p, "more than one field hash table");
                                 r = -EBADMSG;
                                 goto fail;
                         }
 
                         if (le64toh(f->header->field_hash_table_offset) != p + offsetof(HashTableObject, items) ||
                             le64toh(f->header->field_hash_table_size) != le64toh(o->object.size) - offsetof(HashTableObject, items)) {
-                                error(p, "header fields for field hash table invalid");
+                                error(f, p, "header fields for field hash table invalid");
                                 r = -EBADMSG;
                                 goto fail;
                         }
@@ -973,14 +1041,54 @@ int journal_file_verify(
                         n_field_hash_tables++;
                         break;
 
+                case OBJECT_BLOOM:
+                        if (n_blooms > 0) {
+                                error(f, p, "more than one bloom filter");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        if (!JOURNAL_HEADER_BLOOM(f->header) ||
+                            le64toh(f->header->bloom_offset) != p + offsetof(BloomObject, bits) ||
+                            le64toh(f->header->bloom_size) != le64toh(o->object.size) - offsetof(BloomObject, bits)) {
+                                error(f, p, "header fields for bloom filter invalid");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        n_blooms++;
+                        break;
+
+                case OBJECT_TOKEN:
+                        n_tokens++;
+                        break;
+
+                case OBJECT_TOKEN_HASH_TABLE:
+                        if (n_token_hash_tables > 0) {
+                                error(f, p, "more than one token hash table");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        if (!JOURNAL_HEADER_TOKENS(f->header) ||
+                            le64toh(f->header->token_hash_table_offset) != p + offsetof(HashTableObject, items) ||
+                            le64toh(f->header->token_hash_table_size) != le64toh(o->object.size) - offsetof(HashTableObject, items)) {
+                                error(f, p, "header fields for token hash table invalid");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        n_token_hash_tables++;
+                        break;
+
                 case OBJECT_ENTRY_ARRAY:
-                        r = write_uint64(entry_array_fd, p);
+                        r = offset_set_add(&entry_arrays, p);
                         if (r < 0)
                                 goto fail;
 
                         if (p == le64toh(f->header->entry_array_offset)) {
                                 if (found_main_entry_array) {
-                                        error(p, "more than one main entry array");
+                                        error(f, p, "more than one main entry array");
                                         r = -EBADMSG;
                                         goto fail;
                                 }
@@ -1002,65 +1110,85 @@ int journal_file_verify(
         }
 
         if (!found_last) {
-                error(le64toh(f->header->tail_object_offset), "tail object pointer dead");
+                error(f, le64toh(f->header->tail_object_offset), "tail object pointer dead");
                 r = -EBADMSG;
                 goto fail;
         }
 
         if (n_objects != le64toh(f->header->n_objects)) {
-                error(offsetof(Header, n_objects), "object number mismatch");
+                error(f, offsetof(Header, n_objects), "object number mismatch");
                 r = -EBADMSG;
                 goto fail;
         }
 
         if (n_entries != le64toh(f->header->n_entries)) {
-                error(offsetof(Header, n_entries), "entry number mismatch");
+                error(f, offsetof(Header, n_entries), "entry number mismatch");
                 r = -EBADMSG;
                 goto fail;
         }
 
         if (JOURNAL_HEADER_CONTAINS(f->header, n_data) &&
             n_data != le64toh(f->header->n_data)) {
-                error(offsetof(Header, n_data), "data number mismatch");
+                error(f, offsetof(Header, n_data), "data number mismatch");
                 r = -EBADMSG;
                 goto fail;
         }
 
         if (JOURNAL_HEADER_CONTAINS(f->header, n_fields) &&
             n_fields != le64toh(f->header->n_fields)) {
-                error(offsetof(Header, n_fields), "field number mismatch");
+                error(f, offsetof(Header, n_fields), "field number mismatch");
                 r = -EBADMSG;
                 goto fail;
         }
 
         if (JOURNAL_HEADER_CONTAINS(f->header, n_entry_arrays) &&
             n_entry_arrays != le64toh(f->header->n_entry_arrays)) {
-                error(offsetof(Header, n_entry_arrays), "entry array number mismatch");
+                error(f, offsetof(Header, n_entry_arrays), "entry array number mismatch");
                 r = -EBADMSG;
                 goto fail;
         }
 
         if (n_data_hash_tables != 1) {
-                error(0, "missing data hash table");
+                error(f, 0, "missing data hash table");
                 r = -EBADMSG;
                 goto fail;
         }
 
         if (n_field_hash_tables != 1) {
-                error(0, "missing field hash table");
+                error(f, 0, "missing field hash table");
                 r = -EBADMSG;
                 goto fail;
         }
 
+        if (JOURNAL_HEADER_BLOOM(f->header) && n_blooms != 1) {
+                error(f, 0, "missing bloom filter");
+                r = -EBADMSG;
+                goto fail;
+        }
+
+        if (JOURNAL_HEADER_TOKENS(f->header)) {
+                if (n_token_hash_tables != 1) {
+                        error(f, 0, "missing token hash table");
+                        r = -EBADMSG;
+                        goto fail;
+                }
+
+                if (n_tokens != le64toh(f->header->n_tokens)) {
+                        error(f, offsetof(Header, n_tokens), "token number mismatch");
+                        r = -EBADMSG;
+                        goto fail;
+                }
+        }
+
         if (!found_main_entry_array) {
-                error(0, "missing entry array");
+                error(f, 0, "missing entry array");
                 r = -EBADMSG;
                 goto fail;
         }
 
         if (entry_seqnum_set &&
             entry_seqnum != le64toh(f->header->tail_entry_seqnum)) {
-                error(offsetof(Header, tail_entry_seqnum), "invalid tail seqnum");
+                error(f, offsetof(Header, tail_entry_seqnum), "invalid tail seqnum");
                 r = -EBADMSG;
                 goto fail;
         }
@@ -1068,13 +1196,13 @@ int journal_file_verify(
         if (entry_monotonic_set &&
             (!uuid_equal(entry_boot_id, f->header->boot_id) ||
              entry_monotonic != le64toh(f->header->tail_entry_monotonic))) {
-                error(0, "invalid tail monotonic timestamp");
+                error(f, 0, "invalid tail monotonic timestamp");
                 r = -EBADMSG;
                 goto fail;
         }
 
         if (entry_realtime_set && entry_realtime != le64toh(f->header->tail_entry_realtime)) {
-                error(0, "invalid tail realtime timestamp");
+                error(f, 0, "invalid tail realtime timestamp");
                 r = -EBADMSG;
                 goto fail;
         }
@@ -1088,39 +1216,31 @@ int journal_file_verify(
          * referenced is consistent. */
 
         r = verify_entry_array(f,
-                               data_fd, n_data,
-                               entry_fd, n_entries,
-                               entry_array_fd, n_entry_arrays,
-                               &last_usec,
-                               show_progress);
+                               &data,
+                               &entries,
+                               &entry_arrays,
+                               &progress);
         if (r < 0)
                 goto fail;
 
         r = verify_hash_table(f,
-                              data_fd, n_data,
-                              entry_fd, n_entries,
-                              entry_array_fd, n_entry_arrays,
-                              &last_usec,
-                              show_progress);
+                              &data,
+                              &entries,
+                              &entry_arrays,
+                              &progress);
         if (r < 0)
                 goto fail;
 
-        if (show_progress)
-                flush_progress();
-
-        mmap_cache_close_fd(f->mmap, data_fd);
-        mmap_cache_close_fd(f->mmap, entry_fd);
-        mmap_cache_close_fd(f->mmap, entry_array_fd);
+        journal_verify_flush_progress();
 
-        safe_close(data_fd);
-        safe_close(entry_fd);
-        safe_close(entry_array_fd);
+        offset_set_done(&data);
+        offset_set_done(&entries);
+        offset_set_done(&entry_arrays);
 
         return 0;
 
 fail:
-        if (show_progress)
-                flush_progress();
+        journal_verify_flush_progress();
 
         log_error("File corruption detected at %s:"OFSfmt" (of %llu bytes, %"PRIu64"%%).",
                   f->path,
@@ -1128,22 +1248,17 @@ fail:
                   (unsigned long long) f->last_stat.st_size,
                   100 * p / f->last_stat.st_size);
 
-        if (data_fd >= 0) {
-                mmap_cache_close_fd(f->mmap, data_fd);
-                safe_close(data_fd);
-        }
+        offset_set_done(&data);
+        offset_set_done(&entries);
+        offset_set_done(&entry_arrays);
 
-        if (entry_fd >= 0) {
-                mmap_cache_close_fd(f->mmap, entry_fd);
-                safe_close(entry_fd);
-        }
+        return r;
+}
 
-        if (entry_array_fd >= 0) {
-                mmap_cache_close_fd(f->mmap, entry_array_fd);
-                safe_close(entry_array_fd);
-        }
+int journal_file_verify(JournalFile *f, bool show_progress) {
+        usec_t last_usec = 0;
 
-        return r;
+        return journal_file_verify_with_progress(f, show_progress ? journal_verify_draw_progress : NULL, &last_usec);
 }
 
 
@@ -1155,9 +1270,16 @@ fail:
 #define N_ENTRIES 6000
 #define RANDOM_RANGE 77
 
+static void test_progress(unsigned p, void *userdata) {
+        unsigned *last = userdata;
+
+        assert_se(p >= *last);
+        *last = p;
+}
+
 int main(int argc, char *argv[]) {
         char t[] = "/tmp/journal-XXXXXX";
-        unsigned n;
+        unsigned n, progress = 0;
         JournalFile *f;
 
         log_set_max_level(LOG_DEBUG);
@@ -1167,7 +1289,7 @@ int main(int argc, char *argv[]) {
 
         log_info("Generating...");
 
-        assert_se(journal_file_open("test.journal", O_RDWR|O_CREAT, 0666, true, NULL, NULL, NULL, &f) == 0);
+        assert_se(journal_file_open("test.journal", O_RDWR|O_CREAT, 0666, true, false, NULL, NULL, NULL, &f) == 0);
 
         for (n = 0; n < N_ENTRIES; n++) {
                 struct iovec iovec;
@@ -1190,12 +1312,16 @@ int main(int argc, char *argv[]) {
 
         log_info("Verifying...");
 
-        assert_se(journal_file_open("test.journal", O_RDONLY, 0666, true, NULL, NULL, NULL, &f) == 0);
+        assert_se(journal_file_open("test.journal", O_RDONLY, 0666, true, false, NULL, NULL, NULL, &f) == 0);
         /* journal_file_print_header(f); */
         journal_file_dump(f);
 
         assert_se(journal_file_verify(f, true) >= 0);
 
+        /* Progress only goes forward, and gets close to the end */
+        assert_se(journal_file_verify_with_progress(f, test_progress, &progress) >= 0);
+        assert_se(progress > 65535U / 2);
+
         journal_file_close(f);
 
         log_info("Exiting...");
@@ -23,4 +23,17 @@
 
 #include "journal-file.h"
 
+/* Receives the share of the file verified so far, from 0 to 65535 */
+typedef void (*journal_verify_progress_t)(unsigned p, void *userdata);
+
 int journal_file_verify(JournalFile *f, bool show_progress);
+
+/* Draws a progress bar on the terminal, at most every 40ms as noted in
+ * the usec_t passed, or clears it. Used by journal_file_verify(). */
+void journal_verify_draw_progress(unsigned p, void *userdata);
+void journal_verify_flush_progress(void);
+
+/* Reports the progress to the callback instead of drawing it. Several
+ * files may be verified at once in threads of their own, each with a
+ * JournalFile and MMapCache of its own. */
+int journal_file_verify_with_progress(JournalFile *f, journal_verify_progress_t callback, void *userdata);
@@ -35,6 +35,7 @@
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include <linux/fs.h>
+#include <pthread.h>
 
 #include "journal.h"
 
@@ -48,6 +49,7 @@
 #include "journal-internal.h"
 #include "journal-def.h"
 #include "journal-verify.h"
+#include "journal-filter.h"
 
 #define DEFAULT_FSS_INTERVAL_USEC (15*USEC_PER_MINUTE)
 
@@ -71,11 +73,22 @@ static bool arg_show_cursor = false;
 static const char *arg_directory = NULL;
 static char *arg_file = NULL;
 static int arg_priorities = 0xFF;
+static const char *arg_filter = NULL;
+static const char *arg_grep = NULL;
 static usec_t arg_since, arg_until;
 static bool arg_since_set = false, arg_until_set = false;
 static const char *arg_field = NULL;
 static bool arg_reverse = false;
 static int arg_journal_type = 0;
+static unsigned arg_threads = 0;
+static bool arg_unordered = false;
+static usec_t arg_poll_interval = 0;
+
+/* With --threads=, the time range of the journal is split into this
+ * many chunks per thread, and threads may run this many chunks per
+ * thread ahead of the output */
+#define SCAN_CHUNKS_PER_THREAD 16U
+#define SCAN_CHUNKS_AHEAD 2U
 
 static enum {
         ACTION_SHOW,
@@ -150,21 +163,26 @@ static void help(void) {
                "     --list-boots          Show terse information about recorded boots\n"
                "  -k --dmesg               Show kernel message log from the current boot\n"
                "  -p --priority=RANGE      Show only messages within the specified priority range\n"
+               "     --filter=EXPR         Show only entries matching the filter expression\n"
+               "     --grep=WORDS          Show only messages containing all the words\n"
                "  -e --pager-end           Immediately jump to end of the journal in the pager\n"
                "  -f --follow              Follow the journal\n"
+               "     --poll-interval=TIME  Look for new entries every TIME when following\n"
                "  -n --lines[=INTEGER]     Number of journal entries to show\n"
                "     --no-tail             Show all lines, even in follow mode\n"
                "     --no-color            Do not use ansi colors\n"
                "  -r --reverse             Show the newest entries first\n"
                "  -o --output=STRING       Change journal output mode (short, short-iso,\n"
                "                                   short-precise, short-monotonic, verbose,\n"
-               "                                   export, json, json-pretty, json-sse, cat)\n"
+               "                                   export, binary, json, json-pretty, json-sse, cat)\n"
                "     --no-full             Ellipsize fields\n"
                "  -a --all                 Show all fields, including long and unprintable\n"
                "  -q --quiet               Do not show privilege warning\n"
                "     --no-pager            Do not pipe output into a pager\n"
                "  -D --directory=PATH      Show journal files from directory\n"
                "     --file=PATH           Show journal file\n"
+               "     --threads=N           Read and format entries, or verify files, with N threads\n"
+               "     --unordered           Don't keep entries in order with --threads\n"
                "\nCommands:\n"
                "  -h --help                Show this help text\n"
                "     --version             Show package version\n"
@@ -193,7 +211,12 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_SINCE,
                 ARG_UNTIL,
                 ARG_AFTER_CURSOR,
-                ARG_SHOW_CURSOR
+                ARG_SHOW_CURSOR,
+                ARG_THREADS,
+                ARG_UNORDERED,
+                ARG_FILTER,
+                ARG_GREP,
+                ARG_POLL_INTERVAL
         };
 
         static const struct option options[] = {
@@ -219,6 +242,9 @@ static int parse_argv(int argc, char *argv[]) {
                 { "file",           required_argument, NULL, ARG_FILE           },
                 { "header",         no_argument,       NULL, ARG_HEADER         },
                 { "priority",       required_argument, NULL, 'p'                },
+                { "filter",         required_argument, NULL, ARG_FILTER         },
+                { "grep",           required_argument, NULL, ARG_GREP           },
+                { "poll-interval",  required_argument, NULL, ARG_POLL_INTERVAL  },
                 { "verify",         no_argument,       NULL, ARG_VERIFY         },
                 { "disk-usage",     no_argument,       NULL, ARG_DISK_USAGE     },
                 { "cursor",         required_argument, NULL, 'c'                },
@@ -228,6 +254,8 @@ static int parse_argv(int argc, char *argv[]) {
                 { "until",          required_argument, NULL, ARG_UNTIL          },
                 { "field",          required_argument, NULL, 'F'                },
                 { "reverse",        no_argument,       NULL, 'r'                },
+                { "threads",        required_argument, NULL, ARG_THREADS        },
+                { "unordered",      no_argument,       NULL, ARG_UNORDERED      },
                 {}
         };
 
@@ -272,6 +300,7 @@ static int parse_argv(int argc, char *argv[]) {
                         }
 
                         if (arg_output == OUTPUT_EXPORT ||
+                            arg_output == OUTPUT_BINARY ||
                             arg_output == OUTPUT_JSON ||
                             arg_output == OUTPUT_JSON_PRETTY ||
                             arg_output == OUTPUT_JSON_SSE ||
@@ -472,6 +501,34 @@ static int parse_argv(int argc, char *argv[]) {
                         arg_reverse = true;
                         break;
 
+                case ARG_THREADS:
+                        r = safe_atou(optarg, &arg_threads);
+                        if (r < 0 || arg_threads <= 0) {
+                                log_error("Failed to parse number of threads '%s'", optarg);
+                                return -EINVAL;
+                        }
+                        break;
+
+                case ARG_UNORDERED:
+                        arg_unordered = true;
+                        break;
+
+                case ARG_FILTER:
+                        arg_filter = optarg;
+                        break;
+
+                case ARG_GREP:
+                        arg_grep = optarg;
+                        break;
+
+                case ARG_POLL_INTERVAL:
+                        r = parse_sec(optarg, &arg_poll_interval);
+                        if (r < 0 || arg_poll_interval == 0) {
+                                log_error("Failed to parse poll interval '%s'", optarg);
+                                return -EINVAL;
+                        }
+                        break;
+
                 case '?':
                         return -EINVAL;
 
@@ -503,11 +560,29 @@ static int parse_argv(int argc, char *argv[]) {
                 return -EINVAL;
         }
 
-        if (arg_action != ACTION_SHOW && optind < argc) {
+        if (arg_action != ACTION_SHOW && arg_action != ACTION_PRINT_HEADER && optind < argc) {
                 log_error("Extraneous arguments starting with '%s'", argv[optind]);
                 return -EINVAL;
         }
 
+        if (arg_threads > 1 &&
+            (arg_follow || arg_reverse || arg_lines >= 0 || arg_cursor || arg_after_cursor || arg_show_cursor)) {
+                log_error("--threads= cannot be combined with --follow, --reverse, --lines, --pager-end or cursors.");
+                return -EINVAL;
+        }
+
+        /* Binary output refers back to fields written before */
+        if (arg_threads > 1 && arg_output == OUTPUT_BINARY) {
+                log_error("--threads= cannot be combined with binary output.");
+                return -EINVAL;
+        }
+
+        /* The cursor line would end up in the middle of the stream */
+        if (arg_show_cursor && arg_output == OUTPUT_BINARY) {
+                log_error("--show-cursor cannot be combined with binary output.");
+                return -EINVAL;
+        }
+
         if ((arg_boot || arg_action == ACTION_LIST_BOOTS) && (arg_file || arg_directory)) {
                 log_error("Using --boot or --list-boots with --file or --directory is not supported.");
                 return -EINVAL;
@@ -928,15 +1003,216 @@ static int add_priorities(sd_journal *j) {
         return 0;
 }
 
+/* A file checked by one of the verify threads */
+typedef struct VerifyItem {
+        const char *path;
+        uint64_t size;
+
+        unsigned progress;
+        bool done, reported;
+        int r;
+} VerifyItem;
+
+typedef struct Verify {
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+
+        VerifyItem *items;
+        unsigned n_items;
+
+        /* The next item to hand out */
+        unsigned next;
+} Verify;
+
+static int verify_item_compare(const void *_a, const void *_b) {
+        const VerifyItem *a = _a, *b = _b;
+
+        /* Largest first, so that no large file is left for the end */
+        if (a->size > b->size)
+                return -1;
+        if (a->size < b->size)
+                return 1;
+
+        return strcmp(a->path, b->path);
+}
+
+static void verify_thread_progress(unsigned p, void *userdata) {
+        VerifyItem *item = userdata;
+
+        __atomic_store_n(&item->progress, p, __ATOMIC_RELAXED);
+}
+
+static void *verify_thread(void *userdata) {
+        Verify *v = userdata;
+
+        for (;;) {
+                VerifyItem *item;
+                JournalFile *f;
+                int r;
+
+                pthread_mutex_lock(&v->mutex);
+                if (v->next >= v->n_items) {
+                        pthread_mutex_unlock(&v->mutex);
+                        break;
+                }
+
+                item = v->items + v->next++;
+                pthread_mutex_unlock(&v->mutex);
+
+                /* Every thread opens the file on its own, as
+                 * neither files nor their mmap caches are shared
+                 * between threads */
+                r = journal_file_open(item->path, O_RDONLY, 0, false, false, NULL, NULL, NULL, &f);
+                if (r >= 0) {
+                        r = journal_file_verify_with_progress(f, verify_thread_progress, item);
+                        journal_file_close(f);
+                }
+
+                pthread_mutex_lock(&v->mutex);
+                item->r = r;
+                item->done = true;
+
+                /* If the key was invalid, give up right-away */
+                if (r == -EINVAL)
+                        v->n_items = v->next;
+
+                pthread_cond_broadcast(&v->cond);
+                pthread_mutex_unlock(&v->mutex);
+        }
+
+        return NULL;
+}
+
+/* The share of all bytes verified, from 0 to 65535 */
+static unsigned verify_progress(Verify *v, uint64_t total) {
+        uint64_t sum = 0;
+        unsigned i;
+
+        for (i = 0; i < v->n_items; i++) {
+                VerifyItem *item = v->items + i;
+                unsigned p;
+
+                p = item->done ? 65535U : __atomic_load_n(&item->progress, __ATOMIC_RELAXED);
+                sum += item->size / 65535U * p;
+        }
+
+        return total > 0 ? MIN(sum / (total / 65535U + 1), (uint64_t) 65535U) : 0;
+}
+
+static int verify_parallel(sd_journal *j, unsigned n_threads) {
+        Verify v = {
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
+                .cond = PTHREAD_COND_INITIALIZER,
+        };
+        _cleanup_free_ pthread_t *threads = NULL;
+        _cleanup_free_ VerifyItem *items = NULL;
+        JournalFile *f;
+        Iterator it;
+        usec_t last_usec = 0;
+        uint64_t total = 0;
+        unsigned i, n, n_reported = 0, n_started = 0;
+        int r = 0;
+
+        n = hashmap_size(j->files);
+        items = new0(VerifyItem, n);
+        if (!items)
+                return log_oom();
+
+        i = 0;
+        HASHMAP_FOREACH(f, j->files, it) {
+                items[i].path = f->path;
+                items[i].size = f->last_stat.st_size;
+                total += items[i].size;
+                i++;
+        }
+
+        qsort(items, n, sizeof(VerifyItem), verify_item_compare);
+
+        v.items = items;
+        v.n_items = n;
+
+        threads = new(pthread_t, MIN(n_threads, n));
+        if (!threads)
+                return log_oom();
+
+        for (n_started = 0; n_started < MIN(n_threads, n); n_started++) {
+                r = -pthread_create(threads + n_started, NULL, verify_thread, &v);
+                if (r < 0) {
+                        log_error("Failed to start verify thread: %s", strerror(-r));
+                        if (n_started <= 0)
+                                return r;
+
+                        r = 0;
+                        break;
+                }
+        }
+
+        pthread_mutex_lock(&v.mutex);
+
+        /* Report every file once it is done, in the order they
+         * finish, and draw the progress of all files in between */
+        while (n_reported < v.n_items) {
+                VerifyItem *item = NULL;
+                struct timespec ts;
+
+                for (i = 0; i < v.n_items; i++)
+                        if (items[i].done && !items[i].reported) {
+                                item = items + i;
+                                break;
+                        }
+
+                if (!item) {
+                        journal_verify_draw_progress(verify_progress(&v, total), &last_usec);
+
+                        timespec_store(&ts, now(CLOCK_REALTIME) + 50 * USEC_PER_MSEC);
+                        pthread_cond_timedwait(&v.cond, &v.mutex, &ts);
+                        continue;
+                }
+
+                item->reported = true;
+                n_reported++;
+
+                pthread_mutex_unlock(&v.mutex);
+
+                journal_verify_flush_progress();
+
+                if (item->r == -EINVAL)
+                        r = item->r;
+                else if (item->r < 0) {
+                        log_warning("FAIL: %s (%s)", item->path, strerror(-item->r));
+                        if (r != -EINVAL)
+                                r = item->r;
+                } else
+                        log_info("PASS: %s", item->path);
+
+                pthread_mutex_lock(&v.mutex);
+        }
+
+        pthread_mutex_unlock(&v.mutex);
+
+        journal_verify_flush_progress();
+
+        for (i = 0; i < n_started; i++)
+                pthread_join(threads[i], NULL);
+
+        return r;
+}
+
 static int verify(sd_journal *j) {
         int r = 0;
         Iterator i;
         JournalFile *f;
+        unsigned n_threads;
 
         assert(j);
 
         log_show_color(true);
 
+        /* Files are verified on all CPUs unless told otherwise */
+        n_threads = arg_threads > 0 ? arg_threads : (unsigned) MAX(sysconf(_SC_NPROCESSORS_ONLN), 1L);
+        if (n_threads > 1 && hashmap_size(j->files) > 1)
+                return verify_parallel(j, n_threads);
+
         HASHMAP_FOREACH(f, j->files, i) {
                 int k;
 
@@ -995,9 +1271,407 @@ static int access_check(sd_journal *j) {
         return r;
 }
 
+static int open_journal(sd_journal **ret) {
+        int r;
+
+        assert(ret);
+
+        if (arg_directory)
+                r = sd_journal_open_directory(ret, arg_directory, arg_journal_type);
+        else if (arg_file)
+                r = sd_journal_open_files(ret, (const char**) &arg_file, 0);
+        else
+                r = sd_journal_open(ret, arg_journal_type);
+        if (r < 0)
+                log_error("Failed to open %s: %s",
+                          arg_directory ? arg_directory : arg_file ? "files" : "journal",
+                          strerror(-r));
+
+        return r;
+}
+
+static int add_filters(sd_journal *j, char **args, JournalFilter **filter) {
+        int r;
+
+        assert(j);
+        assert(filter);
+
+        /* add_boot() must be called first!
+         * It may need to seek the journal to find parent boot IDs. */
+        r = add_boot(j);
+        if (r < 0)
+                return r;
+
+        r = add_dmesg(j);
+        if (r < 0)
+                return r;
+
+        r = add_priorities(j);
+        if (r < 0) {
+                log_error("Failed to add filter for priorities: %s", strerror(-r));
+                return r;
+        }
+
+        r = add_matches(j, args);
+        if (r < 0) {
+                log_error("Failed to add filters: %s", strerror(-r));
+                return r;
+        }
+
+        if (arg_filter) {
+                r = journal_filter_parse(arg_filter, filter);
+                if (r < 0)
+                        return r;
+        }
+
+        if (arg_grep) {
+                r = journal_filter_add_words(filter, arg_grep);
+                if (r < 0)
+                        return r;
+        }
+
+        if (*filter) {
+                /* Equality terms and words are looked up through the
+                 * indexes, only the rest is tested entry by entry */
+                r = journal_filter_add_matches(*filter, j, !arg_follow);
+                if (r < 0) {
+                        log_error("Failed to add filter expression: %s", strerror(-r));
+                        return r;
+                }
+        }
+
+        return 0;
+}
+
+/* Like sd_journal_previous_skip(), but only counts the entries which
+ * pass the filter */
+static int filter_previous_skip(sd_journal *j, JournalFilter *filter, unsigned skip) {
+        unsigned n = 0;
+        int r;
+
+        while (n < skip) {
+                r = sd_journal_previous(j);
+                if (r <= 0)
+                        return r < 0 ? r : (int) n;
+
+                r = journal_filter_test(filter, j);
+                if (r < 0)
+                        return r;
+
+                n += r;
+        }
+
+        return (int) n;
+}
+
+/* A slice [since, until) of the realtime range of the journal, which
+ * is formatted by one of the scan threads into a memory buffer */
+typedef struct ScanChunk {
+        usec_t since, until;
+
+        char *buf;
+        size_t size;
+
+        uuid_t first_boot_id, last_boot_id;
+        bool boot_id_valid;
+        bool ellipsized;
+
+        bool done, printed;
+        int r;
+} ScanChunk;
+
+typedef struct Scan {
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+
+        ScanChunk *chunks;
+        unsigned n_chunks;
+
+        /* The next chunk to hand out, and the number of chunks
+         * written to stdout so far */
+        unsigned next;
+        unsigned n_printed;
+
+        char **args;
+        unsigned n_columns;
+        int flags;
+} Scan;
+
+static int scan_chunk(Scan *s, sd_journal *j, JournalFilter *filter, ScanChunk *c) {
+        _cleanup_fclose_ FILE *f = NULL;
+        uuid_t boot_id;
+        int r;
+
+        f = open_memstream(&c->buf, &c->size);
+        if (!f)
+                return -ENOMEM;
+
+        r = sd_journal_seek_realtime_usec(j, c->since);
+        if (r < 0)
+                return r;
+
+        for (;;) {
+                usec_t usec;
+
+                r = sd_journal_next(j);
+                if (r <= 0)
+                        break;
+
+                /* The end of the chunk is detected like --until= */
+                r = sd_journal_get_realtime_usec(j, &usec);
+                if (r < 0)
+                        break;
+                if (usec >= c->until)
+                        break;
+
+                if (filter) {
+                        r = journal_filter_test(filter, j);
+                        if (r < 0)
+                                break;
+                        if (r == 0)
+                                continue;
+                }
+
+                r = sd_journal_get_monotonic_usec(j, NULL, &boot_id);
+                if (r >= 0) {
+                        if (!c->boot_id_valid)
+                                c->first_boot_id = boot_id;
+                        else if (!uuid_equal(boot_id, c->last_boot_id))
+                                fprintf(f, "%s-- Reboot --%s\n",
+                                        ansi_highlight(), ansi_highlight_off());
+
+                        c->last_boot_id = boot_id;
+                        c->boot_id_valid = true;
+                }
+
+                r = output_journal(f, j, arg_output, s->n_columns, s->flags, &c->ellipsized);
+                if (r == -EADDRNOTAVAIL) {
+                        r = 0;
+                        break;
+                } else if (r < 0)
+                        break;
+        }
+
+        if (r < 0)
+                return r;
+
+        fflush(f);
+        if (ferror(f))
+                return -ENOMEM;
+
+        return 0;
+}
+
+static void *scan_thread(void *userdata) {
+        Scan *s = userdata;
+        _cleanup_journal_close_ sd_journal *j = NULL;
+        _cleanup_journal_filter_free_ JournalFilter *filter = NULL;
+        int r;
+
+        /* Every thread iterates through a journal object of its own,
+         * as they share no state */
+        r = open_journal(&j);
+        if (r >= 0)
+                r = add_filters(j, s->args, &filter);
+
+        for (;;) {
+                ScanChunk *c;
+
+                /* Don't run too far ahead of the output, so that
+                 * only a few chunks are held in memory */
+                pthread_mutex_lock(&s->mutex);
+                while (s->next < s->n_chunks &&
+                       s->next >= s->n_printed + SCAN_CHUNKS_AHEAD * arg_threads)
+                        pthread_cond_wait(&s->cond, &s->mutex);
+
+                if (s->next >= s->n_chunks) {
+                        pthread_mutex_unlock(&s->mutex);
+                        break;
+                }
+
+                c = s->chunks + s->next++;
+                pthread_mutex_unlock(&s->mutex);
+
+                c->r = r < 0 ? r : scan_chunk(s, j, filter, c);
+
+                pthread_mutex_lock(&s->mutex);
+                c->done = true;
+                pthread_cond_broadcast(&s->cond);
+                pthread_mutex_unlock(&s->mutex);
+        }
+
+        output_free_scratch();
+
+        return NULL;
+}
+
+static int show_parallel(sd_journal *j, char **args, bool *ellipsized) {
+        Scan s = {
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
+                .cond = PTHREAD_COND_INITIALIZER,
+                .args = args,
+        };
+        _cleanup_free_ pthread_t *threads = NULL;
+        uuid_t previous_boot_id;
+        bool previous_boot_id_valid = false;
+        usec_t start, end, width;
+        unsigned i, n_threads = 0;
+        int r;
+
+        assert(j);
+
+        r = sd_journal_get_cutoff_realtime_usec(j, &start, &end);
+        if (r <= 0) {
+                if (r < 0)
+                        log_error("Failed to get cutoff: %s", strerror(-r));
+                return r;
+        }
+
+        /* Files whose realtime goes back are shown by the sequential
+         * code, which walks the entries in merge order */
+        r = journal_realtime_ordered(j, start);
+        if (r <= 0)
+                return r < 0 ? r : -EOPNOTSUPP;
+
+        if (arg_since_set && arg_since > start)
+                start = arg_since;
+        if (arg_until_set && arg_until < end)
+                end = arg_until;
+        if (start > end)
+                return 0;
+
+        /* Split the time range into chunks, several per thread, so
+         * that bursts of entries are spread over the threads */
+        s.n_chunks = arg_threads * SCAN_CHUNKS_PER_THREAD;
+        if (end - start + 1 < s.n_chunks)
+                s.n_chunks = end - start + 1;
+        width = (end - start) / s.n_chunks + 1;
+
+        s.chunks = new0(ScanChunk, s.n_chunks);
+        if (!s.chunks)
+                return log_oom();
+
+        for (i = 0; i < s.n_chunks; i++) {
+                s.chunks[i].since = start + i * width;
+                s.chunks[i].until = i == s.n_chunks - 1 ? end + 1 : start + (i + 1) * width;
+        }
+
+        /* Chunks are cut by realtime, so a clock step back could make
+         * them miss or repeat entries */
+        for (i = 1; i < s.n_chunks; i++) {
+                r = journal_realtime_ordered(j, s.chunks[i].since);
+                if (r <= 0) {
+                        if (r == 0)
+                                r = -EOPNOTSUPP;
+                        goto finish;
+                }
+        }
+
+        s.n_columns = columns();
+        s.flags =
+                arg_all * OUTPUT_SHOW_ALL |
+                arg_full * OUTPUT_FULL_WIDTH |
+                arg_show_color * on_tty() * OUTPUT_COLOR;
+
+        threads = new(pthread_t, arg_threads);
+        if (!threads) {
+                r = log_oom();
+                goto finish;
+        }
+
+        for (n_threads = 0; n_threads < arg_threads; n_threads++) {
+                r = -pthread_create(threads + n_threads, NULL, scan_thread, &s);
+                if (r < 0) {
+                        log_error("Failed to start scan thread: %s", strerror(-r));
+                        if (n_threads <= 0)
+                                goto finish;
+
+                        break;
+                }
+        }
+
+        r = 0;
+
+        pthread_mutex_lock(&s.mutex);
+
+        /* Write out the chunks in order, or in the order they are
+         * done with --unordered */
+        while (s.n_printed < s.n_chunks) {
+                ScanChunk *c = NULL;
+
+                if (arg_unordered) {
+                        for (i = 0; i < s.next && i < s.n_chunks; i++)
+                                if (s.chunks[i].done && !s.chunks[i].printed) {
+                                        c = s.chunks + i;
+                                        break;
+                                }
+                } else if (s.chunks[s.n_printed].done)
+                        c = s.chunks + s.n_printed;
+
+                if (!c) {
+                        pthread_cond_wait(&s.cond, &s.mutex);
+                        continue;
+                }
+
+                pthread_mutex_unlock(&s.mutex);
+
+                if (c->r < 0) {
+                        if (r >= 0)
+                                log_error("Failed to iterate through journal: %s", strerror(-c->r));
+                        r = c->r;
+                } else if (r >= 0) {
+                        if (!arg_unordered && c->boot_id_valid) {
+                                if (previous_boot_id_valid &&
+                                    !uuid_equal(c->first_boot_id, previous_boot_id))
+                                        printf("%s-- Reboot --%s\n",
+                                               ansi_highlight(), ansi_highlight_off());
+
+                                previous_boot_id = c->last_boot_id;
+                                previous_boot_id_valid = true;
+                        }
+
+                        fwrite(c->buf, 1, c->size, stdout);
+                        if (ferror(stdout))
+                                r = -EIO;
+
+                        if (c->ellipsized && ellipsized)
+                                *ellipsized = true;
+                }
+
+                free(c->buf);
+                c->buf = NULL;
+
+                pthread_mutex_lock(&s.mutex);
+
+                c->printed = true;
+
+                /* Stop handing out chunks after the first error */
+                if (r < 0 && s.next < s.n_chunks)
+                        s.n_chunks = s.next;
+
+                s.n_printed++;
+                pthread_cond_broadcast(&s.cond);
+        }
+
+        pthread_mutex_unlock(&s.mutex);
+
+        for (i = 0; i < n_threads; i++)
+                pthread_join(threads[i], NULL);
+
+        fflush(stdout);
+
+finish:
+        for (i = 0; i < s.n_chunks; i++)
+                free(s.chunks[i].buf);
+        free(s.chunks);
+
+        return r;
+}
+
 int main(int argc, char *argv[]) {
         int r;
         _cleanup_journal_close_ sd_journal *j = NULL;
+        _cleanup_journal_filter_free_ JournalFilter *filter = NULL;
         bool need_seek = false;
         uuid_t previous_boot_id;
         bool previous_boot_id_valid = false, first_line = true;
@@ -1014,18 +1688,9 @@ int main(int argc, char *argv[]) {
 
         signal(SIGWINCH, columns_lines_cache_reset);
 
-        if (arg_directory)
-                r = sd_journal_open_directory(&j, arg_directory, arg_journal_type);
-        else if (arg_file)
-                r = sd_journal_open_files(&j, (const char**) &arg_file, 0);
-        else
-                r = sd_journal_open(&j, arg_journal_type);
-        if (r < 0) {
-                log_error("Failed to open %s: %s",
-                          arg_directory ? arg_directory : arg_file ? "files" : "journal",
-                          strerror(-r));
+        r = open_journal(&j);
+        if (r < 0)
                 return EXIT_FAILURE;
-        }
 
         r = access_check(j);
         if (r < 0)
@@ -1036,11 +1701,6 @@ int main(int argc, char *argv[]) {
                 goto finish;
         }
 
-        if (arg_action == ACTION_PRINT_HEADER) {
-                journal_print_header(j);
-                return EXIT_SUCCESS;
-        }
-
         if (arg_action == ACTION_DISK_USAGE) {
                 uint64_t bytes = 0;
                 char sbytes[FORMAT_BYTES_MAX];
@@ -1059,28 +1719,10 @@ int main(int argc, char *argv[]) {
                 goto finish;
         }
 
-        /* add_boot() must be called first!
-         * It may need to seek the journal to find parent boot IDs. */
-        r = add_boot(j);
-        if (r < 0)
-                return EXIT_FAILURE;
-
-        r = add_dmesg(j);
+        r = add_filters(j, argv + optind, &filter);
         if (r < 0)
                 return EXIT_FAILURE;
 
-        r = add_priorities(j);
-        if (r < 0) {
-                log_error("Failed to add filter for priorities: %s", strerror(-r));
-                return EXIT_FAILURE;
-        }
-
-        r = add_matches(j, argv + optind);
-        if (r < 0) {
-                log_error("Failed to add filters: %s", strerror(-r));
-                return EXIT_FAILURE;
-        }
-
         if (_unlikely_(log_get_max_level() >= LOG_PRI(LOG_DEBUG))) {
                 _cleanup_free_ char *filter = NULL;
 
@@ -1088,6 +1730,13 @@ int main(int argc, char *argv[]) {
                 log_debug("Journal filter: %s", filter);
         }
 
+        /* Print the header after the matches have been added, so that
+         * it can show which files they rule out */
+        if (arg_action == ACTION_PRINT_HEADER) {
+                journal_print_header(j);
+                return EXIT_SUCCESS;
+        }
+
         if (arg_field) {
                 const void *data;
                 size_t size;
@@ -1124,6 +1773,9 @@ int main(int argc, char *argv[]) {
 
         /* Opening the fd now means the first sd_journal_wait() will actually wait */
         if (arg_follow) {
+                if (arg_poll_interval > 0)
+                        journal_set_poll_interval(j, arg_poll_interval);
+
                 r = sd_journal_get_fd(j);
                 if (r < 0)
                         return EXIT_FAILURE;
@@ -1161,13 +1813,19 @@ int main(int argc, char *argv[]) {
                 r = sd_journal_previous(j);
 
         } else if (arg_lines >= 0) {
-                r = sd_journal_seek_tail(j);
-                if (r < 0) {
-                        log_error("Failed to seek to tail: %s", strerror(-r));
-                        return EXIT_FAILURE;
-                }
+                r = filter ? -EOPNOTSUPP : journal_seek_tail_window(j, arg_lines);
+                if (r == -EOPNOTSUPP) {
+                        r = sd_journal_seek_tail(j);
+                        if (r < 0) {
+                                log_error("Failed to seek to tail: %s", strerror(-r));
+                                return EXIT_FAILURE;
+                        }
 
-                r = sd_journal_previous_skip(j, arg_lines);
+                        if (filter)
+                                r = filter_previous_skip(j, filter, arg_lines);
+                        else
+                                r = sd_journal_previous_skip(j, arg_lines);
+                }
 
         } else if (arg_reverse) {
                 r = sd_journal_seek_tail(j);
@@ -1196,6 +1854,13 @@ int main(int argc, char *argv[]) {
         if (!arg_follow)
                 pager_open_if_enabled();
 
+        /* The pager shows lines as they come in, so like a terminal it
+         * gets every one right away, however long the next takes */
+        if (pager_have())
+                setvbuf(stdout, NULL, _IOLBF, 0);
+        else
+                output_buffer_stream(stdout);
+
         if (!arg_quiet) {
                 usec_t start, end;
                 char start_buf[FORMAT_TIMESTAMP_MAX], end_buf[FORMAT_TIMESTAMP_MAX];
@@ -1217,6 +1882,14 @@ int main(int argc, char *argv[]) {
                 }
         }
 
+        if (arg_threads > 1) {
+                r = show_parallel(j, argv + optind, &ellipsized);
+                if (r != -EOPNOTSUPP)
+                        goto finish;
+
+                log_debug("Realtime of the journal is out of order, showing entries with one thread.");
+        }
+
         uuid_t boot_id;
 
         for (;;) {
@@ -1260,10 +1933,25 @@ int main(int argc, char *argv[]) {
                                         goto finish;
                         }
 
+                        if (filter) {
+                                r = journal_filter_test(filter, j);
+                                if (r == -EADDRNOTAVAIL)
+                                        break;
+                                else if (r < 0) {
+                                        log_error("Failed to test filter: %s", strerror(-r));
+                                        goto finish;
+                                }
+
+                                need_seek = true;
+                                if (r == 0)
+                                        continue;
+                        }
+
                         r = sd_journal_get_monotonic_usec(j, NULL, &boot_id);
                         if (r >= 0) {
                                 if (previous_boot_id_valid &&
-                                    !uuid_equal(boot_id, previous_boot_id))
+                                    !uuid_equal(boot_id, previous_boot_id) &&
+                                    arg_output != OUTPUT_BINARY)
                                         printf("%s-- Reboot --%s\n",
                                                ansi_highlight(), ansi_highlight_off());
 
@@ -1300,6 +1988,11 @@ int main(int argc, char *argv[]) {
                         break;
                 }
 
+                /* Show what we have before waiting for more */
+                r = output_flush(stdout);
+                if (r < 0)
+                        goto finish;
+
                 r = sd_journal_wait(j, (uint64_t) -1);
                 if (r < 0) {
                         log_error("Couldn't wait for journal event: %s", strerror(-r));
@@ -1310,6 +2003,8 @@ int main(int argc, char *argv[]) {
         }
 
 finish:
+        output_flush(stdout);
+        output_free_scratch();
         pager_close();
 
         return r < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
@@ -20,21 +20,24 @@
 ***/
 
 #include <time.h>
+#include <stdio_ext.h>
 #include <assert.h>
 #include <errno.h>
 #include <sys/poll.h>
 #include <sys/socket.h>
 #include <string.h>
 #include <fcntl.h>
+#include <sys/uio.h>
 
 #include "logs-show.h"
 #include "log.h"
 #include "util.h"
 #include "utf8.h"
 #include "gunicode.h"
-#include "hashmap.h"
 #include "fileio.h"
 #include "journal-internal.h"
+#include "journal-binary.h"
+#include "hash/hash.h"
 
 /* up to three lines (each up to 100 characters),
    or 300 characters, whichever is less */
@@ -43,6 +46,8 @@
 
 #define JSON_THRESHOLD 4096
 
+#define OUTPUT_BUFFER_SIZE (256*1024)
+
 static int parse_field(const void *data, size_t length, const char *field, char **target, size_t *target_size) {
         size_t fl, nl;
         void *buf;
@@ -89,53 +94,128 @@ static bool shall_print(const char *p, size_t l, OutputFlags flags) {
         return true;
 }
 
-static char *ascii_ellipsize_mem(const char *s, size_t old_length, size_t new_length, unsigned percent) {
+/* Stripped messages are written to a buffer which is reused for all
+ * entries formatted by the thread */
+static thread_local char *scratch = NULL;
+static thread_local size_t scratch_allocated = 0;
+
+/* A field of the entry formatted by output_json(), with its name and
+ * escaped name and value kept in the scratch buffer */
+typedef struct JsonField {
+        size_t raw_name, raw_name_len;
+        size_t name, name_len;
+        size_t value, value_len;
+        uint64_t hash;
+        unsigned next;          /* next field with the same name */
+        bool repeated;          /* an earlier field has the same name */
+} JsonField;
+
+#define JSON_FIELD_NONE ((unsigned) -1)
+
+static thread_local JsonField *json_fields = NULL;
+static thread_local size_t json_fields_allocated = 0;
+static thread_local unsigned *json_table = NULL;
+static thread_local size_t json_table_allocated = 0;
+
+/* Export output into a stream which has a file descriptor and isn't
+ * line buffered is written with writev() in batches of entries. Data
+ * stored uncompressed is passed as it is mapped from the journal, which
+ * is pinned until the batch is written, anything else is copied to
+ * export_buffer. A vector without base takes the next bytes of that
+ * buffer. Whatever is buffered by the stream was written after the
+ * pending vectors. */
+typedef struct ExportVec {
+        const void *base;
+        size_t length;
+} ExportVec;
+
+#define EXPORT_VECS_MAX 1024
+
+static thread_local ExportVec export_vecs[EXPORT_VECS_MAX];
+static thread_local unsigned n_export_vecs = 0;
+static thread_local char *export_buffer = NULL;
+static thread_local size_t export_buffer_size = 0, export_buffer_allocated = 0;
+static thread_local FILE *export_stream = NULL;
+static thread_local sd_journal *export_journal = NULL;
+
+/* Fields output_binary() asked the reader to keep, by the file and
+ * offset of their data objects. Slots with offset 0 are free. */
+typedef struct BinaryKept {
+        uuid_t file_id;
+        uint64_t offset;
+        uint32_t index;
+} BinaryKept;
+
+#define BINARY_TABLE_SIZE (JOURNAL_BINARY_KEEP_MAX * 2)
+
+/* A field of the entry written by output_binary(), either mapped or
+ * decompressed to the scratch buffer */
+typedef struct BinaryField {
+        const void *data;
+        size_t offset, size;
+        uint32_t ref;
+} BinaryField;
+
+static thread_local BinaryKept *binary_table = NULL;
+static thread_local unsigned n_binary_kept = 0;
+static thread_local size_t binary_kept_size = 0;
+static thread_local bool binary_magic = false;
+static thread_local BinaryField *binary_fields = NULL;
+static thread_local size_t binary_fields_allocated = 0;
+
+static bool ascii_is_valid_mem(const char *s, size_t l) {
+        const char *p;
+
+        for (p = s; p < s + l; p++)
+                if ((unsigned char) *p >= 128)
+                        return false;
+
+        return true;
+}
+
+/* Both ellipsize functions determine which part of s is shown before
+ * and after the ellipsis, as the lengths *head and *tail, so that it
+ * can be printed from the message in place. They return 0 if s fits
+ * as it is. */
+static int ascii_ellipsize_mem(const char *s, size_t old_length, size_t new_length, unsigned percent,
+                               size_t *head, size_t *tail, const char **ellipsis) {
         size_t x;
-        char *r;
 
         assert(s);
         assert(percent <= 100);
         assert(new_length >= 3);
 
         if (old_length <= 3 || old_length <= new_length)
-                return strndup(s, old_length);
-
-        r = new0(char, new_length+1);
-        if (!r)
-                return NULL;
+                return 0;
 
         x = (new_length * percent) / 100;
 
         if (x > new_length - 3)
                 x = new_length - 3;
 
-        memcpy(r, s, x);
-        r[x] = '.';
-        r[x+1] = '.';
-        r[x+2] = '.';
-        memcpy(r + x + 3,
-               s + old_length - (new_length - x - 3),
-               new_length - x - 3);
+        *head = x;
+        *tail = new_length - x - 3;
+        *ellipsis = "...";
 
-        return r;
+        return 1;
 }
 
-static char *ellipsize_mem(const char *s, size_t old_length, size_t new_length, unsigned percent) {
+static int ellipsize_mem(const char *s, size_t old_length, size_t new_length, unsigned percent,
+                         size_t *head, size_t *tail, const char **ellipsis) {
         size_t x;
-        char *e;
         const char *i, *j;
-        unsigned k, len, len2;
+        unsigned k;
 
         assert(s);
         assert(percent <= 100);
         assert(new_length >= 3);
 
         /* if no multibyte characters use ascii_ellipsize_mem for speed */
-        if (ascii_is_valid(s))
-                return ascii_ellipsize_mem(s, old_length, new_length, percent);
+        if (ascii_is_valid_mem(s, old_length))
+                return ascii_ellipsize_mem(s, old_length, new_length, percent, head, tail, ellipsis);
 
         if (old_length <= 3 || old_length <= new_length)
-                return strndup(s, old_length);
+                return 0;
 
         x = (new_length * percent) / 100;
 
@@ -148,7 +228,7 @@ static char *ellipsize_mem(const char *s, size_t old_length, size_t new_length,
 
                 c = utf8_encoded_to_unichar(i);
                 if (c < 0)
-                        return NULL;
+                        return -EINVAL;
                 k += unichar_iswide(c) ? 2 : 1;
         }
 
@@ -161,37 +241,23 @@ static char *ellipsize_mem(const char *s, size_t old_length, size_t new_length,
                 j = utf8_prev_char(j);
                 c = utf8_encoded_to_unichar(j);
                 if (c < 0)
-                        return NULL;
+                        return -EINVAL;
                 k += unichar_iswide(c) ? 2 : 1;
         }
         assert(i <= j);
 
         /* we don't actually need to ellipsize */
         if (i == j)
-                return memdup(s, old_length + 1);
+                return 0;
 
         /* make space for ellipsis */
         j = utf8_next_char(j);
 
-        len = i - s;
-        len2 = s + old_length - j;
-        e = new(char, len + 3 + len2 + 1);
-        if (!e)
-                return NULL;
-
-        /*
-        printf("old_length=%zu new_length=%zu x=%zu len=%u len2=%u k=%u\n",
-               old_length, new_length, x, len, len2, k);
-        */
+        *head = i - s;
+        *tail = s + old_length - j;
+        *ellipsis = "\xe2\x80\xa6"; /* tri-dot ellipsis: … */
 
-        memcpy(e, s, len);
-        e[len]   = 0xe2; /* tri-dot ellipsis: … */
-        e[len + 1] = 0x80;
-        e[len + 2] = 0xa6;
-
-        memcpy(e + len + 3, j, len2 + 1);
-
-        return e;
+        return 1;
 }
 
 #define ANSI_LIGHTBLUE "\x1B[38;5;153m"
@@ -257,18 +323,20 @@ static bool print_multiline(FILE *f, unsigned prefix, unsigned n_columns, Output
                                         continuation * prefix, "",
                                         color_on, len, pos, color_off);
                         else {
-                                _cleanup_free_ char *e = NULL;
+                                const char *ellipsis;
+                                size_t head, tail;
 
-                                e = ellipsize_mem(pos, len, n_columns - prefix,
-                                                  tail_line ? 100 : 90);
-                                if (!e)
+                                if (ellipsize_mem(pos, len, n_columns - prefix,
+                                                  tail_line ? 100 : 90,
+                                                  &head, &tail, &ellipsis) <= 0)
                                         fprintf(f, "%*s%s%.*s%s\n",
                                                 continuation * prefix, "",
                                                 color_on, len, pos, color_off);
                                 else
-                                        fprintf(f, "%*s%s%s%s\n",
+                                        fprintf(f, "%*s%s%.*s%s%.*s%s\n",
                                                 continuation * prefix, "",
-                                                color_on, e, color_off);
+                                                color_on, (int) head, pos, ellipsis,
+                                                (int) tail, pos + len - tail, color_off);
                         }
                 } else
                         fputs("...\n", f);
@@ -280,53 +348,77 @@ static bool print_multiline(FILE *f, unsigned prefix, unsigned n_columns, Output
         return ellipsized;
 }
 
-static char *strip_tab_ansi(char **ibuf, size_t *_isz) {
-        const char *i, *begin = NULL;
+static int scratch_put(size_t *n, const char *p, size_t l) {
+        if (!GREEDY_REALLOC(scratch, scratch_allocated, *n + l))
+                return -ENOMEM;
+
+        memcpy(scratch + *n, p, l);
+        *n += l;
+
+        return 0;
+}
+
+/* Appends a copy of what was written to the scratch buffer before */
+static int scratch_copy(size_t *n, size_t from, size_t l) {
+        if (!GREEDY_REALLOC(scratch, scratch_allocated, *n + l))
+                return -ENOMEM;
+
+        memcpy(scratch + *n, scratch + from, l);
+        *n += l;
+
+        return 0;
+}
+
+static int strip_tab_ansi(const char **buf, size_t *size) {
+        const char *i, *begin = NULL, *ibuf;
         enum {
                 STATE_OTHER,
                 STATE_ESCAPE,
                 STATE_BRACKET
         } state = STATE_OTHER;
-        char *obuf = NULL;
-        size_t osz = 0, isz;
-        FILE *f;
+        size_t isz, osz = 0;
+        int r = 0;
 
-        assert(ibuf);
-        assert(*ibuf);
+        assert(buf);
+        assert(*buf);
+        assert(size);
 
-        /* Strips ANSI color and replaces TABs by 8 spaces */
+        /* Strips ANSI color and replaces TABs by 8 spaces. Messages
+         * without either are left where they are, the others are
+         * written to the scratch buffer. */
 
-        isz = _isz ? *_isz : strlen(*ibuf);
+        ibuf = *buf;
+        isz = *size;
 
-        f = open_memstream(&obuf, &osz);
-        if (!f)
-                return NULL;
+        if (!memchr(ibuf, '\x1B', isz) && !memchr(ibuf, '\t', isz))
+                return 0;
 
-        for (i = *ibuf; i < *ibuf + isz + 1; i++) {
+        for (i = ibuf; i < ibuf + isz + 1 && r >= 0; i++) {
 
                 switch (state) {
 
                 case STATE_OTHER:
-                        if (i >= *ibuf + isz) /* EOT */
+                        if (i >= ibuf + isz) /* EOT */
                                 break;
                         else if (*i == '\x1B')
                                 state = STATE_ESCAPE;
                         else if (*i == '\t')
-                                fputs("        ", f);
+                                r = scratch_put(&osz, "        ", 8);
                         else
-                                fputc(*i, f);
+                                r = scratch_put(&osz, i, 1);
                         break;
 
                 case STATE_ESCAPE:
-                        if (i >= *ibuf + isz) { /* EOT */
-                                fputc('\x1B', f);
+                        if (i >= ibuf + isz) { /* EOT */
+                                r = scratch_put(&osz, "\x1B", 1);
                                 break;
                         } else if (*i == '[') {
                                 state = STATE_BRACKET;
                                 begin = i + 1;
                         } else {
-                                fputc('\x1B', f);
-                                fputc(*i, f);
+                                r = scratch_put(&osz, "\x1B", 1);
+                                if (r >= 0)
+                                        r = scratch_put(&osz, i, 1);
                                 state = STATE_OTHER;
                         }
 
@@ -334,10 +426,9 @@ static char *strip_tab_ansi(char **ibuf, size_t *_isz) {
 
                 case STATE_BRACKET:
 
-                        if (i >= *ibuf + isz || /* EOT */
+                        if (i >= ibuf + isz || /* EOT */
                             (!(*i >= '0' && *i <= '9') && *i != ';' && *i != 'm')) {
-                                fputc('\x1B', f);
-                                fputc('[', f);
+                                r = scratch_put(&osz, "\x1B[", 2);
                                 state = STATE_OTHER;
                                 i = begin-1;
                         } else if (*i == 'm')
@@ -346,23 +437,74 @@ static char *strip_tab_ansi(char **ibuf, size_t *_isz) {
                 }
         }
 
-        if (ferror(f)) {
-                fclose(f);
-                free(obuf);
-                return NULL;
-        }
+        if (r < 0)
+                return r;
 
-        fclose(f);
+        *buf = osz > 0 ? scratch : "";
+        *size = osz;
 
-        free(*ibuf);
-        *ibuf = obuf;
+        return 1;
+}
+
+void output_free_scratch(void) {
+        free(scratch);
+        scratch = NULL;
+        scratch_allocated = 0;
+
+        free(json_fields);
+        json_fields = NULL;
+        json_fields_allocated = 0;
+
+        free(json_table);
+        json_table = NULL;
+        json_table_allocated = 0;
+
+        if (export_journal)
+                journal_unpin_data(export_journal);
+        export_journal = NULL;
+        export_stream = NULL;
+        n_export_vecs = 0;
+
+        free(export_buffer);
+        export_buffer = NULL;
+        export_buffer_size = export_buffer_allocated = 0;
+
+        free(binary_table);
+        binary_table = NULL;
+        n_binary_kept = 0;
+        binary_kept_size = 0;
+        binary_magic = false;
+
+        free(binary_fields);
+        binary_fields = NULL;
+        binary_fields_allocated = 0;
+}
+
+static int safe_atou64_mem(const char *p, size_t l, uint64_t *ret) {
+        char buf[DECIMAL_STR_MAX(uint64_t)];
+
+        if (l >= sizeof(buf))
+                return -ERANGE;
 
-        if (_isz)
-                *_isz = osz;
+        memcpy(buf, p, l);
+        buf[l] = 0;
 
-        return obuf;
+        return safe_atou64(buf, ret);
 }
 
+/* Fields used by output_short(), in the order of its targets */
+static const char * const short_fields[] = {
+        "PRIORITY",
+        "_HOSTNAME",
+        "SYSLOG_IDENTIFIER",
+        "_COMM",
+        "_PID",
+        "SYSLOG_PID",
+        "_SOURCE_REALTIME_TIMESTAMP",
+        "_SOURCE_MONOTONIC_TIMESTAMP",
+        "MESSAGE",
+};
+
 static int output_short(
                 FILE *f,
                 sd_journal *j,
@@ -371,11 +513,18 @@ static int output_short(
                 OutputFlags flags) {
 
         int r;
-        const void *data;
-        size_t length;
-        size_t n = 0;
-        _cleanup_free_ char *hostname = NULL, *identifier = NULL, *comm = NULL, *pid = NULL, *fake_pid = NULL, *message = NULL, *realtime = NULL, *monotonic = NULL, *priority = NULL;
+        const void *data[ELEMENTSOF(short_fields)];
+        size_t length[ELEMENTSOF(short_fields)];
+        size_t n = 0, l;
+        unsigned i;
+        const char *hostname = NULL, *identifier = NULL, *comm = NULL, *pid = NULL, *fake_pid = NULL, *message = NULL, *realtime = NULL, *monotonic = NULL, *priority = NULL;
         size_t hostname_len = 0, identifier_len = 0, comm_len = 0, pid_len = 0, fake_pid_len = 0, message_len = 0, realtime_len = 0, monotonic_len = 0, priority_len = 0;
+        const char **targets[ELEMENTSOF(short_fields)] = {
+                &priority, &hostname, &identifier, &comm, &pid, &fake_pid, &realtime, &monotonic, &message
+        };
+        size_t *target_lens[ELEMENTSOF(short_fields)] = {
+                &priority_len, &hostname_len, &identifier_len, &comm_len, &pid_len, &fake_pid_len, &realtime_len, &monotonic_len, &message_len
+        };
         int p = LOG_INFO;
         bool ellipsized = false;
 
@@ -390,69 +539,34 @@ static int output_short(
          */
         sd_journal_set_data_threshold(j, flags & (OUTPUT_SHOW_ALL|OUTPUT_FULL_WIDTH) ? 0 : PRINT_CHAR_THRESHOLD + 1);
 
-        JOURNAL_FOREACH_DATA_RETVAL(j, data, length, r) {
-
-                r = parse_field(data, length, "PRIORITY=", &priority, &priority_len);
-                if (r < 0)
-                        return r;
-                else if (r > 0)
-                        continue;
-
-                r = parse_field(data, length, "_HOSTNAME=", &hostname, &hostname_len);
-                if (r < 0)
-                        return r;
-                else if (r > 0)
-                        continue;
-
-                r = parse_field(data, length, "SYSLOG_IDENTIFIER=", &identifier, &identifier_len);
-                if (r < 0)
-                        return r;
-                else if (r > 0)
-                        continue;
-
-                r = parse_field(data, length, "_COMM=", &comm, &comm_len);
-                if (r < 0)
-                        return r;
-                else if (r > 0)
-                        continue;
-
-                r = parse_field(data, length, "_PID=", &pid, &pid_len);
-                if (r < 0)
-                        return r;
-                else if (r > 0)
-                        continue;
-
-                r = parse_field(data, length, "SYSLOG_PID=", &fake_pid, &fake_pid_len);
-                if (r < 0)
-                        return r;
-                else if (r > 0)
-                        continue;
+        r = sd_journal_get_fields(j, short_fields, ELEMENTSOF(short_fields), data, length);
+        if (r < 0)
+                return r;
 
-                r = parse_field(data, length, "_SOURCE_REALTIME_TIMESTAMP=", &realtime, &realtime_len);
-                if (r < 0)
-                        return r;
-                else if (r > 0)
+        /* The values are used where they are, in the mapped file or
+         * the decompression buffers, without copying them.
+         * sd_journal_get_fields() keeps all of them valid until it is
+         * called again or the journal moves on. They are not NUL
+         * terminated and might contain NUL bytes. */
+        for (i = 0; i < ELEMENTSOF(short_fields); i++) {
+                if (!data[i])
                         continue;
 
-                r = parse_field(data, length, "_SOURCE_MONOTONIC_TIMESTAMP=", &monotonic, &monotonic_len);
-                if (r < 0)
-                        return r;
-                else if (r > 0)
-                        continue;
+                /* Strip the field name and the '=' */
+                l = strlen(short_fields[i]) + 1;
 
-                r = parse_field(data, length, "MESSAGE=", &message, &message_len);
-                if (r < 0)
-                        return r;
+                *targets[i] = (const char*) data[i] + l;
+                *target_lens[i] = length[i] - l;
         }
 
-        if (r < 0)
-                return r;
-
         if (!message)
                 return 0;
 
-        if (!(flags & OUTPUT_SHOW_ALL))
-                strip_tab_ansi(&message, &message_len);
+        if (!(flags & OUTPUT_SHOW_ALL)) {
+                r = strip_tab_ansi(&message, &message_len);
+                if (r < 0)
+                        return log_oom();
+        }
 
         if (priority_len == 1 && *priority >= '0' && *priority <= '7')
                 p = *priority - '0';
@@ -464,7 +578,7 @@ static int output_short(
                 r = -ENOENT;
 
                 if (monotonic)
-                        r = safe_atou64(monotonic, &t);
+                        r = safe_atou64_mem(monotonic, monotonic_len, &t);
 
                 if (r < 0)
                         r = sd_journal_get_monotonic_usec(j, &t, &boot_id);
@@ -489,7 +603,7 @@ static int output_short(
                 r = -ENOENT;
 
                 if (realtime)
-                        r = safe_atou64(realtime, &x);
+                        r = safe_atou64_mem(realtime, realtime_len, &x);
 
                 if (r < 0)
                         r = sd_journal_get_realtime_usec(j, &x);
@@ -660,6 +774,129 @@ static int output_verbose(
         return 0;
 }
 
+/* Writes the pending vectors, leaving the journal pinned */
+static int export_write_pending(void) {
+        struct iovec iov[EXPORT_VECS_MAX];
+        unsigned i, k = 0, n = n_export_vecs;
+        size_t offset = 0;
+        int r = 0;
+
+        assert(export_stream);
+
+        for (i = 0; i < n; i++) {
+                if (export_vecs[i].base)
+                        iov[i].iov_base = (void*) export_vecs[i].base;
+                else {
+                        iov[i].iov_base = export_buffer + offset;
+                        offset += export_vecs[i].length;
+                }
+                iov[i].iov_len = export_vecs[i].length;
+        }
+
+        while (k < n) {
+                ssize_t l;
+
+                l = writev(fileno(export_stream), iov + k, n - k);
+                if (l < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        r = -errno;
+                        break;
+                }
+
+                for (; k < n && (size_t) l >= iov[k].iov_len; k++)
+                        l -= iov[k].iov_len;
+
+                if (k < n) {
+                        iov[k].iov_base = (uint8_t*) iov[k].iov_base + l;
+                        iov[k].iov_len -= l;
+                }
+        }
+
+        n_export_vecs = 0;
+        export_buffer_size = 0;
+
+        return r;
+}
+
+static int export_flush(void) {
+        int r;
+
+        if (!export_stream)
+                return 0;
+
+        r = export_write_pending();
+
+        journal_unpin_data(export_journal);
+        export_journal = NULL;
+        export_stream = NULL;
+
+        return r;
+}
+
+static int export_begin(FILE *f, sd_journal *j) {
+        int r;
+
+        if (export_stream &&
+            (export_stream != f || export_journal != j || __fpending(f) > 0)) {
+                r = export_flush();
+                if (r < 0)
+                        return r;
+        }
+
+        if (export_stream)
+                return 0;
+
+        /* Write out what is buffered first, so the vectors follow it */
+        if (fflush(f) != 0)
+                return -errno;
+
+        journal_pin_data(j);
+        export_journal = j;
+        export_stream = f;
+
+        return 0;
+}
+
+/* Writes to the stream, or adds to the batch if one was begun. Mapped
+ * data is passed as it is, and has to stay valid until the batch is
+ * written. */
+static int export_write(FILE *f, const void *p, size_t l, bool mapped) {
+        ExportVec *v;
+
+        if (!export_stream) {
+                fwrite(p, 1, l, f);
+                return 0;
+        }
+
+        if (l <= 0)
+                return 0;
+
+        if (!mapped) {
+                if (!GREEDY_REALLOC(export_buffer, export_buffer_allocated, export_buffer_size + l))
+                        return -ENOMEM;
+
+                memcpy(export_buffer + export_buffer_size, p, l);
+                export_buffer_size += l;
+
+                if (n_export_vecs > 0 && !export_vecs[n_export_vecs - 1].base) {
+                        export_vecs[n_export_vecs - 1].length += l;
+                        return 0;
+                }
+
+                p = NULL;
+        }
+
+        assert(n_export_vecs < EXPORT_VECS_MAX);
+
+        v = export_vecs + n_export_vecs++;
+        v->base = p;
+        v->length = l;
+
+        return 0;
+}
+
 static int output_export(
                 FILE *f,
                 sd_journal *j,
@@ -672,8 +909,12 @@ static int output_export(
         int r;
         usec_t realtime, monotonic;
         _cleanup_free_ char *cursor = NULL;
+        char header[sizeof("\n__REALTIME_TIMESTAMP=\n__MONOTONIC_TIMESTAMP=\n_BOOT_ID=\n") +
+                    2 * DECIMAL_STR_MAX(usec_t) + 32];
         const void *data;
         size_t length;
+        Object *o;
+        bool batch;
 
         assert(j);
 
@@ -697,17 +938,34 @@ static int output_export(
                 return r;
         }
 
-        fprintf(f,
-                "__CURSOR=%s\n"
-                "__REALTIME_TIMESTAMP="USEC_FMT"\n"
-                "__MONOTONIC_TIMESTAMP="USEC_FMT"\n"
-                "_BOOT_ID=%s\n",
-                cursor,
-                realtime,
-                monotonic,
-                journal_uuid_to_str(boot_id, sid));
+        /* Terminals get each entry as it is written */
+        batch = fileno(f) >= 0 && !__flbf(f);
+        if (batch) {
+                r = export_begin(f, j);
+                if (r < 0)
+                        return r;
+        }
 
-        JOURNAL_FOREACH_DATA_RETVAL(j, data, length, r) {
+        snprintf(header, sizeof(header),
+                 "\n"
+                 "__REALTIME_TIMESTAMP="USEC_FMT"\n"
+                 "__MONOTONIC_TIMESTAMP="USEC_FMT"\n"
+                 "_BOOT_ID=%s\n",
+                 realtime,
+                 monotonic,
+                 journal_uuid_to_str(boot_id, sid));
+
+        export_write(f, "__CURSOR=", 9, false);
+        export_write(f, cursor, strlen(cursor), false);
+        r = export_write(f, header, strlen(header), false);
+        if (r < 0)
+                return r;
+
+        sd_journal_restart_data(j);
+        while ((r = journal_enumerate_data_object(j, &data, &length, &o, NULL)) > 0) {
+                const char *c;
+                uint64_t le64;
+                bool mapped;
 
                 /* We already printed the boot id, from the data in
                  * the header, hence let's suppress it here */
@@ -715,32 +973,369 @@ static int output_export(
                     startswith(data, "_BOOT_ID="))
                         continue;
 
+                /* Each field takes up to four vectors */
+                if (batch && n_export_vecs + 4 > EXPORT_VECS_MAX) {
+                        r = export_write_pending();
+                        if (r < 0)
+                                return r;
+                }
+
+                mapped = !(o->object.flags & OBJECT_COMPRESSION_MASK);
+
                 if (utf8_is_printable_newline(data, length, false))
-                        fwrite(data, length, 1, f);
+                        r = export_write(f, data, length, mapped);
                 else {
-                        const char *c;
-                        uint64_t le64;
-
                         c = memchr(data, '=', length);
                         if (!c) {
                                 log_error("Invalid field.");
                                 return -EINVAL;
                         }
 
-                        fwrite(data, c - (const char*) data, 1, f);
-                        fputc('\n', f);
+                        export_write(f, data, c - (const char*) data, mapped);
+                        export_write(f, "\n", 1, false);
                         le64 = htole64(length - (c - (const char*) data) - 1);
-                        fwrite(&le64, sizeof(le64), 1, f);
-                        fwrite(c + 1, length - (c - (const char*) data) - 1, 1, f);
+                        export_write(f, &le64, sizeof(le64), false);
+                        r = export_write(f, c + 1, length - (c - (const char*) data) - 1, mapped);
                 }
+                if (r < 0)
+                        return r;
 
-                fputc('\n', f);
+                r = export_write(f, "\n", 1, false);
+                if (r < 0)
+                        return r;
         }
+        if (r < 0)
+                return r;
 
+        r = export_write(f, "\n", 1, false);
         if (r < 0)
                 return r;
 
-        fputc('\n', f);
+        if (batch &&
+            (n_export_vecs > EXPORT_VECS_MAX / 2 || export_buffer_size >= OUTPUT_BUFFER_SIZE)) {
+                r = export_flush();
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+/* Returns the index the reader keeps the data object under, or whether
+ * to send it as a literal, and to keep it */
+static uint32_t binary_ref(const uuid_t *file_id, uint64_t offset, uint64_t hash,
+                           uint64_t n_entries, size_t size, bool *full) {
+        size_t b, mask = BINARY_TABLE_SIZE - 1;
+
+        for (b = (hash ^ file_id->qwords[0]) & mask; binary_table[b].offset != 0; b = (b + 1) & mask)
+                if (binary_table[b].offset == offset &&
+                    uuid_equal(binary_table[b].file_id, *file_id))
+                        return binary_table[b].index;
+
+        /* Data of a single entry isn't sent again */
+        if (n_entries <= 1)
+                return JOURNAL_BINARY_LITERAL;
+
+        if (n_binary_kept >= JOURNAL_BINARY_KEEP_MAX ||
+            binary_kept_size + size > JOURNAL_BINARY_KEEP_SIZE_MAX) {
+                *full = true;
+                return JOURNAL_BINARY_LITERAL;
+        }
+
+        binary_table[b].file_id = *file_id;
+        binary_table[b].offset = offset;
+        binary_table[b].index = n_binary_kept++;
+        binary_kept_size += size;
+
+        return JOURNAL_BINARY_LITERAL_KEEP;
+}
+
+static int output_binary(
+                FILE *f,
+                sd_journal *j,
+                OutputMode mode,
+                unsigned n_columns,
+                OutputFlags flags) {
+
+        JournalBinaryEntryHeader h = {};
+        JournalFile *jf;
+        uuid_t file_id;
+        Object *o;
+        const void *data;
+        size_t length, n_scratch = 0;
+        uint64_t size, offset;
+        unsigned i, n = 0;
+        bool batch, full = false;
+        int r;
+
+        assert(j);
+
+        sd_journal_set_data_threshold(j, 0);
+
+        jf = j->current_file;
+        if (!jf || jf->current_offset <= 0)
+                return -EADDRNOTAVAIL;
+
+        r = journal_file_move_to_object(jf, OBJECT_ENTRY, jf->current_offset, &o);
+        if (r < 0)
+                return r;
+
+        h.record.type = JOURNAL_BINARY_ENTRY;
+        h.seqnum = o->entry.seqnum;
+        h.realtime = o->entry.realtime;
+        h.monotonic = o->entry.monotonic;
+        h.boot_id = o->entry.boot_id;
+        size = sizeof(h);
+
+        file_id = jf->header->file_id;
+
+        if (!binary_table) {
+                binary_table = new0(BinaryKept, BINARY_TABLE_SIZE);
+                if (!binary_table)
+                        return -ENOMEM;
+        }
+
+        /* The data of all fields is collected before it is written,
+         * hence it has to stay mapped until then */
+        batch = fileno(f) >= 0 && !__flbf(f);
+        if (batch) {
+                r = export_begin(f, j);
+                if (r < 0)
+                        return r;
+        } else
+                journal_pin_data(j);
+
+        sd_journal_restart_data(j);
+        while ((r = journal_enumerate_data_object(j, &data, &length, &o, &offset)) > 0) {
+                BinaryField *field;
+
+                if (!GREEDY_REALLOC(binary_fields, binary_fields_allocated, n + 1)) {
+                        r = -ENOMEM;
+                        goto finish;
+                }
+
+                field = binary_fields + n++;
+                field->ref = binary_ref(&file_id, offset, le64toh(o->data.hash),
+                                        le64toh(o->data.n_entries), length, &full);
+                size += sizeof(le32_t);
+
+                if (field->ref != JOURNAL_BINARY_LITERAL &&
+                    field->ref != JOURNAL_BINARY_LITERAL_KEEP)
+                        continue;
+
+                size += sizeof(le64_t) + length;
+                field->size = length;
+
+                if (o->object.flags & OBJECT_COMPRESSION_MASK) {
+                        field->data = NULL;
+                        field->offset = n_scratch;
+
+                        r = scratch_put(&n_scratch, data, length);
+                        if (r < 0)
+                                goto finish;
+                } else
+                        field->data = data;
+        }
+        if (r < 0)
+                goto finish;
+
+        h.record.size = htole64(size);
+        h.n_fields = htole32(n);
+
+        if (!binary_magic) {
+                export_write(f, JOURNAL_BINARY_MAGIC, sizeof(JOURNAL_BINARY_MAGIC) - 1, false);
+                binary_magic = true;
+        }
+
+        r = export_write(f, &h, sizeof(h), false);
+        if (r < 0)
+                goto finish;
+
+        for (i = 0; i < n; i++) {
+                BinaryField *field = binary_fields + i;
+                le32_t le_ref = htole32(field->ref);
+                le64_t le_size;
+
+                if (batch && n_export_vecs + 2 > EXPORT_VECS_MAX) {
+                        r = export_write_pending();
+                        if (r < 0)
+                                goto finish;
+                }
+
+                r = export_write(f, &le_ref, sizeof(le_ref), false);
+                if (r < 0)
+                        goto finish;
+
+                if (field->ref != JOURNAL_BINARY_LITERAL &&
+                    field->ref != JOURNAL_BINARY_LITERAL_KEEP)
+                        continue;
+
+                le_size = htole64(field->size);
+                export_write(f, &le_size, sizeof(le_size), false);
+
+                if (field->data)
+                        r = export_write(f, field->data, field->size, true);
+                else
+                        r = export_write(f, scratch + field->offset, field->size, false);
+                if (r < 0)
+                        goto finish;
+        }
+
+        /* Start over once the reader keeps as much as it may */
+        if (full) {
+                JournalBinaryRecordHeader reset = {
+                        .size = htole64(sizeof(reset)),
+                        .type = JOURNAL_BINARY_RESET,
+                };
+
+                r = export_write(f, &reset, sizeof(reset), false);
+                if (r < 0)
+                        goto finish;
+
+                memzero(binary_table, BINARY_TABLE_SIZE * sizeof(BinaryKept));
+                n_binary_kept = 0;
+                binary_kept_size = 0;
+        }
+
+        if (batch &&
+            (n_export_vecs > EXPORT_VECS_MAX / 2 || export_buffer_size >= OUTPUT_BUFFER_SIZE))
+                r = export_flush();
+
+finish:
+        if (!batch)
+                journal_unpin_data(j);
+
+        return r;
+}
+
+int output_flush(FILE *f) {
+        int r;
+
+        r = export_flush();
+
+        if (fflush(f) != 0 && r >= 0)
+                r = -errno;
+
+        return r;
+}
+
+static size_t json_plain_length(const char *p, size_t l) {
+        const uint64_t ones = UINT64_C(0x0101010101010101), highs = UINT64_C(0x8080808080808080);
+        size_t i = 0;
+
+        /* Returns the length of the leading bytes which are copied
+         * into JSON strings as they are, i.e. printable ASCII but
+         * quotes and backslashes. Eight bytes are checked at a time,
+         * a byte is zero in x ^ (ones * c) exactly if it equals c. */
+
+#define HAS_LESS(x, n) (((x) - ones * (n)) & ~(x) & highs)
+#define HAS_ZERO(x) HAS_LESS(x, 1)
+
+        for (; i + 8 <= l; i += 8) {
+                uint64_t x;
+
+                memcpy(&x, p + i, sizeof(x));
+
+                if ((x & highs) ||
+                    HAS_LESS(x, 0x20) ||
+                    HAS_ZERO(x ^ (ones * '"')) ||
+                    HAS_ZERO(x ^ (ones * '\\')) ||
+                    HAS_ZERO(x ^ (ones * 0x7F)))
+                        break;
+        }
+
+#undef HAS_ZERO
+#undef HAS_LESS
+
+        for (; i < l; i++) {
+                uint8_t c = p[i];
+
+                if (c < ' ' || c >= 0x7F || c == '"' || c == '\\')
+                        break;
+        }
+
+        return i;
+}
+
+/* Appends the JSON representation of the string to the scratch buffer
+ * at *n: a string, an array of bytes if it isn't printable UTF-8, or
+ * null if it is too long to be shown. */
+static int json_escape_mem(size_t *n, const char *p, size_t l, OutputFlags flags) {
+        static const char hex[] = "0123456789abcdef";
+        size_t k;
+        char *o;
+
+        assert(n);
+        assert(p || l == 0);
+
+        if (!(flags & OUTPUT_SHOW_ALL) && l >= JSON_THRESHOLD)
+                return scratch_put(n, "null", 4);
+
+        k = json_plain_length(p, l);
+
+        if (k < l && !utf8_is_printable(p, l)) {
+                /* "[ " and " ]" and up to five bytes per byte */
+                if (!GREEDY_REALLOC(scratch, scratch_allocated, *n + 4 + l * 5))
+                        return -ENOMEM;
+
+                o = scratch + *n;
+                o = mempcpy(o, "[ ", 2);
+
+                for (k = 0; k < l; k++) {
+                        uint8_t c = p[k];
+
+                        if (k > 0)
+                                o = mempcpy(o, ", ", 2);
+
+                        if (c >= 100)
+                                *(o++) = '0' + c / 100;
+                        if (c >= 10)
+                                *(o++) = '0' + c / 10 % 10;
+                        *(o++) = '0' + c % 10;
+                }
+
+                o = mempcpy(o, " ]", 2);
+                *n = o - scratch;
+
+                return 0;
+        }
+
+        /* Quotes and up to six bytes per escaped byte */
+        if (!GREEDY_REALLOC(scratch, scratch_allocated, *n + 2 + k + (l - k) * 6))
+                return -ENOMEM;
+
+        o = scratch + *n;
+        *(o++) = '"';
+
+        while (l > 0) {
+                o = mempcpy(o, p, k);
+                p += k;
+                l -= k;
+
+                if (l == 0)
+                        break;
+
+                if (*p == '"' || *p == '\\') {
+                        *(o++) = '\\';
+                        *(o++) = *p;
+                } else if (*p == '\n') {
+                        *(o++) = '\\';
+                        *(o++) = 'n';
+                } else if ((uint8_t) *p < ' ') {
+                        o = mempcpy(o, "\\u00", 4);
+                        *(o++) = hex[(uint8_t) *p >> 4];
+                        *(o++) = hex[(uint8_t) *p & 15];
+                } else
+                        *(o++) = *p;
+
+                p++;
+                l--;
+
+                k = json_plain_length(p, l);
+        }
+
+        *(o++) = '"';
+        *n = o - scratch;
 
         return 0;
 }
@@ -751,51 +1346,63 @@ void json_escape(
                 size_t l,
                 OutputFlags flags) {
 
+        size_t n = 0;
+
         assert(f);
         assert(p);
 
-        if (!(flags & OUTPUT_SHOW_ALL) && l >= JSON_THRESHOLD)
+        if (json_escape_mem(&n, p, l, flags) < 0) {
+                log_oom();
+                return;
+        }
 
-                fputs("null", f);
+        fwrite(scratch, 1, n, f);
+}
 
-        else if (!utf8_is_printable(p, l)) {
-                bool not_first = false;
+static int json_link_fields(unsigned n_fields) {
+        size_t size, mask;
+        unsigned i;
 
-                fputs("[ ", f);
+        /* Chains the fields of the same name, through a hash table
+         * of field indexes which is reused for every entry */
 
-                while (l > 0) {
-                        if (not_first)
-                                fprintf(f, ", %u", (uint8_t) *p);
-                        else {
-                                not_first = true;
-                                fprintf(f, "%u", (uint8_t) *p);
-                        }
+        for (size = 32; size < n_fields * 2; size *= 2)
+                ;
+        mask = size - 1;
 
-                        p++;
-                        l--;
-                }
+        if (!GREEDY_REALLOC(json_table, json_table_allocated, size))
+                return -ENOMEM;
 
-                fputs(" ]", f);
-        } else {
-                fputc('\"', f);
-
-                while (l > 0) {
-                        if (*p == '"' || *p == '\\') {
-                                fputc('\\', f);
-                                fputc(*p, f);
-                        } else if (*p == '\n')
-                                fputs("\\n", f);
-                        else if (*p < ' ')
-                                fprintf(f, "\\u%04x", *p);
-                        else
-                                fputc(*p, f);
+        memset(json_table, 0xFF, size * sizeof(unsigned));
+
+        for (i = 0; i < n_fields; i++) {
+                JsonField *x = json_fields + i;
+                size_t b;
+
+                hash64(scratch + x->raw_name, x->raw_name_len, &x->hash);
+                x->next = JSON_FIELD_NONE;
+                x->repeated = false;
+
+                for (b = x->hash & mask; json_table[b] != JSON_FIELD_NONE; b = (b + 1) & mask) {
+                        JsonField *y = json_fields + json_table[b];
 
-                        p++;
-                        l--;
+                        if (y->hash != x->hash ||
+                            y->raw_name_len != x->raw_name_len ||
+                            memcmp(scratch + y->raw_name, scratch + x->raw_name, x->raw_name_len) != 0)
+                                continue;
+
+                        /* Append to the chain of the first field
+                         * of this name, which the slot then points
+                         * to the end of */
+                        y->next = i;
+                        x->repeated = true;
+                        break;
                 }
 
-                fputc('\"', f);
+                json_table[b] = i;
         }
+
+        return 0;
 }
 
 static int output_json(
@@ -808,12 +1415,12 @@ static int output_json(
         uint64_t realtime, monotonic;
         _cleanup_free_ char *cursor = NULL;
         const void *data;
-        size_t length;
+        size_t length, n = 0, start;
         uuid_t boot_id;
-        char sid[33], *k;
+        char sid[33];
+        const char *separator;
+        unsigned n_fields = 0, i;
         int r;
-        Hashmap *h = NULL;
-        bool done, separator;
 
         assert(j);
 
@@ -837,42 +1444,17 @@ static int output_json(
                 return r;
         }
 
-        if (mode == OUTPUT_JSON_PRETTY)
-                fprintf(f,
-                        "{\n"
-                        "\t\"__CURSOR\" : \"%s\",\n"
-                        "\t\"__REALTIME_TIMESTAMP\" : \""USEC_FMT"\",\n"
-                        "\t\"__MONOTONIC_TIMESTAMP\" : \""USEC_FMT"\",\n"
-                        "\t\"_BOOT_ID\" : \"%s\"",
-                        cursor,
-                        realtime,
-                        monotonic,
-                        journal_uuid_to_str(boot_id, sid));
-        else {
-                if (mode == OUTPUT_JSON_SSE)
-                        fputs("data: ", f);
-
-                fprintf(f,
-                        "{ \"__CURSOR\" : \"%s\", "
-                        "\"__REALTIME_TIMESTAMP\" : \""USEC_FMT"\", "
-                        "\"__MONOTONIC_TIMESTAMP\" : \""USEC_FMT"\", "
-                        "\"_BOOT_ID\" : \"%s\"",
-                        cursor,
-                        realtime,
-                        monotonic,
-                        journal_uuid_to_str(boot_id, sid));
-        }
-
-        h = hashmap_new(string_hash_func, string_compare_func);
-        if (!h)
-                return -ENOMEM;
+        /* The names and values of all fields are escaped into the
+         * scratch buffer first, as the data of the entry is only
+         * enumerated once. Fields of the same name are then written
+         * as one array, where the first of them is. */
 
-        /* First round, iterate through the entry and count how often each field appears */
         JOURNAL_FOREACH_DATA_RETVAL(j, data, length, r) {
                 const char *eq;
-                char *n;
-                unsigned u;
+                JsonField *x;
 
+                /* We print the boot id from the data in the
+                 * header, hence let's suppress it here */
                 if (length >= 9 &&
                     memcmp(data, "_BOOT_ID=", 9) == 0)
                         continue;
@@ -881,142 +1463,129 @@ static int output_json(
                 if (!eq)
                         continue;
 
-                n = strndup(data, eq - (const char*) data);
-                if (!n) {
-                        r = -ENOMEM;
-                        goto finish;
-                }
-
-                u = PTR_TO_UINT(hashmap_get(h, n));
-                if (u == 0) {
-                        r = hashmap_put(h, n, UINT_TO_PTR(1));
-                        if (r < 0) {
-                                free(n);
-                                goto finish;
-                        }
-                } else {
-                        r = hashmap_update(h, n, UINT_TO_PTR(u + 1));
-                        free(n);
-                        if (r < 0)
-                                goto finish;
-                }
-        }
-
-        if (r < 0)
-                return r;
-
-        separator = true;
-        do {
-                done = true;
-
-                SD_JOURNAL_FOREACH_DATA(j, data, length) {
-                        const char *eq;
-                        char *kk, *n;
-                        size_t m;
-                        unsigned u;
-
-                        /* We already printed the boot id, from the data in
-                         * the header, hence let's suppress it here */
-                        if (length >= 9 &&
-                            memcmp(data, "_BOOT_ID=", 9) == 0)
-                                continue;
-
-                        eq = memchr(data, '=', length);
-                        if (!eq)
-                                continue;
-
-                        if (separator) {
-                                if (mode == OUTPUT_JSON_PRETTY)
-                                        fputs(",\n\t", f);
-                                else
-                                        fputs(", ", f);
-                        }
+                if (!GREEDY_REALLOC(json_fields, json_fields_allocated, n_fields + 1))
+                        return log_oom();
 
-                        m = eq - (const char*) data;
-
-                        n = strndup(data, m);
-                        if (!n) {
-                                r = -ENOMEM;
-                                goto finish;
-                        }
+                x = json_fields + n_fields;
 
-                        u = PTR_TO_UINT(hashmap_get2(h, n, (void**) &kk));
-                        if (u == 0) {
-                                /* We already printed this, let's jump to the next */
-                                free(n);
-                                separator = false;
-
-                                continue;
-                        } else if (u == 1) {
-                                /* Field only appears once, output it directly */
-
-                                json_escape(f, data, m, flags);
-                                fputs(" : ", f);
+                x->raw_name = n;
+                x->raw_name_len = eq - (const char*) data;
+                r = scratch_put(&n, data, x->raw_name_len);
+                if (r < 0)
+                        return log_oom();
 
-                                json_escape(f, eq + 1, length - m - 1, flags);
+                x->name = n;
+                r = json_escape_mem(&n, data, x->raw_name_len, flags);
+                if (r < 0)
+                        return log_oom();
+                x->name_len = n - x->name;
 
-                                hashmap_remove(h, n);
-                                free(kk);
-                                free(n);
+                x->value = n;
+                r = json_escape_mem(&n, eq + 1, length - x->raw_name_len - 1, flags);
+                if (r < 0)
+                        return log_oom();
+                x->value_len = n - x->value;
 
-                                separator = true;
+                n_fields++;
+        }
 
-                                continue;
+        if (r < 0)
+                return r;
 
-                        } else {
-                                /* Field appears multiple times, output it as array */
-                                json_escape(f, data, m, flags);
-                                fputs(" : [ ", f);
-                                json_escape(f, eq + 1, length - m - 1, flags);
+        r = json_link_fields(n_fields);
+        if (r < 0)
+                return log_oom();
 
-                                /* Iterate through the end of the list */
+        start = n;
 
-                                while (sd_journal_enumerate_data(j, &data, &length) > 0) {
-                                        if (length < m + 1)
-                                                continue;
+        if (!GREEDY_REALLOC(scratch, scratch_allocated, n + 256 + strlen(cursor)))
+                return log_oom();
 
-                                        if (memcmp(data, n, m) != 0)
-                                                continue;
+        if (mode == OUTPUT_JSON_PRETTY)
+                n += sprintf(scratch + n,
+                             "{\n"
+                             "\t\"__CURSOR\" : \"%s\",\n"
+                             "\t\"__REALTIME_TIMESTAMP\" : \""USEC_FMT"\",\n"
+                             "\t\"__MONOTONIC_TIMESTAMP\" : \""USEC_FMT"\",\n"
+                             "\t\"_BOOT_ID\" : \"%s\"",
+                             cursor,
+                             realtime,
+                             monotonic,
+                             journal_uuid_to_str(boot_id, sid));
+        else
+                n += sprintf(scratch + n,
+                             "%s{ \"__CURSOR\" : \"%s\", "
+                             "\"__REALTIME_TIMESTAMP\" : \""USEC_FMT"\", "
+                             "\"__MONOTONIC_TIMESTAMP\" : \""USEC_FMT"\", "
+                             "\"_BOOT_ID\" : \"%s\"",
+                             mode == OUTPUT_JSON_SSE ? "data: " : "",
+                             cursor,
+                             realtime,
+                             monotonic,
+                             journal_uuid_to_str(boot_id, sid));
+
+        separator = mode == OUTPUT_JSON_PRETTY ? ",\n\t" : ", ";
+
+        for (i = 0; i < n_fields; i++) {
+                JsonField *x = json_fields + i;
+                unsigned k;
+
+                if (x->repeated)
+                        continue;
 
-                                        if (((const char*) data)[m] != '=')
-                                                continue;
+                r = scratch_put(&n, separator, strlen(separator));
+                if (r >= 0)
+                        r = scratch_copy(&n, x->name, x->name_len);
+                if (r < 0)
+                        return log_oom();
 
-                                        fputs(", ", f);
-                                        json_escape(f, (const char*) data + m + 1, length - m - 1, flags);
-                                }
+                if (x->next == JSON_FIELD_NONE) {
+                        /* Field only appears once, output it directly */
+                        r = scratch_put(&n, " : ", 3);
+                        if (r >= 0)
+                                r = scratch_copy(&n, x->value, x->value_len);
+                        if (r < 0)
+                                return log_oom();
 
-                                fputs(" ]", f);
+                        continue;
+                }
 
-                                hashmap_remove(h, n);
-                                free(kk);
-                                free(n);
+                /* Field appears multiple times, output it as array */
+                r = scratch_put(&n, " : [ ", 5);
+                if (r < 0)
+                        return log_oom();
 
-                                /* Iterate data fields form the beginning */
-                                done = false;
-                                separator = true;
+                for (k = i; k != JSON_FIELD_NONE; k = json_fields[k].next) {
+                        JsonField *y = json_fields + k;
 
-                                break;
+                        if (k != i) {
+                                r = scratch_put(&n, ", ", 2);
+                                if (r < 0)
+                                        return log_oom();
                         }
+
+                        r = scratch_copy(&n, y->value, y->value_len);
+                        if (r < 0)
+                                return log_oom();
                 }
 
-        } while (!done);
+                r = scratch_put(&n, " ]", 2);
+                if (r < 0)
+                        return log_oom();
+        }
 
         if (mode == OUTPUT_JSON_PRETTY)
-                fputs("\n}\n", f);
+                r = scratch_put(&n, "\n}\n", 3);
         else if (mode == OUTPUT_JSON_SSE)
-                fputs("}\n\n", f);
+                r = scratch_put(&n, "}\n\n", 3);
         else
-                fputs(" }\n", f);
-
-        r = 0;
-
-finish:
-        while ((k = hashmap_steal_first_key(h)))
-                free(k);
+                r = scratch_put(&n, " }\n", 3);
+        if (r < 0)
+                return log_oom();
 
-        hashmap_free(h);
+        fwrite(scratch + start, 1, n - start, f);
 
-        return r;
+        return 0;
 }
 
 static int output_cat(
@@ -1066,6 +1635,7 @@ static int (*output_funcs[_OUTPUT_MODE_MAX])(
         [OUTPUT_SHORT_MONOTONIC] = output_short,
         [OUTPUT_VERBOSE] = output_verbose,
         [OUTPUT_EXPORT] = output_export,
+        [OUTPUT_BINARY] = output_binary,
         [OUTPUT_JSON] = output_json,
         [OUTPUT_JSON_PRETTY] = output_json,
         [OUTPUT_JSON_SSE] = output_json,
@@ -1088,7 +1658,6 @@ int output_journal(
                 n_columns = columns();
 
         ret = output_funcs[mode](f, j, mode, n_columns, flags);
-        fflush(stdout);
 
         if (ellipsized && ret > 0)
                 *ellipsized = true;
@@ -1096,6 +1665,25 @@ int output_journal(
         return ret;
 }
 
+void output_buffer_stream(FILE *f) {
+        static char buffer[OUTPUT_BUFFER_SIZE];
+
+        assert(f);
+
+        /* Terminals get every line as it is written, anything else
+         * gets large writes. glibc ignores the size unless the
+         * buffer is passed along. The stream is only written from
+         * one thread, so stdio doesn't need to lock it either. */
+
+        if (isatty(fileno(f)))
+                return;
+
+        if (setvbuf(f, buffer, _IOFBF, sizeof(buffer)) != 0)
+                return;
+
+        __fsetlocking(f, FSETLOCKING_BYCALLER);
+}
+
 int add_match_this_boot(sd_journal *j) {
         char match[9+32+1] = "_BOOT_ID=";
         uuid_t boot_id;
@@ -1130,6 +1718,7 @@ static const char *const output_mode_table[_OUTPUT_MODE_MAX] = {
         [OUTPUT_SHORT_MONOTONIC] = "short-monotonic",
         [OUTPUT_VERBOSE] = "verbose",
         [OUTPUT_EXPORT] = "export",
+        [OUTPUT_BINARY] = "binary",
         [OUTPUT_JSON] = "json",
         [OUTPUT_JSON_PRETTY] = "json-pretty",
         [OUTPUT_JSON_SSE] = "json-sse",
@@ -37,6 +37,21 @@ int output_journal(
                 OutputFlags flags,
                 bool *ellipsized);
 
+/* Writes out what output_journal() holds back for the calling thread,
+ * and flushes the stream. Export output to a stream which isn't a
+ * terminal is written in batches of entries, callers which wait for
+ * more entries or stop writing have to call this instead of fflush(). */
+int output_flush(FILE *f);
+
+/* Frees the buffers output_journal() keeps for the calling thread,
+ * dropping anything not written with output_flush() */
+void output_free_scratch(void);
+
+/* Gives a stream which isn't a terminal a large buffer. The output
+ * isn't flushed after every entry, callers which wait for more
+ * entries have to flush it themselves. Call before writing to it. */
+void output_buffer_stream(FILE *f);
+
 int add_match_this_boot(sd_journal *j);
 
 void json_escape(
@@ -0,0 +1,684 @@
+/*
+ * Copyright © 2018 - Vitaliy Perevertun
+ *
+ * This file is part of journal
+ *
+ * This file is licensed under the MIT license.
+ * See the file LICENSE.
+ */
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "compress.h"
+#include "hash/hash.h"
+#include "journal-file.h"
+#include "hashmap.h"
+#include "util.h"
+#include "macro.h"
+#include "log.h"
+
+/* Compression benchmark over real journal data.
+ *
+ * Takes journal files (*.journal, *.journal~) and export streams
+ * (anything else, "-" for stdin), collects every distinct data
+ * object within the size range and reports per codec and per size
+ * bucket the compression ratio, the throughput and the latency
+ * percentiles of compression, decompression and
+ * decompress_startswith(). */
+
+typedef int (compress_t)(const void *src, uint64_t src_size, void *dst, size_t *dst_size);
+
+typedef struct Codec {
+        const char *name;
+        int compression;
+        compress_t *compress;
+} Codec;
+
+static const Codec codecs[] = {
+#ifdef HAVE_XZ
+        { "XZ", OBJECT_COMPRESSED_XZ, compress_blob_xz },
+#endif
+#ifdef HAVE_LZ4
+        { "LZ4", OBJECT_COMPRESSED_LZ4, compress_blob_lz4 },
+#endif
+};
+
+typedef struct Sample {
+        uint64_t hash;
+        size_t size;
+        char *data;
+} Sample;
+
+typedef struct Stats {
+        size_t max_size; /* 0 for the summary over all buckets */
+        unsigned n_objects;
+        unsigned n_compressed;
+        uint64_t bytes_in;
+        uint64_t bytes_out;
+        uint64_t bytes_decompressed; /* bytes_in of the compressed objects only */
+        nsec_t compress_time;
+        nsec_t decompress_time;
+        nsec_t *compress_lat;
+        nsec_t *decompress_lat;
+        nsec_t *startswith_lat;
+} Stats;
+
+enum {
+        FORMAT_TEXT,
+        FORMAT_JSON,
+        FORMAT_CSV
+};
+
+static int arg_format = FORMAT_TEXT;
+static size_t arg_min_size = 64;
+static size_t arg_max_size = 4096;
+static unsigned arg_limit = 0;
+
+static Sample *samples = NULL;
+static size_t n_samples = 0, n_samples_allocated = 0;
+static Hashmap *seen = NULL;
+
+static nsec_t now_nsec(void) {
+        struct timespec ts;
+
+        assert_se(clock_gettime(CLOCK_MONOTONIC, &ts) == 0);
+
+        return (nsec_t) ts.tv_sec * NSEC_PER_SEC + (nsec_t) ts.tv_nsec;
+}
+
+static int add_sample(const void *data, size_t size) {
+        Sample *s;
+        uint64_t hash, *key;
+
+        if (size < arg_min_size || size > arg_max_size)
+                return 0;
+
+        if (arg_limit > 0 && n_samples >= arg_limit)
+                return 0;
+
+        /* Data objects are stored only once per journal file, hence
+         * skip values we have already seen */
+        hash64(data, size, &hash);
+        if (hashmap_get(seen, &hash))
+                return 0;
+
+        if (!GREEDY_REALLOC(samples, n_samples_allocated, n_samples + 1))
+                return log_oom();
+
+        s = samples + n_samples;
+        s->hash = hash;
+        s->size = size;
+        s->data = memdup(data, size);
+        if (!s->data)
+                return log_oom();
+
+        /* The sample array might be reallocated later, hence keep
+         * the hash key in its own allocation */
+        key = memdup(&hash, sizeof(hash));
+        if (!key || hashmap_put(seen, key, UINT_TO_PTR(1)) < 0) {
+                free(key);
+                free(s->data);
+                return log_oom();
+        }
+
+        n_samples++;
+
+        return 1;
+}
+
+static int load_journal_file(const char *path) {
+        _cleanup_free_ void *buf = NULL;
+        size_t buf_size = 0;
+        JournalFile *f;
+        Object *o;
+        uint64_t p;
+        int r;
+
+        r = journal_file_open(path, O_RDONLY, 0, false, false, NULL, NULL, NULL, &f);
+        if (r < 0) {
+                log_error("Failed to open %s: %s", path, strerror(-r));
+                return r;
+        }
+
+        p = le64toh(f->header->header_size);
+        while (p > 0 && le64toh(f->header->tail_object_offset) > 0) {
+                int compression;
+                uint64_t l;
+
+                r = journal_file_move_to_object(f, -1, p, &o);
+                if (r < 0) {
+                        log_error("%s: failed to read object at "OFSfmt": %s", path, p, strerror(-r));
+                        goto finish;
+                }
+
+                if (o->object.type != OBJECT_DATA)
+                        goto next;
+
+                l = le64toh(o->object.size) - offsetof(Object, data.payload);
+
+                compression = o->object.flags & OBJECT_COMPRESSION_MASK;
+                if (compression) {
+                        size_t rsize;
+
+                        r = decompress_blob(compression, o->data.payload, l, &buf, &buf_size, &rsize, 0);
+                        if (r < 0) {
+                                log_error("%s: failed to decompress object at "OFSfmt": %s", path, p, strerror(-r));
+                                goto finish;
+                        }
+
+                        r = add_sample(buf, rsize);
+                } else
+                        r = add_sample(o->data.payload, l);
+                if (r < 0)
+                        goto finish;
+
+        next:
+                if (p == le64toh(f->header->tail_object_offset))
+                        p = 0;
+                else
+                        p += ALIGN64(le64toh(o->object.size));
+        }
+
+        r = 0;
+
+finish:
+        journal_file_close(f);
+
+        return r;
+}
+
+static int read_stream(FILE *f, char **ret, size_t *size) {
+        _cleanup_free_ char *buf = NULL;
+        size_t allocated = 0, n = 0;
+
+        for (;;) {
+                size_t k;
+
+                if (!GREEDY_REALLOC(buf, allocated, n + 64 * 1024 + 1))
+                        return log_oom();
+
+                k = fread(buf + n, 1, allocated - n - 1, f);
+                n += k;
+
+                if (k == 0) {
+                        if (ferror(f))
+                                return -EIO;
+                        break;
+                }
+        }
+
+        buf[n] = 0;
+
+        *ret = buf;
+        *size = n;
+        buf = NULL;
+
+        return 0;
+}
+
+static int load_export_stream(const char *path) {
+        _cleanup_free_ char *buf = NULL, *field = NULL;
+        size_t size, allocated = 0;
+        const char *p, *e;
+        int r;
+
+        /* Export streams easily exceed the limit of read_full_file() */
+        if (streq(path, "-"))
+                r = read_stream(stdin, &buf, &size);
+        else {
+                _cleanup_fclose_ FILE *f = NULL;
+
+                f = fopen(path, "re");
+                if (!f)
+                        r = -errno;
+                else
+                        r = read_stream(f, &buf, &size);
+        }
+        if (r < 0) {
+                log_error("Failed to read %s: %s", path, strerror(-r));
+                return r;
+        }
+
+        p = buf;
+        e = buf + size;
+        while (p < e) {
+                const char *nl, *eq;
+                size_t n;
+
+                nl = memchr(p, '\n', e - p);
+                if (!nl)
+                        nl = e;
+
+                /* Empty lines separate entries, and the "__" fields
+                 * are not stored in data objects */
+                if (nl == p || (nl - p >= 2 && p[0] == '_' && p[1] == '_'))
+                        goto next;
+
+                eq = memchr(p, '=', nl - p);
+                if (eq) {
+                        r = add_sample(p, nl - p);
+                        if (r < 0)
+                                return r;
+
+                        goto next;
+                }
+
+                /* Binary field: the name is followed by the
+                 * little-endian 64bit size and the data */
+                if (e - nl < 1 + 8) {
+                        log_error("%s: truncated binary field", path);
+                        return -EBADMSG;
+                }
+
+                n = (size_t) le64toh(*(le64_t*) (nl + 1));
+                if ((size_t) (e - nl - 1 - 8) < n) {
+                        log_error("%s: truncated binary field", path);
+                        return -EBADMSG;
+                }
+
+                if (!GREEDY_REALLOC(field, allocated, (nl - p) + 1 + n))
+                        return log_oom();
+
+                memcpy(field, p, nl - p);
+                field[nl - p] = '=';
+                memcpy(field + (nl - p) + 1, nl + 1 + 8, n);
+
+                r = add_sample(field, (nl - p) + 1 + n);
+                if (r < 0)
+                        return r;
+
+                nl += 1 + 8 + n;
+
+        next:
+                p = nl + 1;
+        }
+
+        return 0;
+}
+
+static int uint64_cmp(const void *_a, const void *_b) {
+        const nsec_t *a = _a, *b = _b;
+
+        return *a < *b ? -1 : *a > *b ? 1 : 0;
+}
+
+static nsec_t percentile(nsec_t *lat, unsigned n, unsigned pct) {
+        if (n == 0)
+                return 0;
+
+        return lat[(n - 1) * pct / 100];
+}
+
+static double mib_per_sec(uint64_t bytes, nsec_t t) {
+        if (t == 0)
+                return 0;
+
+        return bytes / 1024. / 1024. / ((double) t / NSEC_PER_SEC);
+}
+
+static int run_codec(const Codec *c, Stats *stats, unsigned n_stats) {
+        _cleanup_free_ char *buf = NULL;
+        _cleanup_free_ void *out = NULL;
+        size_t out_allocated = 0;
+        size_t i;
+        unsigned k;
+
+        buf = malloc(arg_max_size);
+        if (!buf)
+                return log_oom();
+
+        for (k = 0; k < n_stats; k++) {
+                stats[k].compress_lat = new(nsec_t, n_samples);
+                stats[k].decompress_lat = new(nsec_t, n_samples);
+                stats[k].startswith_lat = new(nsec_t, n_samples);
+                if (!stats[k].compress_lat || !stats[k].decompress_lat || !stats[k].startswith_lat)
+                        return log_oom();
+        }
+
+        for (i = 0; i < n_samples; i++) {
+                const Sample *s = samples + i;
+                Stats *b, *all = stats + n_stats - 1;
+                const char *eq;
+                nsec_t t0, t1, t2, t3;
+                size_t j = 0, l = 0;
+                int r;
+
+                for (b = stats; b->max_size > 0 && b->max_size < s->size; b++)
+                        ;
+
+                t0 = now_nsec();
+                r = c->compress(s->data, s->size, buf, &j);
+                t1 = now_nsec();
+
+                b->compress_lat[b->n_objects] = all->compress_lat[all->n_objects] = t1 - t0;
+                b->compress_time += t1 - t0;
+                all->compress_time += t1 - t0;
+                b->bytes_in += s->size;
+                all->bytes_in += s->size;
+                b->n_objects++;
+                all->n_objects++;
+
+                if (r < 0) {
+                        /* The object would be stored uncompressed */
+                        b->bytes_out += s->size;
+                        all->bytes_out += s->size;
+                        continue;
+                }
+
+                b->bytes_out += j;
+                all->bytes_out += j;
+
+                t1 = now_nsec();
+                r = decompress_blob(c->compression, buf, j, &out, &out_allocated, &l, 0);
+                t2 = now_nsec();
+                if (r < 0 || l != s->size || memcmp(out, s->data, l) != 0) {
+                        log_error("%s: round trip of %zu bytes failed", c->name, s->size);
+                        return r < 0 ? r : -EBADMSG;
+                }
+
+                eq = memchr(s->data, '=', s->size);
+                if (!eq)
+                        eq = s->data;
+
+                r = decompress_startswith(c->compression, buf, j, &out, &out_allocated,
+                                          s->data, eq - s->data, '=');
+                t3 = now_nsec();
+                if (r < 0) {
+                        log_error("%s: prefix check of %zu bytes failed", c->name, s->size);
+                        return r;
+                }
+
+                b->decompress_lat[b->n_compressed] = all->decompress_lat[all->n_compressed] = t2 - t1;
+                b->startswith_lat[b->n_compressed] = all->startswith_lat[all->n_compressed] = t3 - t2;
+                b->decompress_time += t2 - t1;
+                all->decompress_time += t2 - t1;
+                b->bytes_decompressed += s->size;
+                all->bytes_decompressed += s->size;
+                b->n_compressed++;
+                all->n_compressed++;
+        }
+
+        for (k = 0; k < n_stats; k++) {
+                qsort(stats[k].compress_lat, stats[k].n_objects, sizeof(nsec_t), uint64_cmp);
+                qsort(stats[k].decompress_lat, stats[k].n_compressed, sizeof(nsec_t), uint64_cmp);
+                qsort(stats[k].startswith_lat, stats[k].n_compressed, sizeof(nsec_t), uint64_cmp);
+        }
+
+        return 0;
+}
+
+static void print_header(void) {
+        if (arg_format == FORMAT_CSV)
+                printf("codec,bucket,objects,compressed,bytes_in,bytes_out,ratio,"
+                       "compress_mibs,decompress_mibs,"
+                       "compress_p50_ns,compress_p90_ns,compress_p99_ns,"
+                       "decompress_p50_ns,decompress_p90_ns,decompress_p99_ns,"
+                       "startswith_p50_ns,startswith_p90_ns,startswith_p99_ns\n");
+        else if (arg_format == FORMAT_JSON)
+                printf("[");
+        else
+                printf("%-5s %7s %8s %8s %7s %10s %10s %10s %10s %10s %10s %10s\n",
+                       "CODEC", "BUCKET", "OBJECTS", "COMPR", "RATIO",
+                       "C MiB/s", "D MiB/s",
+                       "C p50 ns", "C p99 ns", "D p50 ns", "D p99 ns", "S p50 ns");
+}
+
+static void print_stats(const Codec *c, const Stats *s, bool first) {
+        char bucket[DECIMAL_STR_MAX(size_t)];
+        double ratio;
+
+        if (s->max_size > 0)
+                snprintf(bucket, sizeof(bucket), "%zu", s->max_size);
+        else
+                strcpy(bucket, "all");
+
+        ratio = s->bytes_in > 0 ? (double) s->bytes_out / s->bytes_in : 1;
+
+        if (arg_format == FORMAT_CSV)
+                printf("%s,%s,%u,%u,%"PRIu64",%"PRIu64",%.4f,%.2f,%.2f,"
+                       NSEC_FMT","NSEC_FMT","NSEC_FMT","
+                       NSEC_FMT","NSEC_FMT","NSEC_FMT","
+                       NSEC_FMT","NSEC_FMT","NSEC_FMT"\n",
+                       c->name, bucket, s->n_objects, s->n_compressed,
+                       s->bytes_in, s->bytes_out, ratio,
+                       mib_per_sec(s->bytes_in, s->compress_time),
+                       mib_per_sec(s->bytes_decompressed, s->decompress_time),
+                       percentile(s->compress_lat, s->n_objects, 50),
+                       percentile(s->compress_lat, s->n_objects, 90),
+                       percentile(s->compress_lat, s->n_objects, 99),
+                       percentile(s->decompress_lat, s->n_compressed, 50),
+                       percentile(s->decompress_lat, s->n_compressed, 90),
+                       percentile(s->decompress_lat, s->n_compressed, 99),
+                       percentile(s->startswith_lat, s->n_compressed, 50),
+                       percentile(s->startswith_lat, s->n_compressed, 90),
+                       percentile(s->startswith_lat, s->n_compressed, 99));
+        else if (arg_format == FORMAT_JSON)
+                printf("%s\n\t{ \"codec\" : \"%s\", \"bucket\" : \"%s\", "
+                       "\"objects\" : %u, \"compressed\" : %u, "
+                       "\"bytes_in\" : %"PRIu64", \"bytes_out\" : %"PRIu64", \"ratio\" : %.4f, "
+                       "\"compress_mibs\" : %.2f, \"decompress_mibs\" : %.2f, "
+                       "\"compress_ns\" : [ "NSEC_FMT", "NSEC_FMT", "NSEC_FMT" ], "
+                       "\"decompress_ns\" : [ "NSEC_FMT", "NSEC_FMT", "NSEC_FMT" ], "
+                       "\"startswith_ns\" : [ "NSEC_FMT", "NSEC_FMT", "NSEC_FMT" ] }",
+                       first ? "" : ",",
+                       c->name, bucket, s->n_objects, s->n_compressed,
+                       s->bytes_in, s->bytes_out, ratio,
+                       mib_per_sec(s->bytes_in, s->compress_time),
+                       mib_per_sec(s->bytes_decompressed, s->decompress_time),
+                       percentile(s->compress_lat, s->n_objects, 50),
+                       percentile(s->compress_lat, s->n_objects, 90),
+                       percentile(s->compress_lat, s->n_objects, 99),
+                       percentile(s->decompress_lat, s->n_compressed, 50),
+                       percentile(s->decompress_lat, s->n_compressed, 90),
+                       percentile(s->decompress_lat, s->n_compressed, 99),
+                       percentile(s->startswith_lat, s->n_compressed, 50),
+                       percentile(s->startswith_lat, s->n_compressed, 90),
+                       percentile(s->startswith_lat, s->n_compressed, 99));
+        else
+                printf("%-5s %7s %8u %8u %7.3f %10.2f %10.2f %10"PRIu64" %10"PRIu64" %10"PRIu64" %10"PRIu64" %10"PRIu64"\n",
+                       c->name, bucket, s->n_objects, s->n_compressed, ratio,
+                       mib_per_sec(s->bytes_in, s->compress_time),
+                       mib_per_sec(s->bytes_decompressed, s->decompress_time),
+                       percentile(s->compress_lat, s->n_objects, 50),
+                       percentile(s->compress_lat, s->n_objects, 99),
+                       percentile(s->decompress_lat, s->n_compressed, 50),
+                       percentile(s->decompress_lat, s->n_compressed, 99),
+                       percentile(s->startswith_lat, s->n_compressed, 50));
+}
+
+static void help(void) {
+        printf("%s [OPTIONS...] FILE...\n\n"
+               "Benchmark compression codecs on journal files and export streams.\n\n"
+               "  -h --help              Show this help\n"
+               "     --format=FORMAT     Output format (text, json, csv)\n"
+               "     --min-size=BYTES    Ignore objects smaller than BYTES (default 64)\n"
+               "     --max-size=BYTES    Ignore objects larger than BYTES (default 4096)\n"
+               "     --limit=N           Use at most N distinct objects\n"
+               , program_invocation_short_name);
+}
+
+static int parse_argv(int argc, char *argv[]) {
+
+        enum {
+                ARG_FORMAT = 0x100,
+                ARG_MIN_SIZE,
+                ARG_MAX_SIZE,
+                ARG_LIMIT
+        };
+
+        static const struct option options[] = {
+                { "help",     no_argument,       NULL, 'h'          },
+                { "format",   required_argument, NULL, ARG_FORMAT   },
+                { "min-size", required_argument, NULL, ARG_MIN_SIZE },
+                { "max-size", required_argument, NULL, ARG_MAX_SIZE },
+                { "limit",    required_argument, NULL, ARG_LIMIT    },
+                {}
+        };
+
+        unsigned u;
+        int c;
+
+        while ((c = getopt_long(argc, argv, "h", options, NULL)) >= 0) {
+
+                switch (c) {
+
+                case 'h':
+                        help();
+                        return 0;
+
+                case ARG_FORMAT:
+                        if (streq(optarg, "text"))
+                                arg_format = FORMAT_TEXT;
+                        else if (streq(optarg, "json"))
+                                arg_format = FORMAT_JSON;
+                        else if (streq(optarg, "csv"))
+                                arg_format = FORMAT_CSV;
+                        else {
+                                log_error("Unknown output format '%s'.", optarg);
+                                return -EINVAL;
+                        }
+                        break;
+
+                case ARG_MIN_SIZE:
+                case ARG_MAX_SIZE:
+                        if (safe_atou(optarg, &u) < 0 || u == 0) {
+                                log_error("Failed to parse size '%s'.", optarg);
+                                return -EINVAL;
+                        }
+
+                        if (c == ARG_MIN_SIZE)
+                                arg_min_size = u;
+                        else
+                                arg_max_size = u;
+                        break;
+
+                case ARG_LIMIT:
+                        if (safe_atou(optarg, &arg_limit) < 0) {
+                                log_error("Failed to parse limit '%s'.", optarg);
+                                return -EINVAL;
+                        }
+                        break;
+
+                case '?':
+                        return -EINVAL;
+
+                default:
+                        assert_not_reached("Unhandled option");
+                }
+        }
+
+        if (arg_min_size > arg_max_size) {
+                log_error("--min-size= must not be larger than --max-size=.");
+                return -EINVAL;
+        }
+
+        if (optind >= argc) {
+                log_error("No journal files or export streams specified.");
+                return -EINVAL;
+        }
+
+        return 1;
+}
+
+int main(int argc, char *argv[]) {
+        Stats *stats = NULL;
+        unsigned n_stats = 0, k;
+        bool first = true;
+        size_t bound, i;
+        void *key;
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        r = parse_argv(argc, argv);
+        if (r <= 0)
+                return r < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+
+        seen = hashmap_new(uint64_hash_func, uint64_compare_func);
+        if (!seen) {
+                log_oom();
+                return EXIT_FAILURE;
+        }
+
+        for (; optind < argc; optind++) {
+                const char *path = argv[optind];
+
+                if (endswith(path, ".journal") || endswith(path, ".journal~"))
+                        r = load_journal_file(path);
+                else
+                        r = load_export_stream(path);
+                if (r < 0)
+                        goto finish;
+        }
+
+        log_info("Loaded %zu distinct objects of %zu..%zu bytes.", n_samples, arg_min_size, arg_max_size);
+
+        /* One bucket per power of two up to the maximum size, plus
+         * the summary over all of them */
+        for (bound = 64; bound < arg_max_size; bound *= 2)
+                n_stats++;
+        n_stats += 2;
+
+        print_header();
+
+        for (k = 0; k < ELEMENTSOF(codecs); k++) {
+                unsigned m = 0;
+
+                stats = new0(Stats, n_stats);
+                if (!stats) {
+                        r = log_oom();
+                        goto finish;
+                }
+
+                for (bound = 64; bound < arg_max_size; bound *= 2)
+                        stats[m++].max_size = bound;
+                stats[m].max_size = arg_max_size;
+
+                r = run_codec(codecs + k, stats, n_stats);
+                if (r < 0)
+                        goto finish;
+
+                for (m = 0; m < n_stats; m++)
+                        if (stats[m].n_objects > 0) {
+                                print_stats(codecs + k, stats + m, first);
+                                first = false;
+                        }
+
+                for (m = 0; m < n_stats; m++) {
+                        free(stats[m].compress_lat);
+                        free(stats[m].decompress_lat);
+                        free(stats[m].startswith_lat);
+                }
+                free(stats);
+                stats = NULL;
+        }
+
+        if (arg_format == FORMAT_JSON)
+                printf("\n]\n");
+
+        r = 0;
+
+finish:
+        if (stats) {
+                for (k = 0; k < n_stats; k++) {
+                        free(stats[k].compress_lat);
+                        free(stats[k].decompress_lat);
+                        free(stats[k].startswith_lat);
+                }
+                free(stats);
+        }
+
+        for (i = 0; i < n_samples; i++)
+                free(samples[i].data);
+        free(samples);
+
+        while ((key = hashmap_steal_first_key(seen)))
+                free(key);
+        hashmap_free(seen);
+
+        return r < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
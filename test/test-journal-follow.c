@@ -0,0 +1,138 @@
+/*
+ * Copyright © 2018 - Vitaliy Perevertun
+ *
+ * This file is part of journal
+ *
+ * This file is licensed under the MIT license.
+ * See the file LICENSE.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "journal.h"
+#include "journal-file.h"
+#include "journal-internal.h"
+#include "log.h"
+#include "util.h"
+
+static void append(JournalFile *f) {
+        struct iovec iovec;
+
+        IOVEC_SET_STRING(iovec, "MESSAGE=follow");
+        assert_se(journal_file_append_entry(f, NULL, &iovec, 1, NULL, NULL, NULL) == 0);
+}
+
+static void skip_to_end(sd_journal *j, unsigned n) {
+        unsigned i;
+
+        for (i = 0; i < n; i++)
+                assert_se(sd_journal_next(j) == 1);
+
+        assert_se(sd_journal_next(j) == 0);
+}
+
+int main(int argc, char *argv[]) {
+        char dn[] = "/var/tmp/test-journal-follow.XXXXXX";
+        _cleanup_free_ char *fn = NULL;
+        JournalFile *f;
+        sd_journal *polling, *watching;
+        usec_t start, due;
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(dn));
+        fn = strappend(dn, "/test.journal");
+        assert_se(fn);
+
+        assert_se(journal_file_open(fn, O_RDWR|O_CREAT, 0644, false, false, NULL, NULL, NULL, &f) == 0);
+
+        /* Nothing tells inotify about the writes */
+        f->defer_post_change = true;
+        append(f);
+
+        assert_se(sd_journal_open_directory(&polling, dn, 0) >= 0);
+        journal_set_poll_interval(polling, USEC_PER_MSEC);
+        assert_se(sd_journal_get_fd(polling) >= 0);
+
+        /* Only readers relying on inotify ask for notifications */
+        assert_se(journal_file_has_followers(f) == 0);
+
+        assert_se(sd_journal_open_directory(&watching, dn, 0) >= 0);
+        assert_se(sd_journal_get_fd(watching) >= 0);
+
+        assert_se(journal_file_has_followers(f) == 1);
+
+        skip_to_end(polling, 1);
+        skip_to_end(watching, 1);
+
+        assert_se(sd_journal_wait(polling, 20 * USEC_PER_MSEC) == SD_JOURNAL_NOP);
+
+        append(f);
+
+        /* The header shows the new entry right away */
+        start = now(CLOCK_MONOTONIC);
+        assert_se(sd_journal_wait(polling, 10 * USEC_PER_SEC) == SD_JOURNAL_APPEND);
+        assert_se(now(CLOCK_MONOTONIC) - start < USEC_PER_SEC);
+        skip_to_end(polling, 1);
+
+        /* inotify needs the writer to tell */
+        assert_se(sd_journal_wait(watching, 20 * USEC_PER_MSEC) == SD_JOURNAL_NOP);
+
+        journal_file_post_change(f);
+
+        assert_se(sd_journal_wait(watching, 10 * USEC_PER_SEC) > SD_JOURNAL_NOP);
+        skip_to_end(watching, 1);
+
+        /* The polling reader still gets the event, for an entry it
+         * has seen already */
+        assert_se(sd_journal_wait(polling, 10 * USEC_PER_SEC) > SD_JOURNAL_NOP);
+        assert_se(sd_journal_next(polling) == 0);
+
+        sd_journal_close(polling);
+
+        /* Notifications at most once per interval */
+        f->defer_post_change = false;
+        f->notify_interval = 100 * USEC_PER_MSEC;
+
+        append(f);
+        assert_se(!f->notify_pending);
+        assert_se(sd_journal_wait(watching, 10 * USEC_PER_SEC) > SD_JOURNAL_NOP);
+        skip_to_end(watching, 1);
+
+        append(f);
+        append(f);
+        assert_se(f->notify_pending);
+        assert_se(f->n_notify_suppressed == 2);
+
+        due = journal_file_notify_pending(f);
+        assert_se(due == f->notify_timestamp + f->notify_interval);
+        assert_se(sd_journal_wait(watching, 20 * USEC_PER_MSEC) == SD_JOURNAL_NOP);
+
+        usleep(due - MIN(due, now(CLOCK_MONOTONIC)));
+        assert_se(journal_file_notify_pending(f) == 0);
+        assert_se(sd_journal_wait(watching, 10 * USEC_PER_SEC) > SD_JOURNAL_NOP);
+        skip_to_end(watching, 2);
+
+        sd_journal_close(watching);
+
+        /* Nobody to tell, but readers which don't take the lock
+         * are still told unless asked otherwise */
+        assert_se(journal_file_has_followers(f) == 0);
+        usleep(f->notify_interval);
+        append(f);
+        assert_se(!f->notify_pending);
+        assert_se(f->n_notify_suppressed == 2);
+
+        f->notify_followers_only = true;
+        usleep(f->notify_interval);
+        append(f);
+        assert_se(!f->notify_pending);
+        assert_se(f->n_notify_suppressed == 3);
+
+        journal_file_close(f);
+
+        assert_se(rm_rf_dangerous(dn, false, true, false) >= 0);
+
+        return 0;
+}
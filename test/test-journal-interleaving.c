@@ -52,7 +52,7 @@ noreturn static void log_assert_errno(const char *text, int eno, const char *fil
 
 static JournalFile *test_open(const char *name) {
         JournalFile *f;
-        assert_ret(journal_file_open(name, O_RDWR|O_CREAT, 0644, true, NULL, NULL, NULL, &f));
+        assert_ret(journal_file_open(name, O_RDWR|O_CREAT, 0644, true, false, NULL, NULL, NULL, &f));
         return f;
 }
 
@@ -74,6 +74,18 @@ static void append_number(JournalFile *f, int n, uint64_t *seqnum) {
         free(p);
 }
 
+static void append_number_at(JournalFile *f, int n, usec_t realtime, usec_t monotonic) {
+        char *p;
+        dual_timestamp ts = { .realtime = realtime, .monotonic = monotonic };
+        struct iovec iovec[1];
+
+        assert_se(asprintf(&p, "NUMBER=%d", n) >= 0);
+        iovec[0].iov_base = p;
+        iovec[0].iov_len = strlen(p);
+        assert_ret(journal_file_append_entry(f, &ts, iovec, 1, NULL, NULL, NULL));
+        free(p);
+}
+
 static void test_check_number (sd_journal *j, int n) {
         const void *d;
         _cleanup_free_ char *k = NULL;
@@ -197,6 +209,335 @@ static void test_skip(void (*setup)(void)) {
         puts("------------------------------------------------------------");
 }
 
+static void test_tail_window(void (*setup)(void)) {
+        char t[] = "/tmp/journal-tail-XXXXXX";
+        sd_journal *j;
+        uint64_t from, to;
+        int i, n, r;
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        setup();
+
+        /* Entries can be split at any time.
+         */
+        assert_ret(sd_journal_open_directory(&j, t, 0));
+        assert_se(sd_journal_get_cutoff_realtime_usec(j, &from, &to) > 0);
+        assert_se(journal_realtime_ordered(j, from) == 1);
+        assert_se(journal_realtime_ordered(j, from + (to - from) / 2) == 1);
+        assert_se(journal_realtime_ordered(j, to) == 1);
+        sd_journal_close(j);
+
+        /* Move to the last n entries, iterate down.
+         */
+        for (n = 1; n <= 5; n++) {
+                assert_ret(sd_journal_open_directory(&j, t, 0));
+                assert_ret(r = journal_seek_tail_window(j, n));
+                assert_se(r == 1);
+
+                for (i = MAX(5 - n, 1); i <= 4; i++) {
+                        test_check_number(j, i);
+                        assert_ret(r = sd_journal_next(j));
+                        assert_se(r == (i < 4));
+                }
+                sd_journal_close(j);
+        }
+
+        /* With a single match, count only its entries.
+         */
+        assert_ret(sd_journal_open_directory(&j, t, 0));
+        assert_ret(sd_journal_add_match(j, "NUMBER=3", 0));
+        assert_ret(r = journal_seek_tail_window(j, 2));
+        assert_se(r == 1);
+        test_check_number(j, 3);
+        assert_se(sd_journal_next(j) == 0);
+
+        assert_ret(sd_journal_add_match(j, "NUMBER=2", 0));
+        assert_se(journal_seek_tail_window(j, 2) == -EOPNOTSUPP);
+        sd_journal_close(j);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf_dangerous(t, false, true, false) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+static void check_tail_fallback(const char *t, int last, usec_t realtime) {
+        sd_journal *j;
+        int i, r;
+
+        assert_ret(sd_journal_open_directory(&j, t, 0));
+        assert_se(journal_seek_tail_window(j, 5) == -EOPNOTSUPP);
+
+        /* Neither can the entries be split by realtime for threads */
+        assert_se(journal_realtime_ordered(j, realtime) == 0);
+
+        assert_ret(sd_journal_seek_tail(j));
+        assert_ret(r = sd_journal_previous_skip(j, 5));
+        assert_se(r == 5);
+
+        for (i = last - 4; i <= last; i++) {
+                test_check_number(j, i);
+                assert_ret(r = sd_journal_next(j));
+                assert_se(r == (i < last));
+        }
+
+        sd_journal_close(j);
+}
+
+static void test_tail_window_clock_step(void) {
+        char t[] = "/tmp/journal-step-XXXXXX";
+        JournalFile *one, *two;
+        usec_t base;
+        int i;
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        base = now(CLOCK_REALTIME) - 3600 * USEC_PER_SEC;
+
+        /* The clock is stepped back by 1000s within the file
+         */
+        one = test_open("one.journal");
+        assert_se(JOURNAL_HEADER_REALTIME_ORDERED(one->header));
+        for (i = 1; i <= 100; i++)
+                append_number_at(one, i, base + i * USEC_PER_SEC - (i > 60 ? 1000 * USEC_PER_SEC : 0), i);
+        assert_se(!JOURNAL_HEADER_REALTIME_ORDERED(one->header));
+        test_close(one);
+
+        check_tail_fallback(t, 100, base + 30 * USEC_PER_SEC);
+        assert_se(unlink("one.journal") >= 0);
+
+        /* The clock is stepped back between the entries of two files,
+         * each of which is ordered by itself
+         */
+        one = test_open("one.journal");
+        two = test_open("two.journal");
+        for (i = 1; i <= 50; i++)
+                append_number_at(one, i, base + 1000 * USEC_PER_SEC + i * USEC_PER_SEC, i);
+        for (i = 51; i <= 100; i++)
+                append_number_at(two, i, base + i * USEC_PER_SEC, i);
+        assert_se(JOURNAL_HEADER_REALTIME_ORDERED(one->header));
+        assert_se(JOURNAL_HEADER_REALTIME_ORDERED(two->header));
+        test_close(one);
+        test_close(two);
+
+        check_tail_fallback(t, 100, base + 1001 * USEC_PER_SEC);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf_dangerous(t, false, true, false) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_grow(void) {
+        char t[] = "/tmp/journal-grow-XXXXXX";
+        JournalFile *one, *two;
+        sd_journal *j;
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        one = test_open("one.journal");
+        two = test_open("two.journal");
+        append_number(one, 1, NULL);
+        append_number(two, 2, NULL);
+
+        /* Iterate to the end, then let both files grow, and check
+         * that files which ran out of entries are looked at again */
+        assert_ret(sd_journal_open_directory(&j, t, 0));
+        assert_ret(sd_journal_seek_head(j));
+        assert_se(sd_journal_next(j) == 1);
+        test_check_number(j, 1);
+        assert_se(sd_journal_next(j) == 1);
+        test_check_number(j, 2);
+        assert_se(sd_journal_next(j) == 0);
+
+        append_number(two, 3, NULL);
+        append_number(one, 4, NULL);
+
+        assert_se(sd_journal_next(j) == 1);
+        test_check_number(j, 3);
+        assert_se(sd_journal_next(j) == 1);
+        test_check_number(j, 4);
+        assert_se(sd_journal_next(j) == 0);
+
+        /* Turning around merges the files in the other direction */
+        assert_se(sd_journal_previous(j) == 1);
+        test_check_number(j, 3);
+        test_check_numbers_up(j, 3);
+
+        /* A match on data which doesn't exist yet starts to match
+         * once it is written */
+        assert_ret(sd_journal_add_match(j, "NUMBER=5", 0));
+        assert_se(sd_journal_next(j) == 0);
+
+        append_number(one, 5, NULL);
+
+        assert_se(sd_journal_next(j) == 1);
+        test_check_number(j, 5);
+        assert_se(sd_journal_next(j) == 0);
+
+        sd_journal_close(j);
+        test_close(one);
+        test_close(two);
+
+        log_info("Done...");
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, NULL);
+
+                assert_se(rm_rf_dangerous(t, false, true, false) >= 0);
+        }
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_prune(void) {
+        char t[] = "/tmp/journal-prune-XXXXXX";
+        JournalFile *one, *two, *three;
+        sd_journal *j;
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        one = test_open("one.journal");
+        two = test_open("two.journal");
+        three = test_open("three.journal");
+        append_number(one, 1, NULL);
+        append_number(one, 2, NULL);
+        append_number(two, 3, NULL);
+        append_number(two, 4, NULL);
+        append_number(three, 5, NULL);
+        append_number(three, 6, NULL);
+
+        /* The third file has none of the matched data, and is
+         * skipped as a whole */
+        assert_ret(sd_journal_open_directory(&j, t, 0));
+        assert_ret(sd_journal_add_match(j, "NUMBER=2", 0));
+        assert_ret(sd_journal_add_match(j, "NUMBER=4", 0));
+        assert_ret(sd_journal_seek_head(j));
+        assert_se(sd_journal_next(j) == 1);
+        test_check_number(j, 2);
+        assert_se(j->n_files_pruned == 1);
+        assert_se(sd_journal_next(j) == 1);
+        test_check_number(j, 4);
+        assert_se(sd_journal_next(j) == 0);
+
+        /* No file has data for both sides of the conjunction */
+        assert_ret(sd_journal_add_conjunction(j));
+        assert_ret(sd_journal_add_match(j, "NUMBER=6", 0));
+        assert_ret(sd_journal_seek_tail(j));
+        assert_se(sd_journal_previous(j) == 0);
+        assert_se(j->n_files_pruned == 3);
+
+        /* Files which were skipped are looked at again once they
+         * grow */
+        sd_journal_flush_matches(j);
+        assert_ret(sd_journal_add_match(j, "NUMBER=7", 0));
+        assert_ret(sd_journal_seek_head(j));
+        assert_se(sd_journal_next(j) == 0);
+
+        append_number(three, 7, NULL);
+
+        assert_se(sd_journal_next(j) == 1);
+        test_check_number(j, 7);
+        assert_se(sd_journal_next(j) == 0);
+
+        sd_journal_close(j);
+        test_close(one);
+        test_close(two);
+        test_close(three);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, NULL);
+
+                assert_se(rm_rf_dangerous(t, false, true, false) >= 0);
+        }
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_seek_prune(void) {
+        char t[] = "/tmp/journal-seek-prune-XXXXXX";
+        JournalFile *one, *two;
+        sd_journal *j;
+        uint64_t u;
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        one = test_open("one.journal");
+        two = test_open("two.journal");
+        append_number(one, 1, NULL);
+        append_number(one, 2, NULL);
+        usleep(10);
+        append_number(two, 3, NULL);
+        append_number(two, 4, NULL);
+
+        assert_ret(sd_journal_open_directory(&j, t, 0));
+        assert_ret(sd_journal_seek_head(j));
+        assert_se(sd_journal_next(j) == 1);
+        assert_se(sd_journal_next(j) == 1);
+        assert_se(sd_journal_next(j) == 1);
+        test_check_number(j, 3);
+        assert_ret(sd_journal_get_realtime_usec(j, &u));
+
+        /* The first file ends before the seek location, and isn't
+         * bisected */
+        assert_ret(sd_journal_seek_realtime_usec(j, u));
+        assert_se(sd_journal_next(j) == 1);
+        test_check_number(j, 3);
+        assert_se(j->n_files_pruned == 1);
+        assert_se(sd_journal_next(j) == 1);
+        test_check_number(j, 4);
+        assert_se(sd_journal_next(j) == 0);
+
+        /* The second file starts after the seek location */
+        assert_ret(sd_journal_seek_realtime_usec(j, u - 1));
+        assert_se(sd_journal_previous(j) == 1);
+        test_check_number(j, 2);
+        assert_se(j->n_files_pruned == 1);
+        test_check_numbers_up(j, 2);
+
+        /* Files skipped by the location are looked at again once
+         * they grow */
+        assert_ret(sd_journal_seek_realtime_usec(j, u));
+        assert_se(sd_journal_next(j) == 1);
+        assert_se(sd_journal_next(j) == 1);
+        assert_se(sd_journal_next(j) == 0);
+
+        usleep(10);
+        append_number(one, 5, NULL);
+
+        assert_se(sd_journal_next(j) == 1);
+        test_check_number(j, 5);
+        assert_se(sd_journal_next(j) == 0);
+
+        sd_journal_close(j);
+        test_close(one);
+        test_close(two);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, NULL);
+
+                assert_se(rm_rf_dangerous(t, false, true, false) >= 0);
+        }
+
+        puts("------------------------------------------------------------");
+}
+
 static void test_sequence_numbers(void) {
 
         char t[] = "/tmp/journal-seq-XXXXXX";
@@ -208,7 +549,7 @@ static void test_sequence_numbers(void) {
         assert_se(chdir(t) >= 0);
 
         assert_se(journal_file_open("one.journal", O_RDWR|O_CREAT, 0644,
-                                    true, NULL, NULL, NULL, &one) == 0);
+                                    true, false, NULL, NULL, NULL, &one) == 0);
 
         append_number(one, 1, &seqnum);
         printf("seqnum=%"PRIu64"\n", seqnum);
@@ -224,7 +565,7 @@ static void test_sequence_numbers(void) {
         memcpy(&seqnum_id, &one->header->seqnum_id, sizeof(uuid_t));
 
         assert_se(journal_file_open("two.journal", O_RDWR|O_CREAT, 0644,
-                                    true, NULL, NULL, one, &two) == 0);
+                                    true, false, NULL, NULL, one, &two) == 0);
 
         assert(two->header->state == STATE_ONLINE);
         assert(!uuid_equal(two->header->file_id, one->header->file_id));
@@ -254,7 +595,7 @@ static void test_sequence_numbers(void) {
         seqnum = 0;
 
         assert_se(journal_file_open("two.journal", O_RDWR, 0,
-                                    true, NULL, NULL, NULL, &two) == 0);
+                                    true, false, NULL, NULL, NULL, &two) == 0);
 
         assert(uuid_equal(two->header->seqnum_id, seqnum_id));
 
@@ -286,6 +627,14 @@ int main(int argc, char *argv[]) {
         test_skip(setup_sequential);
         test_skip(setup_interleaved);
 
+        test_tail_window(setup_sequential);
+        test_tail_window(setup_interleaved);
+        test_tail_window_clock_step();
+
+        test_grow();
+        test_prune();
+        test_seek_prune();
+
         test_sequence_numbers();
 
         return 0;
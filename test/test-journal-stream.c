@@ -38,9 +38,10 @@ static void verify_contents(sd_journal *j, unsigned skip) {
 
         i = 0;
         SD_JOURNAL_FOREACH(j) {
-                const void *d;
+                static const char * const fields[] = { "NUMBER", "MAGIC", "NONEXISTENT", "NUMBER" };
+                const void *d, *data[ELEMENTSOF(fields)];
                 char *k, *c;
-                size_t l;
+                size_t l, sizes[ELEMENTSOF(fields)];
                 unsigned u;
 
                 assert_se(sd_journal_get_cursor(j, &k) >= 0);
@@ -54,6 +55,14 @@ static void verify_contents(sd_journal *j, unsigned skip) {
                 assert_se(k = strndup(d, l));
                 printf("\t%s\n", k);
 
+                assert_se(sd_journal_get_data(j, "NONEXISTENT", &d, &l) == -ENOENT);
+
+                assert_se(sd_journal_get_fields(j, fields, ELEMENTSOF(fields), data, sizes) == 3);
+                assert_se(sizes[0] == l && memcmp(data[0], k, l) == 0);
+                assert_se(data[1] && sizes[1] > 6 && memcmp(data[1], "MAGIC=", 6) == 0);
+                assert_se(!data[2] && sizes[2] == 0);
+                assert_se(data[3] == data[0] && sizes[3] == sizes[0]);
+
                 if (skip > 0) {
                         assert_se(safe_atou(k + 7, &u) >= 0);
                         assert_se(i == u);
@@ -71,12 +80,27 @@ static void verify_contents(sd_journal *j, unsigned skip) {
                 assert_se(i == N_ENTRIES);
 }
 
+static unsigned current_number(sd_journal *j) {
+        const void *d;
+        size_t l;
+        unsigned u;
+        char *k;
+
+        assert_se(sd_journal_get_data(j, "NUMBER", &d, &l) >= 0);
+        assert_se(k = strndup((const char*) d + 7, l - 7));
+        assert_se(safe_atou(k, &u) >= 0);
+        free(k);
+
+        return u;
+}
+
 int main(int argc, char *argv[]) {
         JournalFile *one, *two, *three;
         char t[] = "/tmp/journal-stream-XXXXXX";
         unsigned i;
         _cleanup_journal_close_ sd_journal *j = NULL;
-        char *z;
+        char *z, *hint, *cursor, *cursors[4];
+        _cleanup_free_ char *prefix = NULL;
         const void *data;
         size_t l;
 
@@ -85,9 +109,9 @@ int main(int argc, char *argv[]) {
         assert_se(mkdtemp(t));
         assert_se(chdir(t) >= 0);
 
-        assert_se(journal_file_open("one.journal", O_RDWR|O_CREAT, 0666, true, NULL, NULL, NULL, &one) == 0);
-        assert_se(journal_file_open("two.journal", O_RDWR|O_CREAT, 0666, true, NULL, NULL, NULL, &two) == 0);
-        assert_se(journal_file_open("three.journal", O_RDWR|O_CREAT, 0666, true, NULL, NULL, NULL, &three) == 0);
+        assert_se(journal_file_open("one.journal", O_RDWR|O_CREAT, 0666, true, false, NULL, NULL, NULL, &one) == 0);
+        assert_se(journal_file_open("two.journal", O_RDWR|O_CREAT, 0666, true, false, NULL, NULL, NULL, &two) == 0);
+        assert_se(journal_file_open("three.journal", O_RDWR|O_CREAT, 0666, true, false, NULL, NULL, NULL, &three) == 0);
 
         for (i = 0; i < N_ENTRIES; i++) {
                 char *p, *q;
@@ -172,8 +196,91 @@ int main(int argc, char *argv[]) {
         verify_contents(j, 0);
 
         assert_se(sd_journal_query_unique(j, "NUMBER") >= 0);
-        SD_JOURNAL_FOREACH_UNIQUE(j, data, l)
+        i = 0;
+        SD_JOURNAL_FOREACH_UNIQUE(j, data, l) {
                 printf("%.*s\n", (int) l, (const char*) data);
+                i++;
+        }
+        assert_se(i == N_ENTRIES);
+
+        /* Values spread over several files are returned once, also
+         * when enumerating again */
+        assert_se(sd_journal_query_unique(j, "MAGIC") >= 0);
+        for (i = 0; i < 2; i++) {
+                unsigned n = 0;
+
+                SD_JOURNAL_FOREACH_UNIQUE(j, data, l) {
+                        assert_se(l == 10 || l == 11);
+                        n++;
+                }
+                assert_se(n == 2);
+        }
+
+        /* Cursors find their entry through the offset they carry,
+         * and by searching without one or with a wrong one */
+        sd_journal_flush_matches(j);
+        assert_se(sd_journal_seek_head(j) >= 0);
+        assert_se(sd_journal_next_skip(j, 3) == 3);
+        assert_se(sd_journal_get_cursor(j, &z) >= 0);
+        assert_se(hint = strdup(strstr(z, ";o=")));
+        free(z);
+        assert_se(sd_journal_next_skip(j, 6) == 6);
+        assert_se(sd_journal_get_cursor(j, &cursor) >= 0);
+
+        assert_se(z = strndup(cursor, strstr(cursor, ";f=") - cursor));
+        assert_se(cursors[0] = strdup(cursor));
+        assert_se(cursors[1] = strdup(z));
+        assert_se(prefix = strndup(cursor, strstr(cursor, ";o=") - cursor));
+        assert_se(cursors[2] = strappend(prefix, hint));
+        assert_se(cursors[3] = strappend(z, ";f=00000000000000000000000000000000;o=1000"));
+        free(z);
+
+        for (i = 0; i < ELEMENTSOF(cursors); i++) {
+                assert_se(sd_journal_seek_cursor(j, cursors[i]) >= 0);
+                assert_se(sd_journal_next(j) == 1);
+                assert_se(sd_journal_test_cursor(j, cursor) > 0);
+                assert_se(current_number(j) == 8);
+                assert_se(sd_journal_next(j) == 1);
+                assert_se(current_number(j) == 9);
+
+                assert_se(sd_journal_seek_cursor(j, cursors[i]) >= 0);
+                assert_se(sd_journal_previous(j) == 1);
+                assert_se(current_number(j) == 8);
+                assert_se(sd_journal_previous(j) == 1);
+                assert_se(current_number(j) == 7);
+
+                free(cursors[i]);
+        }
+
+        free(hint);
+        free(cursor);
+
+        /* Changing direction in the middle of an OR term, over
+         * numbers which are stored in one file only */
+        sd_journal_flush_matches(j);
+        for (i = 40; i < 54; i++) {
+                char m[sizeof("NUMBER=") + DECIMAL_STR_MAX(unsigned)];
+
+                if (i % 3 == 0 && i % 10 != 0)
+                        continue;
+
+                snprintf(m, sizeof(m), "NUMBER=%u", i);
+                assert_se(sd_journal_add_match(j, m, 0) >= 0);
+        }
+
+        assert_se(sd_journal_seek_head(j) >= 0);
+        assert_se(sd_journal_next_skip(j, 5) == 5);
+        assert_se(current_number(j) == 46);
+        assert_se(sd_journal_previous_skip(j, 2) == 2);
+        assert_se(current_number(j) == 43);
+        assert_se(sd_journal_next_skip(j, 3) == 3);
+        assert_se(current_number(j) == 47);
+        assert_se(sd_journal_previous(j) == 1);
+        assert_se(current_number(j) == 46);
+        assert_se(sd_journal_next_skip(j, 10) == 5);
+        assert_se(current_number(j) == 53);
+        assert_se(sd_journal_previous_skip(j, 20) == 9);
+        assert_se(current_number(j) == 40);
 
         assert_se(rm_rf_dangerous(t, false, true, false) >= 0);
 
@@ -25,7 +25,9 @@
 #include "journal.h"
 
 #include "log.h"
+#include "hash/hash.h"
 #include "journal-file.h"
+#include "journal-internal.h"
 #include "journal-vacuum.h"
 
 static bool arg_keep = false;
@@ -44,7 +46,7 @@ static void test_non_empty(void) {
         assert_se(mkdtemp(t));
         assert_se(chdir(t) >= 0);
 
-        assert_se(journal_file_open("test.journal", O_RDWR|O_CREAT, 0666, true, NULL, NULL, NULL, &f) == 0);
+        assert_se(journal_file_open("test.journal", O_RDWR|O_CREAT, 0666, true, false, NULL, NULL, NULL, &f) == 0);
 
         dual_timestamp_get(&ts);
 
@@ -112,8 +114,8 @@ static void test_non_empty(void) {
 
         assert(journal_file_move_to_entry_by_seqnum(f, 10, DIRECTION_DOWN, &o, NULL) == 0);
 
-        journal_file_rotate(&f, true);
-        journal_file_rotate(&f, true);
+        journal_file_rotate(&f, true, false);
+        journal_file_rotate(&f, true, false);
 
         journal_file_close(f);
 
@@ -139,13 +141,13 @@ static void test_empty(void) {
         assert_se(mkdtemp(t));
         assert_se(chdir(t) >= 0);
 
-        assert_se(journal_file_open("test.journal", O_RDWR|O_CREAT, 0666, false, NULL, NULL, NULL, &f1) == 0);
+        assert_se(journal_file_open("test.journal", O_RDWR|O_CREAT, 0666, false, false, NULL, NULL, NULL, &f1) == 0);
 
-        assert_se(journal_file_open("test-compress.journal", O_RDWR|O_CREAT, 0666, true, NULL, NULL, NULL, &f2) == 0);
+        assert_se(journal_file_open("test-compress.journal", O_RDWR|O_CREAT, 0666, true, false, NULL, NULL, NULL, &f2) == 0);
 
-        assert_se(journal_file_open("test-seal.journal", O_RDWR|O_CREAT, 0666, false, NULL, NULL, NULL, &f3) == 0);
+        assert_se(journal_file_open("test-seal.journal", O_RDWR|O_CREAT, 0666, false, false, NULL, NULL, NULL, &f3) == 0);
 
-        assert_se(journal_file_open("test-seal-compress.journal", O_RDWR|O_CREAT, 0666, true, NULL, NULL, NULL, &f4) == 0);
+        assert_se(journal_file_open("test-seal-compress.journal", O_RDWR|O_CREAT, 0666, true, false, NULL, NULL, NULL, &f4) == 0);
 
         journal_file_print_header(f1);
         puts("");
@@ -172,11 +174,338 @@ static void test_empty(void) {
         journal_file_close(f4);
 }
 
+static void test_compressed_data(void) {
+#if defined(HAVE_XZ) || defined(HAVE_LZ4)
+        dual_timestamp ts;
+        JournalFile *f;
+        struct iovec iovec, both[2];
+        char data[4096], other[2048];
+        Object *o;
+        uint64_t p, q, i;
+        char t[] = "/tmp/journal-XXXXXX";
+        const char *files[] = { "test-compress.journal", NULL };
+        const char * const fields[] = { "TEST", "MISSING" };
+        const char * const fields2[] = { "OTHER", "MISSING", "TEST" };
+        const void *d[ELEMENTSOF(fields2)];
+        size_t l[ELEMENTSOF(fields2)];
+        sd_journal *j;
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open("test-compress.journal", O_RDWR|O_CREAT, 0666, true, false, NULL, NULL, NULL, &f) == 0);
+
+        memcpy(data, "TEST=", 5);
+        for (i = 5; i < sizeof(data); i++)
+                data[i] = 'a' + i % ('z' - 'a' + 1);
+
+        dual_timestamp_get(&ts);
+
+        iovec.iov_base = data;
+        iovec.iov_len = sizeof(data);
+        assert_se(journal_file_append_entry(f, &ts, &iovec, 1, NULL, NULL, NULL) == 0);
+
+        assert_se(journal_file_find_data_object(f, data, sizeof(data), &o, &p) == 1);
+        assert_se(o->object.flags & OBJECT_COMPRESSION_MASK);
+
+        /* The object holds only the compressed payload, and the field
+         * object is appended right after it */
+        q = le64toh(o->object.size);
+        assert_se(q < offsetof(Object, data.payload) + sizeof(data));
+
+        assert_se(journal_file_move_to_object(f, -1, p + ALIGN64(q), &o) == 0);
+        assert_se(o->object.type == OBJECT_FIELD);
+
+        /* An entry with two compressed fields */
+        memcpy(other, "OTHER=", 6);
+        for (i = 6; i < sizeof(other); i++)
+                other[i] = 'z' - i % ('z' - 'a' + 1);
+
+        both[0].iov_base = other;
+        both[0].iov_len = sizeof(other);
+        both[1] = iovec;
+        assert_se(journal_file_append_entry(f, &ts, both, 2, NULL, NULL, NULL) == 0);
+
+        journal_file_close(f);
+
+        /* The batch lookup returns the whole decompressed payload */
+        assert_se(sd_journal_open_files(&j, files, 0) >= 0);
+        assert_se(sd_journal_set_data_threshold(j, 0) >= 0);
+        assert_se(sd_journal_next(j) > 0);
+        assert_se(sd_journal_get_fields(j, fields, ELEMENTSOF(fields), d, l) == 1);
+        assert_se(l[0] == sizeof(data) && memcmp(d[0], data, l[0]) == 0);
+        assert_se(!d[1] && l[1] == 0);
+
+        /* Each compressed field ends up in a buffer of its own, also
+         * when the buffers are reused */
+        assert_se(sd_journal_next(j) > 0);
+        for (i = 0; i < 2; i++) {
+                assert_se(sd_journal_get_fields(j, fields2, ELEMENTSOF(fields2), d, l) == 2);
+                assert_se(l[0] == sizeof(other) && memcmp(d[0], other, l[0]) == 0);
+                assert_se(!d[1] && l[1] == 0);
+                assert_se(l[2] == sizeof(data) && memcmp(d[2], data, l[2]) == 0);
+        }
+
+        /* With a threshold, at least that much is returned */
+        assert_se(sd_journal_set_data_threshold(j, 64) >= 0);
+        assert_se(sd_journal_get_fields(j, fields2, ELEMENTSOF(fields2), d, l) == 2);
+        assert_se(l[0] >= 64 && memcmp(d[0], other, 64) == 0);
+        assert_se(l[2] >= 64 && memcmp(d[2], data, 64) == 0);
+        sd_journal_close(j);
+
+        log_info("Done...");
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf_dangerous(t, false, true, false) >= 0);
+
+        puts("------------------------------------------------------------");
+#endif
+}
+
+static MissedField *find_missed_field(JournalFile *f, const char *field) {
+        unsigned i;
+
+        for (i = 0; i < MISSED_FIELDS_MAX; i++)
+                if (streq_ptr(f->missed_fields[i].field, field))
+                        return f->missed_fields + i;
+
+        return NULL;
+}
+
+static void test_absent_field(void) {
+        dual_timestamp ts;
+        JournalFile *f, *r;
+        struct iovec iovec[2];
+        static const char test[] = "TEST=1", late[] = "LATE=1";
+        char t[] = "/tmp/journal-XXXXXX";
+        const char *files[] = { "test-absent.journal", NULL };
+        const void *d;
+        size_t l;
+        MissedField *m;
+        sd_journal *j;
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open("test-absent.journal", O_RDWR|O_CREAT, 0666, true, false, NULL, NULL, NULL, &f) == 0);
+
+        dual_timestamp_get(&ts);
+
+        iovec[0].iov_base = (void*) test;
+        iovec[0].iov_len = strlen(test);
+        assert_se(journal_file_append_entry(f, &ts, iovec, 1, NULL, NULL, NULL) == 0);
+
+        assert_se(sd_journal_open_files(&j, files, 0) >= 0);
+        r = hashmap_first(j->files);
+        assert_se(r);
+
+        /* A field missed once is only remembered, and looked up in
+         * the file when it is missed again, even with other fields
+         * found in between */
+        assert_se(sd_journal_next(j) > 0);
+        assert_se(sd_journal_get_data(j, "LATE", &d, &l) == -ENOENT);
+        m = find_missed_field(r, "LATE");
+        assert_se(m && !m->probed);
+
+        assert_se(sd_journal_get_data(j, "TEST", &d, &l) == 0);
+        assert_se(l == strlen(test) && memcmp(d, test, l) == 0);
+
+        assert_se(sd_journal_get_data(j, "LATE", &d, &l) == -ENOENT);
+        assert_se(m->probed && m->absent);
+
+        /* Absent fields don't get in the way of present ones */
+        assert_se(sd_journal_get_data(j, "LATE", &d, &l) == -ENOENT);
+        assert_se(sd_journal_get_data(j, "TEST", &d, &l) == 0);
+        assert_se(l == strlen(test) && memcmp(d, test, l) == 0);
+
+        /* Once a writer adds the field, it is looked up again, and
+         * then known to be in the file */
+        iovec[1].iov_base = (void*) late;
+        iovec[1].iov_len = strlen(late);
+        assert_se(journal_file_append_entry(f, &ts, iovec, 2, NULL, NULL, NULL) == 0);
+
+        assert_se(sd_journal_get_data(j, "LATE", &d, &l) == -ENOENT);
+        assert_se(m->probed && !m->absent);
+        assert_se(sd_journal_get_data(j, "LATE", &d, &l) == -ENOENT);
+
+        assert_se(sd_journal_next(j) > 0);
+        assert_se(sd_journal_get_data(j, "LATE", &d, &l) == 0);
+        assert_se(l == strlen(late) && memcmp(d, late, l) == 0);
+
+        sd_journal_close(j);
+        journal_file_close(f);
+
+        log_info("Done...");
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf_dangerous(t, false, true, false) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_fields_windows(void) {
+        dual_timestamp ts;
+        JournalFile *f;
+        struct iovec iovec[2];
+        char t[] = "/tmp/journal-XXXXXX", p[32], m[32];
+        const char * const fields[] = { "BIG0", "BIG1" };
+        const void *d[ELEMENTSOF(fields)];
+        size_t l[ELEMENTSOF(fields)];
+        size_t size = 9 * 1024 * 1024;
+        char *big[ELEMENTSOF(fields)];
+        unsigned i, n = 0;
+        sd_journal *j;
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        dual_timestamp_get(&ts);
+
+        /* Enough files for the mmap cache to reuse windows */
+        for (i = 0; i < 70; i++) {
+                snprintf(p, sizeof(p), "test-small-%u.journal", i);
+                assert_se(journal_file_open(p, O_RDWR|O_CREAT, 0666, false, false, NULL, NULL, NULL, &f) == 0);
+
+                snprintf(m, sizeof(m), "MESSAGE=%u", i);
+                IOVEC_SET_STRING(iovec[0], m);
+                assert_se(journal_file_append_entry(f, &ts, iovec, 1, NULL, NULL, NULL) == 0);
+
+                journal_file_close(f);
+        }
+
+        /* An entry with uncompressed fields larger than a window */
+        assert_se(journal_file_open("test-big.journal", O_RDWR|O_CREAT, 0666, false, false, NULL, NULL, NULL, &f) == 0);
+
+        for (i = 0; i < ELEMENTSOF(fields); i++) {
+                big[i] = malloc(size);
+                assert_se(big[i]);
+
+                snprintf(big[i], size, "%s=", fields[i]);
+                memset(big[i] + strlen(big[i]), 'a' + i, size - strlen(big[i]));
+
+                iovec[i].iov_base = big[i];
+                iovec[i].iov_len = size;
+        }
+
+        ts.realtime++;
+        assert_se(journal_file_append_entry(f, &ts, iovec, ELEMENTSOF(fields), NULL, NULL, NULL) == 0);
+        journal_file_close(f);
+
+        /* The data of all fields stays mapped until the next call */
+        assert_se(sd_journal_open_directory(&j, t, 0) >= 0);
+        assert_se(sd_journal_set_data_threshold(j, 0) >= 0);
+
+        SD_JOURNAL_FOREACH(j) {
+                if (sd_journal_get_fields(j, fields, ELEMENTSOF(fields), d, l) < (int) ELEMENTSOF(fields))
+                        continue;
+
+                for (i = 0; i < ELEMENTSOF(fields); i++)
+                        assert_se(l[i] == size && memcmp(d[i], big[i], size) == 0);
+
+                n++;
+        }
+        assert_se(n == 1);
+
+        sd_journal_close(j);
+
+        for (i = 0; i < ELEMENTSOF(fields); i++)
+                free(big[i]);
+
+        log_info("Done...");
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf_dangerous(t, false, true, false) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_bloom(void) {
+        dual_timestamp ts;
+        JournalFile *f;
+        struct iovec iovec;
+        char data[32];
+        Object *o;
+        uint64_t hash, p;
+        unsigned i, n_false = 0;
+        char t[] = "/tmp/journal-XXXXXX";
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open("test-bloom.journal", O_RDWR|O_CREAT, 0666, true, false, NULL, NULL, NULL, &f) == 0);
+        assert_se(JOURNAL_HEADER_BLOOM(f->header));
+        assert_se(f->bloom);
+
+        dual_timestamp_get(&ts);
+
+        for (i = 0; i < 1000; i++) {
+                iovec.iov_base = data;
+                iovec.iov_len = snprintf(data, sizeof(data), "NUMBER=%u", i);
+                assert_se(journal_file_append_entry(f, &ts, &iovec, 1, NULL, NULL, NULL) == 0);
+        }
+
+        journal_file_print_header(f);
+        journal_file_close(f);
+
+        /* Files are reopened with the filter, and there are no false
+         * negatives */
+        assert_se(journal_file_open("test-bloom.journal", O_RDONLY, 0, true, false, NULL, NULL, NULL, &f) == 0);
+        assert_se(f->bloom);
+
+        for (i = 0; i < 1000; i++) {
+                snprintf(data, sizeof(data), "NUMBER=%u", i);
+                hash64(data, strlen(data), &hash);
+                assert_se(journal_file_bloom_may_contain(f, hash));
+                assert_se(journal_file_find_data_object(f, data, strlen(data), &o, &p) == 1);
+        }
+
+        /* Few values which were never written get past the filter */
+        for (i = 1000; i < 11000; i++) {
+                snprintf(data, sizeof(data), "NUMBER=%u", i);
+                hash64(data, strlen(data), &hash);
+                if (journal_file_bloom_may_contain(f, hash))
+                        n_false++;
+                assert_se(journal_file_find_data_object(f, data, strlen(data), NULL, NULL) == 0);
+        }
+
+        log_info("Bloom filter false positives: %u of 10000", n_false);
+        assert_se(n_false < 500);
+
+        journal_file_close(f);
+
+        log_info("Done...");
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf_dangerous(t, false, true, false) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
 int main(int argc, char *argv[]) {
         arg_keep = argc > 1;
 
         test_non_empty();
         test_empty();
+        test_compressed_data();
+        test_absent_field();
+        test_fields_windows();
+        test_bloom();
 
         return 0;
 }
@@ -0,0 +1,140 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  Copyright 2013 Lennart Poettering
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdlib.h>
+
+#include "prioq.h"
+#include "util.h"
+
+#define SET_SIZE 1024*4
+
+static int unsigned_compare(const void *a, const void *b) {
+        const unsigned *x = a, *y = b;
+
+        if (*x < *y)
+                return -1;
+
+        if (*x > *y)
+                return 1;
+
+        return 0;
+}
+
+static void test_unsigned(void) {
+        unsigned buffer[SET_SIZE], i;
+        Prioq *q;
+
+        srand(0);
+
+        q = prioq_new(trivial_compare_func);
+        assert_se(q);
+
+        for (i = 0; i < ELEMENTSOF(buffer); i++) {
+                unsigned u;
+
+                u = (unsigned) rand();
+                buffer[i] = u;
+                assert_se(prioq_put(q, UINT_TO_PTR(u), NULL) >= 0);
+        }
+
+        qsort(buffer, ELEMENTSOF(buffer), sizeof(buffer[0]), unsigned_compare);
+
+        for (i = 0; i < ELEMENTSOF(buffer); i++) {
+                unsigned u;
+
+                assert_se(prioq_size(q) == ELEMENTSOF(buffer) - i);
+
+                u = PTR_TO_UINT(prioq_pop(q));
+                assert_se(buffer[i] == u);
+        }
+
+        assert_se(prioq_isempty(q));
+        prioq_free(q);
+}
+
+struct test {
+        unsigned value;
+        unsigned idx;
+};
+
+static int test_compare(const void *a, const void *b) {
+        const struct test *x = a, *y = b;
+
+        if (x->value < y->value)
+                return -1;
+
+        if (x->value > y->value)
+                return 1;
+
+        return 0;
+}
+
+static void test_struct(void) {
+        struct test items[SET_SIZE], *t, *p = NULL;
+        unsigned i, n = 0;
+        Prioq *q;
+
+        srand(0);
+
+        q = prioq_new(test_compare);
+        assert_se(q);
+
+        for (i = 0; i < ELEMENTSOF(items); i++) {
+                items[i].value = (unsigned) rand();
+                assert_se(prioq_put(q, items + i, &items[i].idx) >= 0);
+        }
+
+        /* Remove every third element, and move every fifth one to
+         * the end by changing its priority */
+        for (i = 0; i < ELEMENTSOF(items); i++) {
+                if (i % 3 == 0) {
+                        assert_se(prioq_remove(q, items + i, &items[i].idx) == 1);
+                        assert_se(items[i].idx == PRIOQ_IDX_NULL);
+                        assert_se(prioq_remove(q, items + i, &items[i].idx) == 0);
+                } else if (i % 5 == 0) {
+                        items[i].value = (unsigned) -1;
+                        assert_se(prioq_reshuffle(q, items + i, &items[i].idx) == 1);
+                }
+        }
+
+        while ((t = prioq_pop(q))) {
+                assert_se(t->idx == PRIOQ_IDX_NULL);
+
+                if (p)
+                        assert_se(test_compare(p, t) <= 0);
+
+                p = t;
+                n++;
+        }
+
+        assert_se(n == ELEMENTSOF(items) - (ELEMENTSOF(items) + 2) / 3);
+        assert_se(p->value == (unsigned) -1);
+
+        prioq_free(q);
+}
+
+int main(int argc, char* argv[]) {
+
+        test_unsigned();
+        test_struct();
+
+        return 0;
+}